@@ -0,0 +1,367 @@
+// bench.cpp
+
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+* Author: Vyacheslav Brover
+*
+* File Description:
+*   Benchmark of the stx typing stages
+*
+*/
+
+
+#undef NDEBUG
+
+#include "common.hpp"
+#include "tsv.hpp"
+using namespace Common_sp;
+#include "stx.hpp"
+using namespace Stx_sp;
+
+#include "common.inc"
+
+#include <chrono>
+#include <new>
+
+
+
+namespace
+{
+
+
+atomic<size_t> allocs {0};
+atomic<size_t> allocBytes {0};
+
+
+
+void* allocate (size_t size)
+{
+  allocs++;
+  allocBytes += size;
+  if (void* p = malloc (size ? size : 1))
+    return p;
+  throw bad_alloc ();
+}
+
+
+}
+
+
+
+// The scalar and array forms are replaced together and are not inlined,
+// so that an allocation of malloc() is always released by free()
+
+[[gnu::noinline]] void* operator new (size_t size)
+{
+  return allocate (size);
+}
+
+[[gnu::noinline]] void* operator new[] (size_t size)
+{
+  return allocate (size);
+}
+
+[[gnu::noinline]] void operator delete (void* p) noexcept
+{
+  free (p);
+}
+
+[[gnu::noinline]] void operator delete[] (void* p) noexcept
+{
+  free (p);
+}
+
+[[gnu::noinline]] void operator delete (void* p,
+                                        size_t) noexcept
+{
+  free (p);
+}
+
+[[gnu::noinline]] void operator delete[] (void* p,
+                                          size_t) noexcept
+{
+  free (p);
+}
+
+
+
+namespace
+{
+
+
+struct Stage
+{
+  string name;
+  double ns {0.0};
+  size_t allocs {0};
+  size_t allocBytes {0};
+};
+
+
+
+struct Timer
+// Adds the time and the allocations of its scope to a Stage
+{
+private:
+  Stage &stage;
+  const chrono::steady_clock::time_point start;
+  const size_t allocs_start;
+  const size_t allocBytes_start;
+public:
+
+  explicit Timer (Stage &stage_arg)
+    : stage (stage_arg)
+    , start (chrono::steady_clock::now ())
+    , allocs_start (allocs)
+    , allocBytes_start (allocBytes)
+    {}
+ ~Timer ()
+    { stage. ns         += (double) chrono::duration_cast<chrono::nanoseconds> (chrono::steady_clock::now () - start). count ();
+      stage. allocs     += allocs     - allocs_start;
+      stage. allocBytes += allocBytes - allocBytes_start;
+    }
+};
+
+
+
+StringVector searchFasta (const string &fName,
+                          const string &protFName)
+// Return: tblastn lines of the built-in search of fName
+{
+  const NativeSearch native (protFName);
+  Vector<NativeSearch::Hit> hits;
+  size_t seqs = 0;
+  size_t len = 0;
+  {
+    string id;
+    string seq;
+    auto processSeq = [&] ()
+      { if (id. empty ())
+          return;
+        native. search (id, seq, hits);
+        seqs++;
+        len += seq. size ();
+      };
+    LineInput f (fName);
+    while (f. nextLine ())
+    {
+      trimTrailing (f. line);
+      if (isLeft (f. line, ">"))
+      {
+        processSeq ();
+        id = f. line. substr (1);
+        id = findSplit (id);
+        seq. clear ();
+      }
+      else
+        seq += f. line;
+    }
+    processSeq ();
+  }
+  QC_ASSERT (seqs);
+  return native. finish (std::move (hits), len, seqs, 1e-10);
+}
+
+
+
+struct ThisApplication : Application
+{
+  ThisApplication ()
+    : Application ("Benchmark of the stx typing stages on the BLAST hits of an assembly: time per hit and memory allocations per hit.\nThe hits are found by the built-in search, or read from a tblastn output")
+    {
+      addPositional ("in", "Nucleotide FASTA file, or tblastn output if -tblastn");
+      addFlag ("tblastn", "IN is a tblastn output: -outfmt '6 qseqid sseqid qstart qend qlen sstart send slen qseq sseq'");
+      addKey ("stx_prot", "stx reference proteins", "stx.prot");
+      addKey ("copies", "Number of copies of the hits on renamed contigs, for a synthetic input with a high number of hits", "1");
+      addKey ("repeat", "Number of runs", "10");
+	    version = SVN_REV;
+    }
+
+
+
+  void body () const final
+  {
+    const string inFName   = getArg ("in");
+    const bool   tblastnP  = getFlag ("tblastn");
+    const string protFName = getArg ("stx_prot");
+    const size_t copies    = str2<size_t> (getArg ("copies"));
+    const size_t repeat    = str2<size_t> (getArg ("repeat"));
+    QC_ASSERT (copies);
+    QC_ASSERT (repeat);
+
+    checkStxRefs (protFName);
+
+    StringVector lines;
+    if (tblastnP)
+    {
+      LineInput f (inFName);
+      while (f. nextLine ())
+        if (! f. line. empty ())
+          lines << f. line;
+    }
+    else
+      lines = searchFasta (inFName, protFName);
+    if (copies > 1)
+    {
+      const StringVector lines1 (std::move (lines));
+      lines. clear ();
+      lines. reserve (lines1. size () * copies);
+      FFOR (size_t, i, copies)
+        for (const string& line : lines1)
+        {
+          const size_t pos = line. find ('\t');
+          QC_ASSERT (pos != string::npos);
+          lines << line. substr (0, pos) + "_" + to_string (i + 1) + line. substr (pos);
+        }
+    }
+    const size_t hits = lines. size ();
+    QC_ASSERT (hits);
+
+    Vector<Stage> stages;
+    for (const char* name : {"parsing", "grouping", "frameshift", "goodBlastAls", "operons_same_type", "operons_strong", "operons_weak", "goodOperons", "single_subunit", "report"})
+      stages << Stage {name};
+    enum {parsing, grouping, frameshift, goodBlastAls_, same, strong, weak, goodOperons_, single, report};
+
+    TsvOut noLogTd (nullptr);
+    size_t reportLen = 0;
+    FFOR (size_t, run, repeat)
+    {
+      deque<BlastAlignment> alignments;
+      StringArena arena;
+      ContigNames contigs;
+      VectorPtr<BlastAlignment> blastAls;
+      {
+        const Timer t (stages [parsing]);
+        for (const string& line : lines)
+        {
+          alignments. emplace_back (line, arena, contigs);
+          blastAls << & alignments. back ();
+        }
+        contigs. index ();
+        for (BlastAlignment& al : alignments)
+          al. targetIndex = contigs [al. targetName];
+      }
+
+      Vector<VectorPtr<BlastAlignment>> groups;
+      {
+        const Timer t (stages [grouping]);
+        blastAls. sort (BlastAlignment::frameshiftLess);
+        for (const BlastAlignment* al : blastAls)
+        {
+          if (   groups. empty ()
+              || groups. back (). front () -> targetIndex  != al->targetIndex
+              || groups. back (). front () -> targetStrand != al->targetStrand
+             )
+            groups << VectorPtr<BlastAlignment> ();
+          groups. back () << al;
+        }
+      }
+
+      // As blastAls2operons()
+      Vector<Operon> goodOperons;
+      for (VectorPtr<BlastAlignment>& group : groups)
+      {
+        { const Timer t (stages [frameshift]);
+          mergeFrameshifts (group, noLogTd);
+        }
+        VectorPtr<BlastAlignment> goodBlastAls;
+        { const Timer t (stages [goodBlastAls_]);
+          goodBlastAls = selectGoodBlasts (group, noLogTd);
+        }
+        Vector<Operon> operons;
+        { const Timer t (stages [same]);
+          goodBlasts2operons (goodBlastAls, operons, true, true, noLogTd);
+        }
+        { const Timer t (stages [strong]);
+          goodBlastAls. sort (BlastAlignment::less);
+          goodBlasts2operons (goodBlastAls, operons, false, true, noLogTd);
+        }
+        { const Timer t (stages [weak]);
+          goodBlasts2operons (goodBlastAls, operons, false, false, noLogTd);
+        }
+        { const Timer t (stages [goodOperons_]);
+          selectGoodOperons (operons, goodOperons, noLogTd);
+        }
+        { const Timer t (stages [single]);
+          singleSubunitOperons (goodBlastAls, goodOperons, noLogTd);
+        }
+      }
+
+      {
+        ostringstream os;
+        {
+          const Timer t (stages [report]);
+          TsvOut td (os, 2, false);
+          goodOperons. sort (Operon::reportLess);
+          for (const Operon& op : goodOperons)
+            op. saveTsvOut (td, false);
+        }
+        if (! run)
+          reportLen = os. str (). size ();
+        QC_ASSERT (os. str (). size () == reportLen);
+      }
+    }
+
+    cerr << "Hits: " << hits << endl;
+    cerr << "Runs: " << repeat << endl;
+    TsvOut td (cout, 2, false);
+    td << "stage" << "ns_per_hit" << "allocations_per_hit" << "allocated_bytes_per_hit";
+    td. newLn ();
+    Stage total {"total"};
+    const double n = (double) (hits * repeat);
+    for (const Stage& stage : stages)
+    {
+      td << stage. name
+         << stage. ns / n
+         << (double) stage. allocs / n
+         << (double) stage. allocBytes / n;
+      td. newLn ();
+      total. ns         += stage. ns;
+      total. allocs     += stage. allocs;
+      total. allocBytes += stage. allocBytes;
+    }
+    td << total. name
+       << total. ns / n
+       << (double) total. allocs / n
+       << (double) total. allocBytes / n;
+    td. newLn ();
+  }
+};
+
+
+
+}  // namespace
+
+
+
+int main (int argc,
+          const char* argv[])
+{
+  ThisApplication app;
+  return app. run (argc, argv);
+}
+
+
+
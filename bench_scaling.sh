@@ -0,0 +1,101 @@
+#!/bin/bash
+
+# End-to-end throughput of stxtyper on a corpus made by stxtyper_corpus
+# Usage: bench_scaling.sh <corpus dir> ["<threads> ..."] ["<mode> ..."]
+#   mode: native | tblastn | tiered | no_prescreen
+# Output: a tab-delimited line per run:
+#   each assembly of the corpus, then the whole manifest in the --batch mode (sample "batch")
+# Timings and peak memory are taken from the --stats output
+
+CORPUS="$1"
+THREADS="${2:-1}"
+MODES="${3:-native tblastn}"
+STXTYPER="${STXTYPER:-./stxtyper}"
+
+if [ ! -e "$CORPUS/corpus.tsv" ]
+then
+    echo "$CORPUS/corpus.tsv is not found, run stxtyper_corpus first" >&2
+    exit 1
+fi
+
+STATS=$(mktemp)
+OUT=$(mktemp)
+trap "rm -f $STATS $OUT" EXIT
+
+STAGES="fasta_check native_search makeblastdb tblastn parsing operons"
+
+# $1: JSON object name, $2: key
+function stats_value {
+    grep -o "\"$1\":{[^}]*}" $STATS | grep -o "\"$2\":[0-9.]*" | cut -d: -f2
+}
+
+function stats_counter {
+    grep -o "\"$1\":[0-9]*" $STATS | head -1 | cut -d: -f2
+}
+
+# $1: mode, $2: threads, $3: sample, $4: samples, $5: bp, $6: planted operons, $7...: stxtyper input parameters
+function run {
+    local mode=$1
+    local threads=$2
+    local sample=$3
+    local samples=$4
+    local bp=$5
+    local planted=$6
+    shift 6
+    local options="--threads $threads --stats $STATS"
+    case $mode in
+        native)       options="$options --engine native" ;;
+        tblastn)      ;;
+        tiered)       options="$options --tiered" ;;
+        no_prescreen) options="$options --no_prescreen" ;;
+        *)            echo "Unknown mode: $mode" >&2; exit 1 ;;
+    esac
+    if ! $STXTYPER $options -q "$@" > $OUT 2> /dev/null
+    then
+        echo "# $mode $threads $sample: $STXTYPER failed" >&2
+        return 1
+    fi
+    local wall=$(stats_value total wall_sec)
+    local rss=$(stats_value total peak_rss_kb)
+    local child_rss=$(stats_value total peak_child_rss_kb)
+    local reported=$(grep -vc '^#' $OUT)
+    local line="$mode	$threads	$sample	$samples	$bp	$planted	$reported	$wall"
+    line="$line	$(awk -v n=$samples -v t=$wall 'BEGIN {printf "%.3f", (t > 0 ? n / t : 0)}')"
+    line="$line	$(awk -v n=$bp      -v t=$wall 'BEGIN {printf "%.0f", (t > 0 ? n / t : 0)}')"
+    line="$line	$rss	$child_rss"
+    for stage in $STAGES
+    do
+        local w=$(stats_value $stage wall_sec)
+        line="$line	${w:-0}"
+    done
+    echo "$line"
+}
+
+HEADER="#mode	threads	sample	samples	bp	planted_operons	reported_operons	wall_sec	samples_per_sec	bp_per_sec	peak_rss_kb	peak_child_rss_kb"
+for stage in $STAGES
+do
+    HEADER="$HEADER	${stage}_sec"
+done
+echo "$HEADER"
+
+for mode in $MODES
+do
+    for threads in $THREADS
+    do
+        samples=0
+        bp_total=0
+        planted_total=0
+        while IFS=$'\t' read name file contigs bp operons decoys
+        do
+            [ "${name:0:1}" == "#" ] && continue
+            run $mode $threads $name 1 $bp $operons -n "$file" < /dev/null || continue
+            samples=$(( $samples + 1 ))
+            bp_total=$(( $bp_total + $bp ))
+            planted_total=$(( $planted_total + $operons ))
+        done < "$CORPUS/corpus.tsv"
+        if [ $samples -gt 0 ]
+        then
+            run $mode $threads batch $samples $bp_total $planted_total --batch "$CORPUS/manifest.tsv"
+        fi
+    done
+done
@@ -39,13 +39,22 @@
 #include <sstream>
 #include <cstring>
 #include <regex>
+#include <chrono>
 #include <csignal>  
+#include <zlib.h>
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
 #ifndef _MSC_VER
   extern "C"
   {
 	  #include <execinfo.h>
 	  #include <sys/types.h>
 	  #include <sys/stat.h>
+	  #include <sys/resource.h>
+	  #include <sys/mman.h>
+	  #include <sys/statvfs.h>
+	  #include <fcntl.h>
 	  #include <unistd.h>
 	  #include <dirent.h>
 	  #ifdef __APPLE__
@@ -259,6 +268,9 @@ namespace
   }
   //system (("env >> " + logFName). c_str ());
 
+  if (! segmFault)
+    try { Trace::dump (*os); }
+      catch (...) {}
   os->flush ();           
 
   if (cxml)
@@ -394,6 +406,94 @@ void Chronometer::print (ostream &os) const
  
 
 
+// ResourceChronometer
+
+namespace
+{
+
+double getWallTime ()
+{
+  return (double) chrono::duration_cast<chrono::microseconds> (chrono::steady_clock::now (). time_since_epoch ()). count () / 1e6;
+}
+
+
+#ifndef _MSC_VER
+double rusage2cpu (const rusage &ru)
+{
+  return   (double) ru. ru_utime. tv_sec + (double) ru. ru_utime. tv_usec / 1e6
+         + (double) ru. ru_stime. tv_sec + (double) ru. ru_stime. tv_usec / 1e6;
+}
+#endif
+
+}
+
+
+
+void ResourceChronometer::start ()
+{
+  if (wallStart >= 0.0)
+    throw runtime_error (FUNC "ResourceChronometer \"" + name + "\" is not stopped");
+  wallStart = getWallTime ();
+#ifndef _MSC_VER
+  rusage self, children;
+  EXEC_ASSERT (! getrusage (RUSAGE_SELF,     & self));
+  EXEC_ASSERT (! getrusage (RUSAGE_CHILDREN, & children));
+  cpuStart = rusage2cpu (self) + rusage2cpu (children);
+#endif
+}
+
+
+
+void ResourceChronometer::stop ()
+{
+  if (wallStart < 0.0)
+    throw runtime_error (FUNC "ResourceChronometer \"" + name + "\" is not started");
+  wall += getWallTime () - wallStart;
+  wallStart = -1.0;
+#ifndef _MSC_VER
+  rusage self, children;
+  EXEC_ASSERT (! getrusage (RUSAGE_SELF,     & self));
+  EXEC_ASSERT (! getrusage (RUSAGE_CHILDREN, & children));
+  cpu += rusage2cpu (self) + rusage2cpu (children) - cpuStart;
+  // ru_maxrss is in bytes on Mac OS
+  #ifdef __APPLE__
+    constexpr long unit = 1024;
+  #else
+    constexpr long unit = 1;
+  #endif
+  maximize (rss_max,      (size_t) (self.     ru_maxrss / unit));
+  maximize (childRss_max, (size_t) (children. ru_maxrss / unit));
+#endif
+  runs++;
+}
+
+
+
+void ResourceChronometer::add (const ResourceChronometer &other)
+{
+  ASSERT (other. wallStart < 0.0);
+  wall += other. wall;
+  cpu  += other. cpu;
+  maximize (rss_max,      other. rss_max);
+  maximize (childRss_max, other. childRss_max);
+  runs += other. runs;
+}
+
+
+
+void ResourceChronometer::saveJson (JsonContainer* parent) const
+{
+  auto j = new JsonMap (parent, name);
+  new JsonDouble (wall, 3, j, "wall_sec");
+  new JsonDouble (cpu,  3, j, "cpu_sec");
+  new JsonInt ((long long) rss_max,      j, "peak_rss_kb");
+  new JsonInt ((long long) childRss_max, j, "peak_child_rss_kb");
+  new JsonInt ((long long) runs,         j, "runs");
+}
+
+
+
+
 // Chronometer_OnePass
 
 Chronometer_OnePass::Chronometer_OnePass (const string &name_arg,
@@ -905,6 +1005,32 @@ string strQuote (const string &s,
 
 
 
+string jsonQuote (const string &s)
+{
+  string res ("\"");
+  for (const char c : s)
+    switch (c)
+    {
+      case '\"': res += "\\\""; break;
+      case '\\': res += "\\\\"; break;
+      case '\n': res += "\\n"; break;
+      case '\r': res += "\\r"; break;
+      case '\t': res += "\\t"; break;
+      default:
+        if ((unsigned char) c < ' ')
+        {
+          char buf [8];
+          snprintf (buf, sizeof (buf), "\\u%04x", (unsigned) c);
+          res += buf;
+        }
+        else
+          res += c;
+    }
+  return res + "\"";
+}
+
+
+
 string to_c (const string &s)
 {
   string r;
@@ -1588,19 +1714,131 @@ Unverbose::~Unverbose ()
 
 
 
+// Trace
+
+atomic<int> Trace::level {0};
+
+
+
+namespace
+{
+  
+struct TraceRecord
+{
+  size_t num {0};
+    // Global order
+  int level {0};
+  string text;
+};
+
+
+
+struct TraceRing;
+
+mutex traceMtx;
+  // Guards traceRings, traceRetired
+set<TraceRing*> traceRings;
+vector<TraceRecord> traceRetired;
+  // Records of the finished threads, at most Trace::ring_size
+atomic<size_t> traceNum {0};
+atomic<size_t> traceThreads {0};
+
+
+
+struct TraceRing
+{
+  const size_t threadNum;
+  mutex mtx;
+  vector<TraceRecord> records;
+  size_t next {0};
+    // Index in records to be overwritten if records.size() = Trace::ring_size
+
+
+  TraceRing ()
+    : threadNum (traceThreads++)
+    { const lock_guard<mutex> lock (traceMtx);
+      traceRings. insert (this);
+    }
+ ~TraceRing ()
+    { const lock_guard<mutex> lock (traceMtx);
+      traceRings. erase (this);
+      for (TraceRecord& rec : records)
+        traceRetired. push_back (std::move (rec));
+      if (traceRetired. size () > Trace::ring_size)
+      {
+        std::sort (traceRetired. begin (), traceRetired. end (), [] (const TraceRecord &a, const TraceRecord &b) { return a. num < b. num; });
+        traceRetired. erase (traceRetired. begin (), traceRetired. end () - (long) Trace::ring_size);
+      }
+    }
+
+
+  void add (TraceRecord &&rec)
+    { const lock_guard<mutex> lock (mtx);  // Not contended, except by Trace::dump()
+      if (records. size () < Trace::ring_size)
+        records. push_back (std::move (rec));
+      else
+      {
+        records [next] = std::move (rec);
+        next = (next + 1) % Trace::ring_size;
+      }
+    }
+};
+
+}
+
+
+
+void Trace::add (int level_arg,
+                 string &&text)
+{
+  static thread_local TraceRing ring;
+  TraceRecord rec;
+  rec. num = traceNum++;
+  rec. level = level_arg;
+  rec. text = std::move (text);
+  ring. add (std::move (rec));
+}
+
+
+
+void Trace::dump (ostream &os)
+{
+  vector<pair<size_t/*threadNum*/,TraceRecord>> all;
+  {
+    const lock_guard<mutex> lock (traceMtx);
+    for (TraceRecord& rec : traceRetired)
+      all. push_back (make_pair (no_index, std::move (rec)));
+    traceRetired. clear ();
+    for (TraceRing* ring : traceRings)
+    {
+      const lock_guard<mutex> ringLock (ring->mtx);
+      for (TraceRecord& rec : ring->records)
+        all. push_back (make_pair (ring->threadNum, std::move (rec)));
+      ring->records. clear ();
+      ring->next = 0;
+    }
+  }
+  if (all. empty ())
+    return;
+  std::sort (all. begin (), all. end (), [] (const auto &a, const auto &b) { return a. second. num < b. second. num; });
+  os << "# Trace: thread, level, record" << endl;
+  for (const auto& it : all)
+    os << (it. first == no_index ? string ("-") : to_string (it. first)) << '\t' << it. second. level << '\t' << it. second. text << '\n';
+  os. flush ();
+}
+
+
+
+
 //
 
-void exec (const string &cmd,
-           const string &logFName)
+namespace
 {
-  ASSERT (! cmd. empty ());
   
-//Chronometer_OnePass cop (cmd);  
-  if (verbose ())
-  	cout << cmd << endl;
-  LOG (cmd);
-  	
-	const int status = system (cmd. c_str ());  // pipefail's are not caught
+void checkExecStatus (const string &cmd,
+                      int status,
+                      const string &logFName)
+{
 	LOG ("status = " + to_string (status));
 	if (status)
 	{
@@ -1613,6 +1851,24 @@ void exec (const string &cmd,
 		throw runtime_error (err);		
 	}
 }
+  
+}
+
+
+
+void exec (const string &cmd,
+           const string &logFName)
+{
+  ASSERT (! cmd. empty ());
+  
+//Chronometer_OnePass cop (cmd);  
+  if (verbose ())
+  	cout << cmd << endl;
+  LOG (cmd);
+  	
+	const int status = system (cmd. c_str ());  // pipefail's are not caught
+	checkExecStatus (cmd, status, logFName);
+}
 
 
 
@@ -1683,6 +1939,189 @@ Threads::~Threads ()
 
 
 
+// ThreadPool
+
+thread_local const ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local size_t ThreadPool::currentWorker = no_index;
+
+
+
+ThreadPool::ThreadPool (size_t threads_arg)
+{
+  FFOR (size_t, i, threads_arg + 1)
+    deques. emplace_back (new TaskDeque ());
+  threads. reserve (threads_arg);
+  FFOR (size_t, i, threads_arg)
+    threads. emplace_back (& ThreadPool::work, this, i);
+}
+
+
+
+ThreadPool::~ThreadPool ()
+{
+  {
+    const lock_guard<mutex> lock (sleepMtx);
+    stopping = true;
+  }
+  sleepCv. notify_all ();
+  for (thread& t : threads)
+    t. join ();
+}
+
+
+
+ThreadPool& ThreadPool::global ()
+{
+  ASSERT (threads_max >= 1);
+  static ThreadPool* pool = new ThreadPool (threads_max - 1);
+  return *pool;
+}
+
+
+
+void ThreadPool::push (function<void ()> &&func,
+                       TaskGroup &group)
+{
+  const size_t i = currentPool == this ? currentWorker : deques. size () - 1;
+  {
+    // The counters and the deque are changed together, so that a thread sleeping until a task is queued is woken up
+    const lock_guard<mutex> lock (sleepMtx);
+    queued++;
+    group. queued++;
+    TaskDeque& d = * deques [i];
+    const lock_guard<mutex> lock_d (d. mtx);
+    d. tasks. push_back (Task {std::move (func), & group});
+  }
+  // The waiting thread of group or a worker
+  sleepCv. notify_all ();
+}
+
+
+
+bool ThreadPool::pop (Task &task,
+                      const TaskGroup* group)
+{
+  auto take = [this, &task, group] (size_t i, 
+                                    bool back)
+    {
+      TaskDeque& d = * deques [i];
+      {
+        const lock_guard<mutex> lock (d. mtx);
+        if (d. tasks. empty ())
+          return false;
+        if (! group)
+        {
+          if (back)
+          {
+            task = std::move (d. tasks. back ());
+            d. tasks. pop_back ();
+          }
+          else
+          {
+            task = std::move (d. tasks. front ());
+            d. tasks. pop_front ();
+          }
+        }
+        else if (back)
+        {
+          const auto it = find_if (d. tasks. rbegin (), d. tasks. rend (), [group] (const Task &t) { return t. group == group; });
+          if (it == d. tasks. rend ())
+            return false;
+          task = std::move (*it);
+          d. tasks. erase (std::next (it). base ());
+        }
+        else
+        {
+          const auto it = find_if (d. tasks. begin (), d. tasks. end (), [group] (const Task &t) { return t. group == group; });
+          if (it == d. tasks. end ())
+            return false;
+          task = std::move (*it);
+          d. tasks. erase (it);
+        }
+      }
+      const lock_guard<mutex> lock (sleepMtx);
+      ASSERT (queued);
+      ASSERT (task. group->queued);
+      queued--;
+      task. group->queued--;
+      return true;
+    };
+  
+  const size_t shared = deques. size () - 1;
+  const size_t own = currentPool == this ? currentWorker : shared;
+  // The own deque of a worker is LIFO for locality, the other deques are FIFO
+  if (take (own, own != shared))
+    return true;
+  if (own != shared && take (shared, false))
+    return true;
+  const size_t start = own == shared ? 0 : own + 1;
+  FFOR (size_t, k, shared)
+  {
+    const size_t i = (start + k) % shared;
+    if (i != own && take (i, false))
+      return true;
+  }
+  return false;
+}
+
+
+
+bool ThreadPool::runOne (TaskGroup* group)
+{
+  Task task;
+  if (! pop (task, group))
+    return false;
+  task. func ();
+  return true;
+}
+
+
+
+void ThreadPool::work (size_t worker)
+{
+  currentPool = this;
+  currentWorker = worker;
+  for (;;)
+  {
+    if (runOne (nullptr))
+      continue;
+    unique_lock<mutex> lock (sleepMtx);
+    sleepCv. wait (lock, [this] () { return stopping || queued; });
+    if (stopping && ! queued)
+      break;
+  }
+}
+
+
+
+// TaskGroup
+
+void TaskGroup::run (function<void ()> &&task)
+{
+  pending++;
+  auto wrapped = [this, task = std::move (task)] ()
+    {
+      try { task (); }
+        catch (...)
+        {
+          const lock_guard<mutex> lock (errorMtx);
+          if (! error)
+            error = current_exception ();
+        }
+      ThreadPool& pool_ = pool;
+      pending--;
+        // *this can be destroyed
+      pool_. wakeAll ();  // waitBelow()
+    };
+  if (pool. size ())
+    pool. push (std::move (wrapped), *this);
+  else
+    wrapped ();
+}
+
+
+
+
 // Xml
 
 // Xml::TextFile
@@ -2083,6 +2522,24 @@ void TextPos::dec ()
 
 // Input
 
+Input::Input (const string &fName,
+              uint displayPeriod)
+: prog (0, displayPeriod)  
+{ 
+  if (isGzipped (fName))
+  {
+    gzs. reset (new GzipIStream (fName));
+    is = gzs. get ();
+  }
+  else
+  {
+    ifs. open (fName);
+    is = & ifs;
+  }
+}
+
+
+
 Input::Input (istream &is_arg,
 	            uint displayPeriod)
 : is (& is_arg)
@@ -2153,6 +2610,37 @@ bool LineInput::nextLine ()
 
 
 
+// FastqInput
+
+bool FastqInput::nextRecord ()
+{
+  do
+    if (! nextLine ())
+      return false;
+  while (line. empty ());
+  if (line [0] != '@')
+    throw runtime_error (lineStr (false) + ": '@' is expected");
+  id = line. substr (1);
+  id = findSplit (id);
+  if (id. empty ())
+    throw runtime_error (lineStr (false) + ": empty read identifier");
+  if (! nextLine ())
+    throw runtime_error ("Read " + strQuote (id) + ": no sequence");
+  trimTrailing (line);
+  seq = std::move (line);
+  if (! nextLine () || line. empty () || line [0] != '+')
+    throw runtime_error ("Read " + strQuote (id) + ", " + lineStr (false) + ": '+' is expected");
+  if (! nextLine ())
+    throw runtime_error ("Read " + strQuote (id) + ": no qualities");
+  trimTrailing (line);
+  if (line. size () != seq. size ())
+    throw runtime_error ("Read " + strQuote (id) + ", " + lineStr (false) + ": the numbers of qualities and of nucleotides differ");
+  return true;
+}
+
+
+
+
 // CharInput
 
 char CharInput::get ()
@@ -2209,7 +2697,8 @@ string CharInput::getLine ()
 
 void Token::readInput (CharInput &in,
                        bool dashInName_arg,
-                       bool consecutiveQuotesInText)
+                       bool consecutiveQuotesInText,
+                       bool backslashInText)
 {
 	ASSERT (empty ());
 
@@ -2237,6 +2726,15 @@ void Token::readInput (CharInput &in,
 		    in. error ("Text is not finished: end of file", false);
 			if (in. tp. eol ())
 		    continue;
+		  if (backslashInText && c == '\\')
+		  {
+		    name += c;
+		    c = in. get ();
+  			if (in. eof)
+  		    in. error ("Text is not finished: end of file", false);
+		    name += c;
+		    continue;
+		  }
 			if (c == quote)
 			{
 			  if (consecutiveQuotesInText)
@@ -2730,7 +3228,7 @@ char TokenInput::getNextChar (bool unget)
 
 // IFStream
 
-IFStream::IFStream (const string &pathName)
+void IFStream::open (const string &pathName)
 { 
   switch (getFiletype (pathName, true))
   {
@@ -2740,7 +3238,7 @@ IFStream::IFStream (const string &pathName)
     case Filetype::link: ERROR; break;
     default: break;
   }
-	open (pathName);
+	ifstream::open (pathName);
   if (! good ())
     throw runtime_error ("Cannot open file " + shellQuote (pathName));
 }
@@ -2748,13 +3246,161 @@ IFStream::IFStream (const string &pathName)
 
 
 
-// OFStream
+bool isGzipped (const string &pathName)
+{
+  if (getFiletype (pathName, true) != Filetype::file)
+    return false;
+  ifstream f (pathName, ios_base::binary);
+  if (! f. good ())
+    return false;
+  const int c1 = f. get ();
+  const int c2 = f. get ();
+  return c1 == 0x1f && c2 == 0x8b;
+}
 
-void OFStream::open (const string &dirName,
-	                   const string &fileName,
-	                   const string &extension)
-{ 
-	QC_ASSERT (! fileName. empty ());
+
+
+
+// GzipIStream::Buf
+
+GzipIStream::Buf::Buf (const string &pathName)
+: buf (1024 * 1024)  // PAR
+{
+  gz = gzopen (pathName. c_str (), "rb");
+  if (! gz)
+    throw runtime_error ("Cannot open file " + shellQuote (pathName));
+  gzbuffer (gz, 256 * 1024);  // PAR
+  setg (buf. data (), buf. data (), buf. data ());
+}
+
+
+
+GzipIStream::Buf::~Buf ()
+{
+  if (gz)
+    gzclose (gz);
+}
+
+
+
+GzipIStream::Buf::int_type GzipIStream::Buf::underflow ()
+{
+  ASSERT (gz);
+  if (gptr () < egptr ())
+    return traits_type::to_int_type (*gptr ());
+  const int n = gzread (gz, buf. data (), (uint) buf. size ());
+  if (n < 0)
+  {
+    int errnum = 0;
+    throw runtime_error ("gzip: " + string (gzerror (gz, & errnum)));
+  }
+  setg (buf. data (), buf. data (), buf. data () + n);
+  if (! n)
+    return traits_type::eof ();
+  return traits_type::to_int_type (*gptr ());
+}
+
+
+
+GzipIStream::Buf::pos_type GzipIStream::Buf::seekoff (off_type off,
+                                                      ios_base::seekdir dir,
+                                                      ios_base::openmode which)
+{
+  if (dir == ios_base::beg)
+    return seekpos ((pos_type) off, which);
+  return pos_type (off_type (-1));
+}
+
+
+
+GzipIStream::Buf::pos_type GzipIStream::Buf::seekpos (pos_type pos,
+                                                      ios_base::openmode /*which*/)
+{
+  ASSERT (gz);
+  if (pos != pos_type (0))
+    return pos_type (off_type (-1));
+  if (gzrewind (gz))
+    return pos_type (off_type (-1));
+  setg (buf. data (), buf. data (), buf. data ());
+  return pos;
+}
+
+
+
+// PipeIStream::Buf
+
+PipeIStream::Buf::Buf (const string &cmd)
+: buf (1024 * 1024)  // PAR
+{
+  f = popen (cmd. c_str (), "r");
+  if (! f)
+    throw runtime_error ("Cannot run " + cmd);
+  setg (buf. data (), buf. data (), buf. data ());
+}
+
+
+
+PipeIStream::Buf::~Buf ()
+{
+  if (f)
+    pclose (f);
+}
+
+
+
+PipeIStream::Buf::int_type PipeIStream::Buf::underflow ()
+{
+  if (gptr () < egptr ())
+    return traits_type::to_int_type (*gptr ());
+  if (! f)
+    return traits_type::eof ();
+  const size_t n = fread (buf. data (), 1, buf. size (), f);
+  if (! n && ferror (f))
+    throw runtime_error ("Cannot read the output of a command");
+  setg (buf. data (), buf. data (), buf. data () + n);
+  if (! n)
+    return traits_type::eof ();
+  return traits_type::to_int_type (*gptr ());
+}
+
+
+
+
+// PipeIStream
+
+PipeIStream::PipeIStream (const string &cmd_arg)
+: istream (nullptr)
+, cmd (cmd_arg)
+, buf (cmd_arg)
+{ 
+  ASSERT (! cmd. empty ());
+  if (verbose ())
+  	cout << cmd << endl;
+  LOG (cmd);
+  rdbuf (& buf); 
+}
+
+
+
+void PipeIStream::close (const string &logFName)
+{
+  ASSERT (buf. f);
+  const int status = pclose (buf. f);
+  buf. f = nullptr;
+  checkExecStatus (cmd, status, logFName);
+}
+
+
+
+
+
+// OFStream
+
+void OFStream::open (const string &dirName,
+	                   const string &fileName,
+	                   const string &extension)
+{ 
+	QC_ASSERT (! fileName. empty ());
 	QC_ASSERT (! is_open ());
 	
 #if 0
@@ -2849,6 +3495,676 @@ StringVector csvLine2vec (const string &line)
 
 
 
+// FastaCheck
+
+namespace
+{
+
+struct MappedFile
+// Read-only memory-mapped regular file
+{
+  const char* data {nullptr};
+  size_t size {0};
+
+
+  explicit MappedFile (const string &fName)
+    // Output: !data <=> fName cannot be mapped
+    {
+    #ifndef _MSC_VER
+      const int fd = open (fName. c_str (), O_RDONLY);
+      if (fd == -1)
+        return;
+      struct stat st;
+      if (   ! fstat (fd, & st)
+          && S_ISREG (st. st_mode)
+          && st. st_size > 0
+         )
+      {
+        void* p = mmap (nullptr, (size_t) st. st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+          madvise (p, (size_t) st. st_size, MADV_SEQUENTIAL);
+          data = static_cast<const char*> (p);
+          size = (size_t) st. st_size;
+        }
+      }
+      close (fd);
+    #endif
+    }
+ ~MappedFile ()
+    {
+    #ifndef _MSC_VER
+      if (data)
+        munmap (const_cast<char*> (data), size);
+    #endif
+    }
+  MappedFile (const MappedFile&) = delete;
+  MappedFile& operator= (const MappedFile&) = delete;
+};
+
+
+
+inline size_t acgtPrefix (const char* s,
+                          size_t len)
+// Return: length of the prefix of s of characters "ACGTacgt", rounded down to blocks
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i lower = _mm_set1_epi8 (0x20);
+  const __m128i a = _mm_set1_epi8 ('a');
+  const __m128i c = _mm_set1_epi8 ('c');
+  const __m128i g = _mm_set1_epi8 ('g');
+  const __m128i t = _mm_set1_epi8 ('t');
+  while (i + 16 <= len)
+  {
+    const __m128i v = _mm_or_si128 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + i)), lower);
+    const __m128i m = _mm_or_si128 ( _mm_or_si128 (_mm_cmpeq_epi8 (v, a), _mm_cmpeq_epi8 (v, c))
+                                   , _mm_or_si128 (_mm_cmpeq_epi8 (v, g), _mm_cmpeq_epi8 (v, t))
+                                   );
+    if (_mm_movemask_epi8 (m) != 0xFFFF)
+      break;
+    i += 16;
+  }
+#else
+  (void) s;
+  (void) len;
+#endif
+  return i;
+}
+
+
+
+struct FastaIdSet
+// Fingerprints of sequence identifiers, sharded for concurrent insertion
+{
+private:
+  struct Shard
+  {
+    mutex mtx;
+    unordered_set<uint64_t> fingerprints;
+  };
+  vector<Shard> shards;
+public:
+
+
+  explicit FastaIdSet (size_t shards_arg)
+    : shards (shards_arg)
+    { ASSERT (! shards. empty ()); }
+
+
+  bool insert (const string &id)
+    // Return: false <=> the fingerprint of id has been inserted before, id is a likely duplicate
+    { const uint64_t h = fnv1a (id);
+      Shard& shard = shards [h % shards. size ()];
+      const lock_guard<mutex> lg (shard. mtx);
+      return shard. fingerprints. insert (h). second;
+    }
+};
+
+
+
+struct FastaChunk
+// Part of a FASTA file starting at a record
+{
+  // Input
+  const FastaCheck &fc;
+  const string &fName;
+  const array<unsigned char,256> &charClass;
+  FastaIdSet &idSet;
+  const function<void (const string &id, const string &seq)> &processSeq;
+  const bool copySeq;
+    // The sequence is copied only if it is output
+  const bool exactIds;
+    // true: a likely duplicate identifier is checked at once, otherwise it is added to suspects
+  ostream* lenF {nullptr};
+
+  enum : unsigned char {cValid = 1, cAmbig = 2, cNuc = 4, cHyphen = 8};
+    // Of charClass
+
+  // Output
+  Vector<FastaCheck::Seq> seqs;
+    // Seq::offset is in the chunk
+  StringVector ids;
+    // In the file order
+  Vector<size_t> suspects;
+    // Indexes in ids of likely duplicates
+  size_t seqSize_max {0};
+  size_t seqSize_sum {0};
+  size_t nuc {0};
+  size_t lineNum {0};
+    // Of the current line, 1-based, also if the last line has no '\n'
+  size_t lines {0};
+    // Non-empty
+
+  // processSeq() in the file order if the chunks are checked in parallel
+  FastaChunk* next {nullptr};
+private:
+  mutex seqMtx;
+  Vector<pair<string,string>> pendingSeqs;
+    // (id, seq) not passed to processSeq() while !live
+  bool live {true};
+    // The previous chunks are done, processSeq() is invoked directly
+  bool done {false};
+    // Guarded by seqMtx
+  // One sequence
+  size_t xs {0};
+  string header;
+  string seq;
+    // copySeq
+  size_t seqLen {0};
+  char lastChar {'\0'};
+    // !copySeq
+public:
+
+
+  FastaChunk (const FastaCheck &fc_arg,
+              const string &fName_arg,
+              const array<unsigned char,256> &charClass_arg,
+              FastaIdSet &idSet_arg,
+              const function<void (const string &id, const string &seq)> &processSeq_arg,
+              bool exactIds_arg)
+    : fc (fc_arg)
+    , fName (fName_arg)
+    , charClass (charClass_arg)
+    , idSet (idSet_arg)
+    , processSeq (processSeq_arg)
+    , copySeq (processSeq_arg || fc_arg. outF)
+    , exactIds (exactIds_arg)
+    , lenF (fc_arg. lenF)
+    { ids. reserve (100000);  // PAR
+    }
+
+
+  string errorS () const
+    { return "File " + fName + ", line " + to_string (lineNum) + ": "; }
+  void processText (const char* start,
+                    const char* end)
+    { const char* p = start;
+      while (p < end)
+      {
+        const char* eol = static_cast<const char*> (memchr (p, '\n', (size_t) (end - p)));
+        if (! eol)
+          eol = end;  // The last line without '\n'
+        lineNum++;
+        processLine (p, (size_t) (eol - p));
+        p = eol + 1;
+      }
+    }
+  void processLine (const char* line,
+                    size_t len);
+  void finishSeq ();
+  void setPending ()
+    { live = false; }
+    // Before processText()
+  void finish ();
+    // After the last finishSeq()
+    // Invokes: processSeq() of the pending sequences of the next chunks which become live
+private:
+  void passSeq (const string &id);
+};
+
+
+
+void FastaChunk::processLine (const char* line,
+                              size_t len)
+{
+  // trimTrailing()
+  while (len && isspace (line [len - 1]))
+    len--;
+  if (! len)
+    return;
+  if (line [0] == '>')
+  {
+    size_t pos = 1;
+    while (pos < len && ! isspace (line [pos]))
+      pos++;
+    string id (line + 1, pos - 1);
+    if (id. empty ())
+      throw runtime_error (errorS () + "Empty sequence identifier");
+  #if 0
+    if (id. size () > 1000)  // PAR
+      throw runtime_error (errorS () + "Too long sequence identifier");
+  #endif
+    for (const char c : id)
+      if (! printable (c))
+        throw runtime_error (errorS () + "Non-printable character in the sequence identifier: " + to_string ((int) c));
+    // BLAST: PD-4548
+    if (! fc. aa)
+    {
+      if (id. front () == '?')
+        throw runtime_error (errorS () + "Sequence identifier starts with '?'");
+      for (const char c : {',', ';', '.', '~'})
+        if (id. back () == c)
+          throw runtime_error (errorS () + "Sequence identifier ends with " + strQuote (string (1, c)));
+      if (contains (id, "\\t"))
+        throw runtime_error (errorS () + "Sequence identifier contains '\\t'");
+      if (contains (id, ",,"))
+        throw runtime_error (errorS () + "Sequence identifier contains ',,'");
+    }
+    finishSeq ();
+    header. assign (line, len);
+    if (! idSet. insert (id))
+    {
+      if (! exactIds)
+        suspects << ids. size ();
+      else if (ids. contains (id))
+        throw runtime_error ("Duplicate identifier: " + id);
+    }
+    ids << std::move (id);
+  }
+  else
+  {
+    if (! lines)
+      throw runtime_error (errorS () + "FASTA should start with '>'");
+    size_t i = fc. aa ? 0 : acgtPrefix (line, len);
+    size_t skipped = 0;
+    for (; i < len; i++)
+    {
+      const char c = line [i];
+      const unsigned char cl = charClass [(unsigned char) c];
+      if (cl & cValid)
+      {
+        if (cl & cAmbig)
+          xs++;
+        if (cl & cNuc)
+          nuc++;
+      }
+      else if (cl & cHyphen)
+      {
+        if (! fc. hyphen)
+        {
+          if (fc. outF)
+            skipped++;
+          else
+            throw runtime_error (errorS () + "Hyphen in the sequence");
+        }
+      }
+      else if (fc. aa)
+        throw runtime_error (errorS () + "Wrong amino acid character: (code = " + to_string ((int) c) + ") '" + c + "'");
+      else
+        throw runtime_error (errorS () + "Wrong nucleotide character: (code = " + to_string ((int) c) + ") '" + c + "'");
+    }
+    if (copySeq)
+    {
+      if (skipped)
+      {
+        FOR (size_t, j, len)
+          if (line [j] != '-')
+            seq += line [j];
+      }
+      else
+        seq. append (line, len);
+    }
+    else
+    {
+      ASSERT (! skipped);
+      seqLen += len;
+      lastChar = line [len - 1];
+    }
+  }
+  lines++;
+}
+
+
+
+void FastaChunk::finishSeq ()
+{
+  if (header. empty ())
+    return;
+  ASSERT (! ids. empty ());
+  const string& id = ids. back ();
+  if (fc. aa && ! fc. stop_codon)
+  {
+    if (copySeq)
+      while (! seq. empty () && seq. back () == '*')
+        if (fc. outF)
+          seq. erase (seq. size () - 1);
+        else
+          throw runtime_error (id + ": '*' at the sequence end");
+    else if (lastChar == '*')
+      throw runtime_error (id + ": '*' at the sequence end");
+  }
+  if (copySeq)
+    seqLen = seq. size ();
+  if (! seqLen)
+    throw runtime_error (id + ": Empty sequence");
+  bool skip = false;
+  if (! fc. ambig && xs > fc. ambig_max)
+  {
+    if (fc. outF)
+      skip = true;
+    else
+      throw runtime_error (id + ": Too many ambiguities");
+  }
+  if (skip)
+    { LOG ("Skipping " + id); }
+  else
+  {
+    if (lenF)
+      *lenF << id << '\t' << seqLen << '\n';
+    if (fc. outF)
+      *fc. outF << header << '\n' << seq << '\n';
+    seqs << FastaCheck::Seq {id, seqSize_sum, seqLen};
+    maximize (seqSize_max, seqLen);
+    seqSize_sum += seqLen;
+    if (processSeq)
+      passSeq (id);
+  }
+  xs = 0;
+  header. clear ();
+  seq. clear ();
+  seqLen = 0;
+  lastChar = '\0';
+}
+
+
+
+void FastaChunk::passSeq (const string &id)
+{
+  {
+    const lock_guard<mutex> lg (seqMtx);
+    if (! live)
+    {
+      pendingSeqs << pair<string,string> (id, std::move (seq));
+      return;
+    }
+  }
+  processSeq (id, seq);
+}
+
+
+
+void FastaChunk::finish ()
+{
+  {
+    const lock_guard<mutex> lg (seqMtx);
+    done = true;
+    if (! live)
+      return;  // The previous chunk will make this chunk live
+  }
+  for (FastaChunk* chunk = next; chunk; chunk = chunk->next)
+    for (;;)
+    {
+      Vector<pair<string,string>> pending;
+      {
+        const lock_guard<mutex> lg (chunk->seqMtx);
+        if (chunk->pendingSeqs. empty ())
+        {
+          chunk->live = true;
+          if (! chunk->done)
+            return;  // chunk will make the next chunk live
+          break;
+        }
+        pending. swap (chunk->pendingSeqs);
+      }
+      for (const auto& it : pending)
+        processSeq (it. first, it. second);
+    }
+}
+
+
+
+array<unsigned char,256> fastaCharClass (bool aa)
+// Return: FastaChunk::c* flags of the characters, case-insensitive
+{
+  array<unsigned char,256> charClass;
+  charClass. fill (0);
+  auto setClass = [&charClass] (const char* chars,
+                                unsigned char flag)
+    { for (const char* c = chars; *c; c++)
+      {
+        charClass [(unsigned char) *c]           |= flag;
+        charClass [(unsigned char) toupper (*c)] |= flag;
+      }
+    };
+  if (aa)
+  {
+    setClass ("acdefghiklmnpqrstvwyxbzjuo*", FastaChunk::cValid);
+    setClass ("xbzjuo", FastaChunk::cAmbig);
+    setClass ("acgt", FastaChunk::cNuc);
+  }
+  else
+  {
+    setClass ("acgtbdhkmnrsvwy", FastaChunk::cValid);
+    setClass ("bdhkmnrsvwy", FastaChunk::cAmbig);
+  }
+  charClass ['-'] = FastaChunk::cHyphen;
+  return charClass;
+}
+
+
+
+void mergeFastaChunks (FastaCheck &fc,
+                       const Vector<unique_ptr<FastaChunk>> &chunks)
+// Output: fc
+// Checks of the whole file
+{
+  size_t lines = 0;
+  size_t nuc = 0;
+  fc. ids. reserve (chunks. front () -> ids. size ());
+  for (const auto& chunk : chunks)
+  {
+    for (FastaCheck::Seq& s : chunk->seqs)
+    {
+      s. offset += fc. seqSize_sum;
+      fc. seqs << std::move (s);
+    }
+    if (fc. ids. empty ())
+      fc. ids = std::move (chunk->ids);
+    else
+      for (string& id : chunk->ids)
+        fc. ids << std::move (id);
+    maximize (fc. seqSize_max, chunk->seqSize_max);
+    fc. seqSize_sum += chunk->seqSize_sum;
+    nuc             += chunk->nuc;
+    lines           += chunk->lines;
+  }
+  if (! lines)
+    throw runtime_error ("Empty file");
+  if (fc. aa && (double) nuc / (double) fc. seqSize_sum > 0.9)  // PAR
+    throw runtime_error ("Protein sequences looks like a nucleotide sequences");
+}
+
+
+
+}
+
+
+
+void FastaCheck::run (const string &fName,
+                      const function<void (const string &id, const string &seq)> &processSeq)
+{
+  QC_IMPLY (stop_codon, aa);
+  
+  seqs. clear ();
+  ids. clear ();
+  seqSize_max = 0;
+  seqSize_sum = 0;
+
+  const array<unsigned char,256> charClass (fastaCharClass (aa));
+  
+  const MappedFile mf (isGzipped (fName) ? noString : fName);
+  
+  // Chunks starting at '>' lines
+  Vector<const char*> chunkStarts;
+  if (   mf. data
+      && threads_max > 1
+      && ! outF
+     )
+  {
+    constexpr size_t chunkSize_min = 1000000;  // PAR
+    const size_t chunks = min (threads_max, mf. size / chunkSize_min + 1);
+    const char* end = mf. data + mf. size;
+    chunkStarts << mf. data;
+    FOR_START (size_t, i, 1, chunks)
+    {
+      const char* p = mf. data + mf. size / chunks * i;
+      if (p <= chunkStarts. back ())
+        continue;
+      while (p < end)
+      {
+        p = static_cast<const char*> (memchr (p, '\n', (size_t) (end - p)));
+        if (! p || p + 1 == end)
+        {
+          p = end;
+          break;
+        }
+        p++;
+        if (*p == '>')
+          break;
+      }
+      if (p == end)
+        break;
+      chunkStarts << p;
+    }
+  }
+  
+  Vector<unique_ptr<FastaChunk>> chunks;
+  if (chunkStarts. size () > 1)
+  {
+    FastaIdSet idSet (64);  // PAR
+    Vector<unique_ptr<ostringstream>> lenStreams;
+    FFOR (size_t, i, chunkStarts. size ())
+    {
+      chunks << unique_ptr<FastaChunk> (new FastaChunk (*this, fName, charClass, idSet, processSeq, false));
+      if (i)
+      {
+        chunks. back () -> setPending ();
+        chunks [i - 1] -> next = chunks. back (). get ();
+      }
+      if (lenF)
+      {
+        lenStreams << unique_ptr<ostringstream> (new ostringstream ());
+        chunks. back () -> lenF = lenStreams. back (). get ();
+      }
+    }
+    StringVector errors (chunks. size ());
+    atomic<size_t> firstError {no_index};
+      // Index of the first chunk with an error
+    {
+      const char* end = mf. data + mf. size;
+      auto check = [&] (size_t from, size_t to, size_t& /*res*/)
+        {
+          FOR_START (size_t, i, from, to)
+          {
+            if (firstError < i)
+              break;
+            FastaChunk& chunk = * chunks [i];
+            if (i)
+              chunk. lines = 1;  // '>' line is valid
+            try
+            {
+              chunk. processText (chunkStarts [i], i + 1 == chunks. size () ? end : chunkStarts [i + 1]);
+              chunk. finishSeq ();
+              chunk. finish ();
+            }
+            catch (const exception &e)
+            {
+              errors [i] = e. what ();
+              const string prefix (chunk. errorS ());
+              if (isLeft (errors [i], prefix))
+                errors [i]. erase (0, prefix. size ());
+              else
+                chunk. lineNum = no_index;
+              size_t first = firstError;
+              while (i < first && ! firstError. compare_exchange_weak (first, i))
+                ;
+              break;
+            }
+          }
+        };
+      vector<size_t> dummy;
+      arrayThreads (check, chunks. size (), dummy);
+    }
+    if (firstError != no_index)
+    {
+      if (chunks [firstError] -> lineNum == no_index)
+        throw runtime_error (errors [firstError]);
+      size_t lineNum = chunks [firstError] -> lineNum;
+      FOR (size_t, i, firstError)
+        lineNum += chunks [i] -> lineNum;
+      throw runtime_error ("File " + fName + ", line " + to_string (lineNum) + ": " + errors [firstError]);
+    }
+    // Exact check of the likely duplicates
+    {
+      unordered_map<string,size_t> suspectIds;
+      for (const auto& chunk : chunks)
+        for (const size_t i : chunk->suspects)
+          suspectIds [chunk->ids [i]] = 0;
+      if (! suspectIds. empty ())
+        for (const auto& chunk : chunks)
+          for (const string& id : chunk->ids)
+          {
+            const auto it = suspectIds. find (id);
+            if (it != suspectIds. end () && it->second++)
+              throw runtime_error ("Duplicate identifier: " + id);
+          }
+    }
+    for (const auto& s : lenStreams)
+      *lenF << s->str ();
+  }
+  else
+  {
+    FastaIdSet idSet (1);
+    chunks << unique_ptr<FastaChunk> (new FastaChunk (*this, fName, charClass, idSet, processSeq, true));
+    FastaChunk& chunk = * chunks. back ();
+    if (mf. data)
+      chunk. processText (mf. data, mf. data + mf. size);
+    else
+    {
+      // Gzipped or not a regular file
+      LineInput f (fName); 
+      while (f. nextLine ())
+      {
+        chunk. lineNum = f. lineNum;
+        if (f. eof)
+          chunk. lineNum++;  // LineInput::lineNum does not count the last line without '\n'
+        chunk. processLine (f. line. data (), f. line. size ());
+      }
+    }
+    chunk. finishSeq ();	// Last sequence
+  }
+  
+  mergeFastaChunks (*this, chunks);
+}
+
+
+
+void FastaCheck::runSeqs (const Vector<pair<string_view,string_view>> &records,
+                          const string &name)
+{
+  QC_IMPLY (stop_codon, aa);
+  
+  seqs. clear ();
+  ids. clear ();
+  seqSize_max = 0;
+  seqSize_sum = 0;
+
+  const array<unsigned char,256> charClass (fastaCharClass (aa));
+  const function<void (const string &id, const string &seq)> noProcessSeq;
+  FastaIdSet idSet (1);
+  Vector<unique_ptr<FastaChunk>> chunks;
+  chunks << unique_ptr<FastaChunk> (new FastaChunk (*this, name, charClass, idSet, noProcessSeq, true));
+  FastaChunk& chunk = * chunks. back ();
+  for (const auto& it : records)
+  {
+    chunk. lineNum++;
+    for (const char c : it. first)
+      if (isspace (c))
+        throw runtime_error (chunk. errorS () + "Space in the sequence identifier");
+    const string header (">" + string (it. first));
+    chunk. processLine (header. data (), header. size ());
+    chunk. lineNum++;
+    chunk. processLine (it. second. data (), it. second. size ());
+  }
+  chunk. finishSeq ();
+  
+  mergeFastaChunks (*this, chunks);
+}
+
+
+
+
 // Json
 
 Json::Json (JsonContainer* parent,
@@ -3043,14 +4359,14 @@ JsonArray::JsonArray (CharInput& in,
   bool first = true;
   for (;;)
   {
-    Token token (in, false, false);
+    Token token (in, false, false, true);
     if (token. isDelimiter (']'))
       break;
     if (! first)
     {
       if (! token. isDelimiter (','))
         in. error ("\',\'");
-      token = Token (in, false, false);
+      token = Token (in, false, false, true);
     }
     parse (in, token, this, noString);
     first = false;
@@ -3089,7 +4405,7 @@ JsonMap::JsonMap ()
 JsonMap::JsonMap (const string &fName)
 {
   CharInput in (fName);
-  const Token token (in, false, false);
+  const Token token (in, false, false, true);
   if (! token. isDelimiter ('{'))
     in. error ("Json file " + shellQuote (fName) + ": text should start with '{'", false);
   parse (in);
@@ -3097,6 +4413,17 @@ JsonMap::JsonMap (const string &fName)
 
 
 
+JsonMap::JsonMap (istream &is)
+{
+  CharInput in (is);
+  const Token token (in, false, false, true);
+  if (! token. isDelimiter ('{'))
+    in. error ("JSON object should start with '{'", false);
+  parse (in);
+}
+
+
+
 void JsonMap::parse (CharInput& in)
 {
   ASSERT (data. empty ());
@@ -3104,24 +4431,24 @@ void JsonMap::parse (CharInput& in)
   bool first = true;
   for (;;)
   {
-    Token token (in, false, false);
+    Token token (in, false, false, true);
     if (token. isDelimiter ('}'))
       break;
     if (! first)
     {
       if (! token. isDelimiter (','))
         in. error ("\',\'");
-      token = Token (in, false, false);
+      token = Token (in, false, false, true);
     }
     if (   token. type != Token::eName
         && token. type != Token::eText
        )
       in. error ("name or text");
     string name (token. name);
-    const Token colon (in, false, false);
+    const Token colon (in, false, false, true);
     if (! colon. isDelimiter (':'))
       in. error ("\':\'");
-    token = Token (in, false, false);
+    token = Token (in, false, false, true);
     Json::parse (in, token, this, name);
     first = false;
   }
@@ -4019,6 +5346,9 @@ int Application::run (int argc,
 		initVar ();
 		qc ();
   	body ();
+  	
+  	if (logPtr)
+  	  Trace::dump (*logPtr);
 
   
   	if (! jsonFName. empty ())
@@ -4047,7 +5377,11 @@ int Application::run (int argc,
 ShellApplication::~ShellApplication ()
 {
 	if (tmpCreated && ! logPtr)
+	{
 	  removeDirectory (tmp);
+	  if (! tmpDisk. empty () && tmpDisk != tmp)
+	    removeDirectory (tmpDisk);
+	}
 
   if (startTime)
   {
@@ -4064,14 +5398,15 @@ void ShellApplication::initEnvironment ()
   ASSERT (tmp. empty ());
   ASSERT (! programArgs. empty ());
   
-  // tmp
+  // tmpDir
   if (useTmp)
   {
+    addKey ("scratch_ram", "Max. MB of the temporary files kept in RAM (" + string (scratchRamDir) + "), a job whose temporary files do not fit is run in $TMPDIR; 0 - all temporary files are in $TMPDIR", "0", '\0', "MB");
     string s (getEnv ("TMPDIR"));
     if (s. empty ())
-      tmp = "/tmp";
+      tmpDir = "/tmp";
     else
-      tmp = std::move (s);
+      tmpDir = std::move (s);
   }
 
   // execDir, programName
@@ -4095,34 +5430,94 @@ void ShellApplication::initEnvironment ()
 
 
 
+namespace
+{
+
+string getProbeCacheDir ()
+// Return: empty() if the cache cannot be used
+{
+  string programNameUpper (programName);
+  strUpper (programNameUpper);
+  if (! getEnv (programNameUpper + "_NO_PROBE_CACHE"). empty ())
+    return noString;
+  string dir (getEnv ("XDG_CACHE_HOME"));
+  if (dir. empty ())
+  {
+    const string home (getEnv ("HOME"));
+    if (home. empty ())
+      return noString;
+    dir = home + "/.cache";
+  }
+  for (const string& sub : {noString, "/" + programName, string ("/probes")})
+  {
+    dir += sub;
+    if (! directoryExists (dir) && mkdir (dir. c_str (), 0777) && errno != EEXIST)  // PAR
+      return noString;
+  }
+  errno = 0;
+  return dir + "/";
+}
+
+
+
+streamsize getFreeSpace (const string &dirName)
+// Return: -1 if unknown
+{
+  struct statvfs st;
+  if (statvfs (dirName. c_str (), & st))
+  {
+    errno = 0;
+    return -1;
+  }
+  return (streamsize) st. f_bavail * (streamsize) st. f_frsize;
+}
+
+
+
+string makeTmpDir (const string &dirName)
+// Return: dirName + "/" + programName + ".XXXXXX"
+{
+  string dir (dirName + "/" + programName + ".XXXXXX");
+  if (! mkdtemp (var_cast (dir. c_str ())))
+    throw runtime_error ("Error creating a temporary directory in " + dirName);
+  if (dir. empty ())
+    throw runtime_error ("Cannot create a temporary directory in " + dirName);
+  if (! getFreeSpace (dir))
+    throw runtime_error (dirName + " is full, make space there or use environment variable TMPDIR to change location for temporary files");
+  return dir;
+}
+
+}
+
+
+
 void ShellApplication::initVar () 
 {
   ASSERT (! tmpCreated);
   
+  stderr. quiet = getQuiet ();
+  
   if (useTmp)
   {
-    const string tmpDir (tmp);
-    tmp += "/" + programName + ".XXXXXX";
-    if (! mkdtemp (var_cast (tmp. c_str ())))
-      throw runtime_error ("Error creating a temporary directory in " + tmpDir);
-  	if (tmp. empty ())
-  		throw runtime_error ("Cannot create a temporary directory in " + tmpDir);
-
+    scratchRam_max = str2<size_t> (getArg ("scratch_ram")) * 1000000;
+    if (scratchRam_max)
     {
-    	const string testFName (tmp + "/test");
+      const streamsize freeSpace = directoryExists (scratchRamDir) ? getFreeSpace (scratchRamDir) : 0;
+      if (freeSpace <= 0)
       {
-        ofstream f (testFName);
-        f << "abc" << endl;
-        if (! f. good ())
-  		    throw runtime_error (tmpDir + " is full, make space there or use environment variable TMPDIR to change location for temporary files");
+        stderr << scratchRamDir << " cannot be used for the temporary files, using " << tmpDir << '\n';
+        scratchRam_max = 0;
       }
-      removeFile (testFName);
+      else
+        minimize (scratchRam_max, (size_t) freeSpace);
     }
-    
+    tmp = makeTmpDir (scratchRam_max ? scratchRamDir : tmpDir);
+    if (! scratchRam_max)
+      tmpDisk = tmp;
     tmpCreated = true;
   }
   
-  stderr. quiet = getQuiet ();
+  probeCacheDir = getProbeCacheDir ();
 
   startTime = time (NULL);
   stderr << "Running: " << getCommandLine () << '\n';
@@ -4146,7 +5541,7 @@ string ShellApplication::getHelp () const
 {
   string help (Application::getHelp ());
   if (useTmp)
-    help += "\n\nTemporary directory used is $TMPDIR or \"/tmp\"";
+    help += "\n\nTemporary directory used is $TMPDIR or \"/tmp\", or " + string (scratchRamDir) + " for the jobs fitting in " + ifS (gnu, "-") + "-scratch_ram";
   return help;
 }
 
@@ -4170,9 +5565,19 @@ void ShellApplication::findProg (const string &progName) const
 	string dir;
 	if (! find (prog2dir, progName, dir))
 	{
-		dir = fileExists (execDir + progName)
-		        ? execDir
-		        : which (progName);
+	  // The cached directory is valid if the binary is there and the search would find it first
+	  const string key ("findProg\n" + progName + '\n' + execDir + '\n' + getEnv ("PATH"));
+	  dir = probeRead (key);
+	  if (! dir. empty () && ! fileExists (dir + progName))
+	    dir. clear ();
+	  if (dir. empty ())
+	  {
+  		dir = fileExists (execDir + progName)
+  		        ? execDir
+  		        : which (progName);
+  		if (! dir. empty ())
+  		  probeWrite (key, dir);
+  	}
 	  if (dir. empty ())
 	    throw runtime_error ("Binary " + shellQuote (progName) + " is not found.\nPlease make sure that " 
 	                         + shellQuote (progName) + " is in the same directory as " + shellQuote (Common_sp::programName) + " or is in your $PATH.");;
@@ -4195,6 +5600,91 @@ string ShellApplication::fullProg (const string &progName) const
 
 
 
+string ShellApplication::probeRead (const string &key) const
+{
+  if (probeCacheDir. empty ())
+    return noString;
+  ifstream f (probeFName (key), ios::binary);
+  if (! f. good ())
+    return noString;
+  string keyRead;
+  if (! getline (f, keyRead) || keyRead != to_string (key. size ()) + ' ' + to_string (fnv1a (key, ~ (uint64_t) 0)))
+    return noString;  // Hash collision or a damaged file
+  ostringstream oss;
+  oss << f. rdbuf ();
+  return oss. str ();
+}
+
+
+
+void ShellApplication::probeWrite (const string &key,
+                                   const string &value) const
+{
+  if (probeCacheDir. empty () || value. empty ())
+    return;
+  // Atomic for concurrent processes
+  const string fName (probeFName (key));
+  const string tmpFName (fName + "." + to_string (fnv1a (tmp)) + "." + to_string (hash<thread::id> () (this_thread::get_id ())) + ".tmp");
+  {
+    ofstream f (tmpFName, ios::binary);
+    f << key. size () << ' ' << fnv1a (key, ~ (uint64_t) 0) << '\n' << value;
+    if (! f. good ())
+    {
+      ::remove (tmpFName. c_str ());
+      return;  // The cache is optional
+    }
+  }
+  if (::rename (tmpFName. c_str (), fName. c_str ()))
+    ::remove (tmpFName. c_str ());
+  errno = 0;
+}
+
+
+
+string ShellApplication::progOutput (const string &progName,
+                                     const string &args) const
+{
+  const string cmd (fullProg (progName) + args);
+  {
+    const lock_guard<mutex> lock (probeMtx);
+    string output;
+    if (find (probe2output, cmd, output))
+      return output;
+  }
+
+  string key;
+  {
+    string dir;
+    EXEC_ASSERT (find (prog2dir, progName, dir));
+    const string path (dir + progName);
+    struct stat st;
+    if (::stat (path. c_str (), & st))
+      throw runtime_error ("Cannot stat " + shellQuote (path));
+    key = "progOutput\n" + path + '\n' + to_string (st. st_mtime) + '\n' + to_string (st. st_size) + '\n' + args;
+  }
+  
+  string output (probeRead (key));
+  if (output. empty ())
+  {
+    const string out (tmp + "/probe." + to_string (fnv1a (key)) + "." + to_string (hash<thread::id> () (this_thread::get_id ())));
+    exec (cmd + " > " + out);
+    {
+      ifstream f (out, ios::binary);
+      ostringstream oss;
+      oss << f. rdbuf ();
+      output = oss. str ();
+    }
+    removeFile (out);
+    probeWrite (key, output);
+  }
+  
+  const lock_guard<mutex> lock (probeMtx);
+  probe2output [cmd] = output;
+  return output;
+}
+
+
+
 string ShellApplication::exec2str (const string &cmd,
                                    const string &tmpName,
                                    const string &logFName) const
@@ -4236,15 +5726,14 @@ string ShellApplication::getBlastThreadsParam (const string &blast,
 	bool num_threadsP = false;
 	bool mt_modeP = false;
 	{
-	  const string blast_help (tmp + "/blast_help");
-    exec (fullProg (blast) + " -help > " + blast_help);
-    LineInput f (blast_help);
-    while (f. nextLine ())
+	  istringstream f (progOutput (blast, "-help"));
+	  string line;
+    while (getline (f, line))
     {
-      trim (f. line);
-      if (contains (f. line, "-num_threads "))
+      trim (line);
+      if (contains (line, "-num_threads "))
         num_threadsP = true;
-      if (contains (f. line, "-mt_mode "))
+      if (contains (line, "-mt_mode "))
         mt_modeP = true;
     }
   }
@@ -4258,18 +5747,17 @@ string ShellApplication::getBlastThreadsParam (const string &blast,
 #ifdef __APPLE__
   {
     mt_mode_works = false;
-    const string blast_version (tmp + "/blast_version");
-    exec (fullProg (blast) + " -version > " + blast_version);
-    LineInput f (blast_version);
-    while (f. nextLine ())
+    istringstream f (progOutput (blast, "-version"));
+    string line;
+    while (getline (f, line))
     {
-      trim (f. line);
+      trim (line);
       const string prefix (blast + ": ");
-      if (isLeft (f. line, prefix))
+      if (isLeft (line, prefix))
       {
-        trimSuffix (f. line, "+");
+        trimSuffix (line, "+");
         Istringstream iss;
-        iss. reset (f. line. substr (prefix. size ()));
+        iss. reset (line. substr (prefix. size ()));
         const SoftwareVersion v (iss);
       //PRINT (v);  
         iss. reset ("2.13.0");  // PD-4560
@@ -4287,6 +5775,62 @@ string ShellApplication::getBlastThreadsParam (const string &blast,
     
   return s;
 }
+
+
+
+
+ShellApplication::Scratch::Scratch (const ShellApplication &app_arg,
+                                    const string &subDir,
+                                    size_t bytes)
+: app (app_arg)
+{
+  ASSERT (app. useTmp);
+  ASSERT (subDir. empty () || isDirName (subDir));
+
+  {
+    const lock_guard<mutex> lg (app. scratchMtx);
+    if (   app. scratchRam_max
+        && app. scratchRam + bytes <= app. scratchRam_max
+       )
+    {
+      app. scratchRam += bytes;
+      reserved = bytes;
+      ram = true;
+    }
+    else if (app. tmpDisk. empty ())
+    {
+      app. tmpDisk = makeTmpDir (app. tmpDir);
+      LOG (app. tmpDisk);
+    }
+  }
+
+  dir = (ram ? app. tmp : app. tmpDisk) + "/" + subDir;
+  if (subDir. empty ())
+    return;
+  try 
+  {
+    createDirectory (dir);
+    created = true;
+  }
+  catch (...)
+  {
+    const lock_guard<mutex> lg (app. scratchMtx);
+    app. scratchRam -= reserved;
+    throw;
+  }
+}
+
+
+
+ShellApplication::Scratch::~Scratch ()
+{
+  if (created && ! logPtr)
+    try { removeDirectory (dir); }
+      catch (...) {}
+
+  const lock_guard<mutex> lg (app. scratchMtx);
+  app. scratchRam -= reserved;
+}
 #endif   // _MSC_VER
 
 
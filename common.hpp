@@ -66,6 +66,7 @@
 #include <limits>
 #include <array>
 #include <list>
+#include <deque>
 #include <vector>
 #include <stack>
 #include <set>
@@ -77,20 +78,27 @@
 #include <sstream>
 #include <iomanip>
 #include <memory>
+#include <functional>
 #include <algorithm>
+#include <charconv>
 
 #include <thread>
+#include <chrono>
+#include <atomic>
 #ifdef _MSC_VER
 	#pragma warning(push)
 	#pragma warning(disable:4265)
 #endif
 #include <mutex>
+#include <condition_variable>
 #ifdef _MSC_VER
 	#pragma warning(pop)
 #endif
 
 using namespace std;
 
+struct gzFile_s;  // zlib.h
+
 
 
 namespace Common_sp
@@ -474,6 +482,22 @@ constexpr size_t hash_class_max = 1000;  // PAR
 
 inline size_t str2hash_class (const string &s)
   { return str_hash (s) % hash_class_max; }
+
+inline uint64_t fnv1a (const char* s,
+                       size_t n,
+                       uint64_t h = 0xcbf29ce484222325ULL)
+  // FNV-1a, 64 bits
+  // Stable across platforms and runs, unlike str_hash
+  { for (size_t i = 0; i < n; i++)
+    { h ^= (uchar) s [i];
+      h *= 0x100000001b3ULL;
+    }
+    return h;
+  }
+
+inline uint64_t fnv1a (const string &s,
+                       uint64_t h = 0xcbf29ce484222325ULL)
+  { return fnv1a (s. c_str (), s. size (), h); }
  
 
 
@@ -626,6 +650,9 @@ inline bool isQuoted (const string &s,
 string strQuote (const string &s,
                  char quote = '\"');
 
+string jsonQuote (const string &s);
+  // Return: JSON string
+
 inline string unQuote (const string &s)
   { return s. substr (1, s. size () - 2); }
 
@@ -1611,7 +1638,78 @@ struct IFStream : ifstream
 // Text file
 {
   IFStream () = default;
-	explicit IFStream (const string &pathName);
+	explicit IFStream (const string &pathName)
+	  { open (pathName); }
+
+
+	void open (const string &pathName);
+};
+
+
+
+bool isGzipped (const string &pathName);
+  // Return: pathName is a regular file starting with the gzip magic number
+
+
+
+struct GzipIStream : istream
+// gzip-compressed text file decompressed while reading
+// Concatenated gzip members, e.g., BGZF, are read as one stream
+{
+private:
+  struct Buf : streambuf
+  {
+    ::gzFile_s* gz {nullptr};
+    vector<char> buf;
+    
+    explicit Buf (const string &pathName);
+   ~Buf ();
+  protected:
+    int_type underflow () final;
+    pos_type seekoff (off_type off,
+                      ios_base::seekdir dir,
+                      ios_base::openmode which) final;
+    pos_type seekpos (pos_type pos,
+                      ios_base::openmode which) final;
+      // Only pos = 0 is supported
+  };
+  Buf buf;
+public:
+  
+  
+  explicit GzipIStream (const string &pathName)
+    : istream (nullptr)
+    , buf (pathName)
+    { rdbuf (& buf); }
+};
+
+
+
+struct PipeIStream : istream
+// Standard output of a shell command read while the command is running
+{
+private:
+  struct Buf : streambuf
+  {
+    FILE* f {nullptr};
+    vector<char> buf;
+    
+    explicit Buf (const string &cmd);
+   ~Buf ();
+  protected:
+    int_type underflow () final;
+  };
+  const string cmd;
+  Buf buf;
+public:
+  
+  
+  explicit PipeIStream (const string &cmd_arg);
+    
+    
+  void close (const string &logFName = noString);
+    // Waits for the command to finish
+    // Input: logFName: as in exec()
 };
 
 
@@ -1743,46 +1841,216 @@ public:
 
 
 
+template <typename T>
+struct BoundedQueue
+// Thread-safe queue of a bounded size
+// push() blocks while the queue is full, which slows down the producers
+{
+private:
+  mutex mtx;
+  condition_variable notFull;
+  condition_variable notEmpty;
+  deque<T> items;
+  const size_t size_max;
+  bool closed {false};
+public:
+  
+  
+  explicit BoundedQueue (size_t size_max_arg)
+    : size_max (size_max_arg)
+    { if (! size_max)
+        throwf ("BoundedQueue: size_max = 0");
+    }
+    
+    
+  bool push (T &&item)
+    // Return: false <=> close()
+    { unique_lock<mutex> lock (mtx);
+      notFull. wait (lock, [this] () { return closed || items. size () < size_max; });
+      if (closed)
+        return false;
+      items. push_back (std::move (item));
+      notEmpty. notify_one ();
+      return true;
+    }
+  bool pop (T &item)
+    // Return: false <=> close() and the queue is empty
+    { unique_lock<mutex> lock (mtx);
+      notEmpty. wait (lock, [this] () { return closed || ! items. empty (); });
+      if (items. empty ())
+        return false;
+      item = std::move (items. front ());
+      items. pop_front ();
+      notFull. notify_one ();
+      return true;
+    }
+  void close ()
+    // The remaining items can be pop()'ed
+    { const lock_guard<mutex> lock (mtx);
+      closed = true;
+      notFull. notify_all ();
+      notEmpty. notify_all ();
+    }
+};
+
+
+
+struct TaskGroup;
+
+
+
+struct ThreadPool : Nocopy
+// Persistent worker threads with work stealing:
+//   a worker runs the last task of its deque, or else steals the first task of another deque
+// Tasks of the threads which are not workers go to a shared deque
+// A thread waiting for a TaskGroup runs the queued tasks of this TaskGroup, therefore tasks can create and wait for TaskGroup's (nested parallelism)
+// Long-running tasks should be run by dedicated threads
+{
+private:
+  struct Task
+  {
+    function<void ()> func;
+    TaskGroup* group {nullptr};
+  };
+  struct TaskDeque
+  {
+    mutex mtx;
+    deque<Task> tasks;
+  };
+  vector<unique_ptr<TaskDeque>> deques;
+    // Index: worker number, the last one is shared
+  vector<thread> threads;
+  mutex sleepMtx;
+  condition_variable sleepCv;
+  size_t queued {0};
+    // Number of tasks in deques or being pushed
+    // Guarded by sleepMtx
+  bool stopping {false};
+  static thread_local const ThreadPool* currentPool;
+  static thread_local size_t currentWorker;
+public:
+
+
+  explicit ThreadPool (size_t threads_arg);
+ ~ThreadPool ();
+  static ThreadPool& global ();
+    // threads_max - 1 workers, created at the first call
+    // Never destroyed, so that the process can exit while tasks are running
+
+
+  size_t size () const
+    { return threads. size (); }
+  void push (function<void ()> &&func,
+             TaskGroup &group);
+  bool runOne (TaskGroup* group);
+    // Run one queued task of group by this thread
+    // Input: group: nullptr <=> any
+    // Return: false <=> no such task is queued
+  template <typename Pred>
+    void sleep (const TaskGroup &group,
+                const Pred &wakeUp);
+      // Until wakeUp() or a task of group is queued
+      // Requires: wakeAll() is invoked after the state of wakeUp() is changed
+  void wakeAll ()
+    { { const lock_guard<mutex> lock (sleepMtx); }
+      sleepCv. notify_all ();
+    }
+private:
+  bool pop (Task &task,
+            const TaskGroup* group);
+  void work (size_t worker);
+};
+
+
+
+struct TaskGroup : Nocopy
+// Tasks run by a ThreadPool and joined by wait()
+{
+private:
+  friend ThreadPool;
+  ThreadPool &pool;
+  atomic<size_t> pending {0};
+  size_t queued {0};
+    // Number of the tasks in the deques of pool
+    // Guarded by pool.sleepMtx
+  mutex errorMtx;
+  exception_ptr error;
+    // Of the first task which has thrown
+public:
+
+
+  explicit TaskGroup (ThreadPool &pool_arg = ThreadPool::global ())
+    : pool (pool_arg)
+    {}
+ ~TaskGroup ()
+    { try { wait (); }
+        catch (...) {}
+    }
+
+
+  void run (function<void ()> &&task);
+    // task is run immediately if the pool has no workers
+  void wait ()
+    // Runs queued tasks of *this meanwhile
+    // Rethrows the first exception of the tasks
+    { waitBelow (0);
+      if (error)
+      { const exception_ptr e (error);
+        error = nullptr;
+        rethrow_exception (e);
+      }
+    }
+  void waitBelow (size_t n)
+    // Until the number of the not finished tasks <= n
+    // Runs queued tasks of *this meanwhile
+    { while (pending > n)
+        if (! pool. runOne (this))
+          pool. sleep (*this, [this, n] () { return pending <= n; });
+    }
+  size_t getPending () const
+    { return pending; }
+};
+
+
+
+template <typename Pred>
+  void ThreadPool::sleep (const TaskGroup &group,
+                          const Pred &wakeUp)
+    { unique_lock<mutex> lock (sleepMtx);
+      sleepCv. wait (lock, [&group, &wakeUp] () { return group. queued || wakeUp (); });
+    }
+
+
+
 template <typename Func, typename Res, typename... Args>
-  void arrayThreads (bool quiet,
-                     const Func& func,
+  void arrayThreads (const Func& func,
                      size_t i_max,
                      vector<Res> &results,
                      Args&&... args)
   // Input: void func (size_t from, size_t to, Res& res, Args...)
-  // Optimial thread_num minimizes (Time_SingleCPU/thread_num + Time_openCloseThread * (thread_num - 1)), which is sqrt(Time_SingleCPU/Time_openCloseThread)
+  // Output: results: of consecutive ranges of [0,i_max)
+  // The ranges are tasks of ThreadPool::global(), several per thread for load balancing, and can be nested
   {
   	if (threads_max < 1)
   	  throwf ("threads_max < 1");
 		results. clear ();
-		results. reserve (threads_max);
-  	if (threads_max == 1 || i_max <= 1 || ! Threads::empty ())
+  	if (threads_max == 1 || i_max <= 1)
   	{
   		results. push_back (Res ());
     	func (0, i_max, results. front (), std::forward<Args>(args)...);
   		return;
   	}
-		size_t chunk = max<size_t> (1, i_max / threads_max);
-		if (chunk * threads_max < i_max)
-			chunk++;
-		if (chunk * threads_max < i_max)
-		  throwf ("chunk * threads_max < i_max");
-		Threads th (threads_max - 1, quiet);
-		for (size_t tn = 0; tn < threads_max; tn++)
-	  {
-	    const size_t from = tn * chunk;
-	  	if (from >= i_max)
-	  		break;
-	    const size_t to = from + chunk;
-	    results. push_back (Res ());
-	    Res& res = results. back ();
-	    if (to >= i_max)
-	    {
-	    	func (from, i_max, res, std::forward<Args>(args)...);
-	    	break;
-	    }
-		  th << thread (func, from, to, ref (res), std::forward<Args>(args)...);
+  	constexpr size_t chunksPerThread = 4;  // PAR
+  	const size_t chunks = min (i_max, threads_max * chunksPerThread);
+		results. resize (chunks);
+		TaskGroup tg;
+		for (size_t k = 0; k < chunks; k++)
+		{
+	    const size_t from = i_max * k       / chunks;
+	    const size_t to   = i_max * (k + 1) / chunks;
+		  tg. run ([&func, &results, &args..., from, to, k] () { func (from, to, results [k], args...); });
 		}
+		tg. wait ();
   }
 
 
@@ -3414,6 +3682,38 @@ struct Unverbose
 	Unverbose ();
  ~Unverbose ();
 };
+
+
+
+// Tracing
+
+#ifndef TRACE_LEVEL_MAX
+  #define TRACE_LEVEL_MAX 3
+#endif
+  // Trace points of a greater level are not compiled
+
+struct Trace
+// Records of TRACE() are kept in a ring buffer of each thread, the oldest records are overwritten
+// Thread-safe
+{
+  static atomic<int> level;
+    // Records of a level <= level are kept
+    // 0: tracing is off
+  static constexpr size_t ring_size {1024};  // PAR
+    // Records per thread
+
+
+  static bool on (int level_arg)
+    { return level_arg <= level. load (memory_order_relaxed); }
+  static void add (int level_arg,
+                   string &&text);
+  static void dump (ostream &os);
+    // Output: records of all threads in the order of add()'s
+    // Records are removed
+};
+
+#define TRACE(level,x)  { if ((level) <= TRACE_LEVEL_MAX && Trace::on (level)) { ostringstream os_trace_; os_trace_ << x; Trace::add ((level), os_trace_. str ()); } }
+  // x: <<-separated expression, evaluated only if the trace point is enabled
   
 
 
@@ -3556,6 +3856,39 @@ struct Chronometer_OnePass_cerr : Chronometer_OnePass
     {}
 };
 
+
+
+struct ResourceChronometer
+// Astronomical time, CPU time and peak memory of the process and its finished child processes
+// Accumulated over start()-stop() pairs
+{
+  string name;
+  double wall {0.0};
+  double cpu {0.0};
+    // sec.
+  size_t rss_max {0};
+  size_t childRss_max {0};
+    // KB, at stop()
+  size_t runs {0};
+private:
+  double wallStart {-1.0};
+  double cpuStart {0.0};
+public:
+
+
+  explicit ResourceChronometer (const string &name_arg)
+    : name (name_arg)
+    {}
+
+
+  void start ();
+  void stop ();
+  void add (const ResourceChronometer &other);
+    // Requires: other is stopped
+  void saveJson (JsonContainer* parent) const;
+};
+
+
 	
 
 
@@ -3614,8 +3947,11 @@ struct Input : Root, Nocopy
 {
 protected:
   IFStream ifs;
+  unique_ptr<GzipIStream> gzs;
+    // File is gzipped
   istream* is {nullptr};
     // ifs.is_open() => is = &ifs
+    // gzs => is = gzs.get()
 public:
   bool eof {false};
     // End of file
@@ -3626,11 +3962,7 @@ public:
 
 protected:	
   Input (const string &fName,
-         uint displayPeriod)
-    : ifs (fName)
-    , is (& ifs)
-    , prog (0, displayPeriod)  
-    {}
+         uint displayPeriod);
   Input (istream &is_arg,
 	       uint displayPeriod);
 public:
@@ -3666,19 +3998,90 @@ struct LineInput : Input
     // Invokes: trimTrailing()
 	bool expectPrefix (const string &prefix,
 	                   bool eofAllowed)
-		{ if (nextLine () && trimPrefix (line, prefix))
-		  	return true;  
-			if (eof && eofAllowed)
-				return false;
-		  throw runtime_error ("No " + strQuote (prefix));
-		  return false;  // dummy
-		}
+    { if (nextLine () && trimPrefix (line, prefix))
+        return true;
+      if (eof && eofAllowed)
+        return false;
+      throw runtime_error ("No " + strQuote (prefix));
+      return false;  // dummy
+    }
 	string lineStr (bool add1 = true) const
 	  { return "line " + to_string (lineNum + add1); }
 };
 	
 
 
+struct FastqInput : LineInput
+// FASTQ file of 4-line records, can be gzipped
+{
+  string id;
+  string seq;
+    // Current record
+
+
+	explicit FastqInput (const string &fName,
+          	           uint displayPeriod = 0)
+    : LineInput (fName, displayPeriod)
+    {}
+
+
+  bool nextRecord ();
+    // Output: id, seq
+    // Throws: runtime_error if the record is incorrect
+};
+	
+
+
+struct FieldSplitter
+// Zero-copy split of a line into fields
+{
+private:
+  string_view rest;
+  char delimiter {'\t'};
+  size_t fields {0};
+    // Number of returned fields
+  bool done {false};
+public:
+  
+  
+  explicit FieldSplitter (string_view line,
+                          char delimiter_arg = '\t')
+    : rest (line)
+    , delimiter (delimiter_arg)
+    {}
+    
+    
+  bool empty () const
+    { return done; }
+  string_view next ()
+    // Return: next field
+    { if (done)
+        throw runtime_error ("No field #" + to_string (fields + 1));
+      fields++;
+      const size_t pos = rest. find (delimiter);
+      const string_view field (rest. substr (0, pos));
+      if (pos == string_view::npos)
+      { rest = string_view ();
+        done = true;
+      }
+      else
+        rest. remove_prefix (pos + 1);
+      return field;
+    }
+  template <typename T>
+    T nextNum ()
+      // Return: next field as an integer
+      { const string_view field (next ());
+        T n {};
+        const auto res = from_chars (field. data (), field. data () + field. size (), n);
+        if (res. ec != errc () || res. ptr != field. data () + field. size ())
+          throw runtime_error ("Field #" + to_string (fields) + " is not a number: " + strQuote (string (field)));
+        return n;
+      }
+};
+
+
+
 struct PairFile : Root
 {
 private:
@@ -3797,13 +4200,15 @@ struct Token : Root
 	  {}
 	Token (CharInput &in,
 	       bool dashInName_arg,
-	       bool consecutiveQuotesInText)
-	  { readInput (in, dashInName_arg, consecutiveQuotesInText); }
+	       bool consecutiveQuotesInText,
+	       bool backslashInText = false)
+	  { readInput (in, dashInName_arg, consecutiveQuotesInText, backslashInText); }
 	Token (CharInput &in,
 	       Type expected,
 	       bool dashInName_arg,
-	       bool consecutiveQuotesInText)
-    { readInput (in, dashInName_arg, consecutiveQuotesInText);
+	       bool consecutiveQuotesInText,
+	       bool backslashInText = false)
+    { readInput (in, dashInName_arg, consecutiveQuotesInText, backslashInText);
     	if (empty ())
  			  in. error ("No token", false); 
     	if (type != expected)
@@ -3812,8 +4217,10 @@ struct Token : Root
 private:
 	void readInput (CharInput &in,
 	                bool dashInName_arg,
-	                bool consecutiveQuotesInText);  
+	                bool consecutiveQuotesInText,
+	                bool backslashInText);  
 	  // Input: consecutiveQuotesInText means that '' = '
+	  //        backslashInText: '\\' and the next character are kept in the text, which does not end at an escaped quote (JSON)
     // Update: in: in.charNum = last character of *this
 public:
 	void qc () const override;
@@ -3966,6 +4373,57 @@ public:
 
 
 
+struct FastaCheck
+// Check the correctness of a FASTA file
+{
+  // Parameters
+  bool aa {false};
+    // Amino acid sequences, otherwise nucleotide
+  bool hyphen {false};
+    // Hyphens are allowed
+  bool ambig {false};
+    // Ambiguous characters are allowed
+  size_t ambig_max {0};
+    // Max. number of ambiguous characters in sequences
+  bool stop_codon {false};
+    // Stop codons ('*') in the protein sequence are allowed
+  ostream* lenF {nullptr};
+    // Output: lines <sequence id> <length>
+  ostream* outF {nullptr};
+    // Output: FASTA with some of the issues fixed
+
+  // Output
+  struct Seq
+  {
+    string id;
+    size_t offset {0};
+      // In the concatenation of the sequences
+    size_t len {0};
+  };
+  Vector<Seq> seqs;
+    // In the file order
+    // Without skipped sequences
+  StringVector ids;
+    // All sequence identifiers, in the file order
+  size_t seqSize_max {0};
+  size_t seqSize_sum {0};
+
+
+  void run (const string &fName,
+            const function<void (const string &id, const string &seq)> &processSeq = nullptr);
+    // Invokes: processSeq() for each element of seqs in the file order, not concurrently, before the checks of the whole file
+    // Throws: runtime_error if the file is incorrect
+    // Parts of an uncompressed file are checked by the tasks of ThreadPool::global() if !outF,
+    //   the sequences of a part are kept until processSeq() of the previous parts
+  void runSeqs (const Vector<pair<string_view,string_view>> &records,
+                const string &name);
+    // As run() of the FASTA file named name with records (sequence identifier, sequence), a sequence in one line
+    // Requires: !outF
+};
+
+
+
+
 ///////////////////////////////////// Json //////////////////////////////////////////
 		
 extern unique_ptr<JsonMap> jRoot;
@@ -4189,6 +4647,8 @@ public:
   JsonMap ();
     // Output: jRoot = this
   explicit JsonMap (const string &fName);
+  explicit JsonMap (istream &is);
+    // Input: is: a JSON object, e.g., a line of JSON Lines
 private:
   JsonMap (CharInput& in,
            JsonContainer* parent,
@@ -4633,10 +5093,21 @@ protected:
   // Environment
   const bool useTmp;
   string tmp;
-    // Temporary directory: ($TMPDIR or "/tmp") + "/" + programName + "XXXXXX"
+    // Temporary directory: ($TMPDIR or "/tmp") + "/" + programName + "XXXXXX", or in scratchRamDir if scratchRam_max
     // If log is used then tmp is printed in the log file and the temporary files are not deleted 
+  size_t scratchRam_max {0};
+    // Max. bytes reserved by Scratch's in tmp if tmp is in RAM, otherwise 0
+  static constexpr const char* scratchRamDir {"/dev/shm"};
 private:
   bool tmpCreated {false};
+  string tmpDir;
+    // $TMPDIR or "/tmp"
+  mutable mutex scratchMtx;
+  mutable size_t scratchRam {0};
+    // Bytes reserved in tmp, <= scratchRam_max
+  mutable string tmpDisk;
+    // Temporary directory in tmpDir for the Scratch's not fitting in scratchRam_max, created on demand
+    // = tmp if !scratchRam_max
 protected:
   string execDir;
     // Ends with '/'
@@ -4644,6 +5115,13 @@ protected:
   mutable KeyValue prog2dir;
   mutable Stderr stderr;
   time_t startTime {0};
+  string probeCacheDir;
+    // Persistent cache of the results of findProg() and progOutput(): ($XDG_CACHE_HOME or $HOME/.cache) + "/" + programName + "/probes/"
+    // Empty if the cache is not used: $<PROGRAMNAME>_NO_PROBE_CACHE is set, or the directory cannot be created
+private:
+  mutable mutex probeMtx;
+  mutable KeyValue probe2output;
+    // Of progOutput()
 public:
   
   
@@ -4656,7 +5134,7 @@ public:
     , useTmp (useTmp_arg)
     {}
  ~ShellApplication ();
-   // Invokes: removeDirectory(tmp) if !logPtr
+   // Invokes: removeDirectory(tmp), removeDirectory(tmpDisk) if !logPtr
 
 
 protected:
@@ -4673,6 +5151,7 @@ protected:
     {	return s. empty () || s == "\'\'"; }
   void findProg (const string &progName) const;
     // Output: prog2dir
+    // Uses probeCacheDir
   string fullProg (const string &progName) const;
     // Return: shellQuote (directory + progName) + ' '
     // Requires: After findProg(progName)
@@ -4685,10 +5164,47 @@ protected:
                      const string &suffix) const;
     // Return: quotedFName or tmp + "/" + suffix
     // Invokes: exec("gunzip")
+  string progOutput (const string &progName,
+                     const string &args) const;
+    // Return: STDOUT of fullProg(progName) + args
+    // Cached in memory and in probeCacheDir by the path, mtime and size of the binary
+    // Requires: the output depends only on the binary and args, e.g. args = "-help" or "-version"
+    // Thread-safe
   string getBlastThreadsParam (const string &blast,
                                size_t threads_max_max) const;
     // Input: blast: "blastp", "blastx", etc.
-    // Invokes: fullProg(blast)
+    // Invokes: progOutput(blast)
+
+  struct Scratch
+  // Directory of the temporary files of a job: in tmp if the job fits in the rest of scratchRam_max, otherwise in tmpDisk
+  {
+  private:
+    const ShellApplication& app;
+    size_t reserved {0};
+      // In app.scratchRam
+    bool created {false};
+  public:
+    string dir;
+      // Ends with '/'
+    bool ram {false};
+
+    Scratch (const ShellApplication &app_arg,
+             const string &subDir,
+             size_t bytes);
+      // Input: subDir: empty or ends with '/', created in tmp or tmpDisk, must be unique among the existing Scratch's
+      //        bytes: estimated size of the temporary files
+   ~Scratch ();
+      // Invokes: removeDirectory(dir) if subDir is not empty and !logPtr
+    Scratch (const Scratch&) = delete;
+    Scratch& operator= (const Scratch&) = delete;
+  };
+private:
+  string probeFName (const string &key) const
+    { return probeCacheDir + [&key] () { ostringstream oss; oss << hex << setfill ('0') << setw (16) << fnv1a (key); return oss. str (); } (); }
+  string probeRead (const string &key) const;
+    // Return: empty() if not cached
+  void probeWrite (const string &key,
+                   const string &value) const;
 };
 #endif
 
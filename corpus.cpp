@@ -0,0 +1,335 @@
+// corpus.cpp
+
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+* Author: Vyacheslav Brover
+*
+* File Description:
+*   Synthetic assemblies for the throughput benchmark of stxtyper
+*
+*/
+
+
+#undef NDEBUG
+
+#include "common.hpp"
+#include "tsv.hpp"
+using namespace Common_sp;
+#include "stx.hpp"
+using namespace Stx_sp;
+
+#include "common.inc"
+
+
+
+namespace
+{
+
+
+// E. coli codons
+const map<char,vector<string>> aa2codons
+  { {'A', {"GCG", "GCC", "GCA", "GCT"}}
+  , {'C', {"TGC", "TGT"}}
+  , {'D', {"GAT", "GAC"}}
+  , {'E', {"GAA", "GAG"}}
+  , {'F', {"TTT", "TTC"}}
+  , {'G', {"GGC", "GGT", "GGG", "GGA"}}
+  , {'H', {"CAT", "CAC"}}
+  , {'I', {"ATT", "ATC", "ATA"}}
+  , {'K', {"AAA", "AAG"}}
+  , {'L', {"CTG", "TTA", "TTG", "CTT", "CTC", "CTA"}}
+  , {'M', {"ATG"}}
+  , {'N', {"AAC", "AAT"}}
+  , {'P', {"CCG", "CCA", "CCT", "CCC"}}
+  , {'Q', {"CAG", "CAA"}}
+  , {'R', {"CGT", "CGC", "CGG", "CGA", "AGA", "AGG"}}
+  , {'S', {"AGC", "TCT", "TCC", "TCG", "AGT", "TCA"}}
+  , {'T', {"ACC", "ACG", "ACT", "ACA"}}
+  , {'V', {"GTG", "GTT", "GTC", "GTA"}}
+  , {'W', {"TGG"}}
+  , {'Y', {"TAT", "TAC"}}
+  };
+const string aas ("ACDEFGHIKLMNPQRSTVWY");
+
+
+
+struct Generator
+{
+  Rand rand;
+  map<string/*stxType*/,Vector<string>> A, B;
+    // Proteins without '*'
+  StringVector types;
+    // With A and B proteins
+
+
+  Generator (const string &protFName,
+             ulong seed)
+    : rand (seed)
+    { checkStxRefs (protFName);
+      string id;
+      string seq;
+      auto add = [&] ()
+        { if (id. empty ())
+            return;
+          trimSuffix (seq, "*");
+          const StxRef& ref = stxRefs [stxRefIndex (id)];
+          (ref. subunit == 'A' ? A : B) [string (ref. stxType)] << seq;
+        };
+      LineInput f (protFName);
+      while (f. nextLine ())
+      {
+        trimTrailing (f. line);
+        if (isLeft (f. line, ">"))
+        {
+          add ();
+          id = f. line. substr (1);
+          id = findSplit (id);
+          seq. clear ();
+        }
+        else
+          seq += f. line;
+      }
+      add ();
+      for (const auto& it : A)
+        if (contains (B, it. first))
+          types << it. first;
+      QC_ASSERT (! types. empty ());
+    }
+
+
+  string dna (size_t len)
+    { string s (len, ' ');
+      for (char& c : s)
+        c = "ACGT" [rand. get (4)];
+      return s;
+    }
+  string backTranslate (const string &prot)
+    // Return: with a stop codon
+    { string s;  s. reserve (3 * prot. size () + 3);
+      for (const char aa : prot)
+      {
+        const vector<string>& codons = aa2codons. at (aa);
+        s += codons [rand. get (codons. size ())];
+      }
+      s += "TAA";
+      return s;
+    }
+  template <typename T>
+    const T& pick (const Vector<T> &vec)
+      { QC_ASSERT (! vec. empty ());
+        return vec [rand. get (vec. size ())];
+      }
+  string operon (const string &type)
+    // Return: stxA, intergenic region, stxB on the + strand
+    { return   backTranslate (pick (A. at (type)))
+             + dna (10 + rand. get (10))  // PAR
+             + backTranslate (pick (B. at (type)));
+    }
+  string decoy ()
+    // Return: stxA with 70% of the amino acids replaced
+    { string prot (pick (A. at (pick (types))));
+      for (char& aa : prot)
+        if (rand. get (100) < 70)  // PAR
+          aa = aas [rand. get (aas. size ())];
+      return backTranslate (prot);
+    }
+  void insert (string &contig,
+               string s)
+    // Input: s: + strand
+    // Output: contig: s is inserted on a random strand at a random position
+    { if (rand. get (2))
+        reverseDna (s);
+      contig. insert (rand. get (contig. size () + 1), s);
+    }
+  static void reverseDna (string &s)
+    { reverse (s);
+      for (char& c : s)
+        switch (c)
+        {
+          case 'A': c = 'T'; break;
+          case 'C': c = 'G'; break;
+          case 'G': c = 'C'; break;
+          case 'T': c = 'A'; break;
+        }
+    }
+};
+
+
+
+struct Assembly
+{
+  string name;
+  StringVector contigs;
+  size_t operons {0};
+    // Planted
+  size_t decoys {0};
+
+
+  size_t len () const
+    { size_t n = 0;
+      for (const string& s : contigs)
+        n += s. size ();
+      return n;
+    }
+  void save (const string &fName) const
+    { OFStream f (fName);
+      FFOR (size_t, i, contigs. size ())
+      {
+        f << ">" << name << "_" << i + 1 << '\n';
+        constexpr size_t lineLen = 80;  // PAR
+        for (size_t pos = 0; pos < contigs [i]. size (); pos += lineLen)
+          f << contigs [i]. substr (pos, lineLen) << '\n';
+      }
+    }
+};
+
+
+
+struct ThisApplication : Application
+{
+  ThisApplication ()
+    : Application ("Generate synthetic assemblies for the stxtyper throughput benchmark: isolates with complete stx operons back-translated from the stx reference proteins, an operon split by a contig end, a frameshifted operon, and metagenomes with decoy near-stx genes.\n\
+Output: OUT_DIR/<name>.fa, OUT_DIR/manifest.tsv (a manifest for stxtyper --batch), OUT_DIR/corpus.tsv (the numbers of contigs, bp, planted operons and decoys)")
+    {
+      addPositional ("out_dir", "Output directory, created if it does not exist");
+      addKey ("stx_prot", "stx reference proteins", "stx.prot");
+      addKey ("isolate_operons", "Comma-separated numbers of operons of the isolates", "0,1,2,5");
+      addKey ("isolate_contigs", "Number of contigs of an isolate", "100");
+      addKey ("isolate_contig_len", "Contig length of an isolate", "50000");
+      addKey ("metagenome_contigs", "Comma-separated numbers of contigs of the metagenomes", "1000,10000");
+      addKey ("metagenome_contig_len", "Average contig length of a metagenome, the lengths are uniform in [len/2,3*len/2]", "2000");
+      addKey ("metagenome_operons", "Number of operons in a metagenome", "2");
+      addKey ("decoys", "Number of decoy stxA genes with 70% of the amino acids replaced per 1000 contigs of a metagenome", "10");
+	    version = SVN_REV;
+    }
+
+
+
+  void body () const final
+  {
+    const string outDir               = getArg ("out_dir");
+    const string protFName            = getArg ("stx_prot");
+    const string isolateOperonsS      = getArg ("isolate_operons");
+    const size_t isolateContigs       = str2<size_t> (getArg ("isolate_contigs"));
+    const size_t isolateContigLen     = str2<size_t> (getArg ("isolate_contig_len"));
+    const string metagenomeContigsS   = getArg ("metagenome_contigs");
+    const size_t metagenomeContigLen  = str2<size_t> (getArg ("metagenome_contig_len"));
+    const size_t metagenomeOperons    = str2<size_t> (getArg ("metagenome_operons"));
+    const size_t decoysPer1000        = str2<size_t> (getArg ("decoys"));
+    QC_ASSERT (isolateContigs);
+    QC_ASSERT (isolateContigLen);
+    QC_ASSERT (metagenomeContigLen >= 2);
+
+    if (! directoryExists (outDir))
+      createDirectory (outDir);
+    const string dir (outDir + "/");
+
+    Generator gen (protFName, seed_global);
+
+    auto isolate = [&gen, isolateContigs, isolateContigLen] (const string &name)
+      { Assembly as;
+        as. name = name;
+        FFOR (size_t, i, isolateContigs)
+          as. contigs << gen. dna (isolateContigLen);
+        return as;
+      };
+
+    Vector<Assembly> assemblies;
+
+    for (const string& s : StringVector (isolateOperonsS, ',', true))
+    {
+      Assembly as (isolate ("isolate_" + s));
+      as. operons = str2<size_t> (s);
+      FFOR (size_t, i, as. operons)
+        gen. insert (as. contigs [gen. rand. get (as. contigs. size ())], gen. operon (gen. pick (gen. types)));
+      assemblies << std::move (as);
+    }
+
+    {
+      Assembly as (isolate ("isolate_split"));
+      as. operons = 1;
+      // The operon is split inside stxA between the end of contig 0 and the start of contig 1
+      const string op (gen. operon (gen. pick (gen. types)));
+      const size_t cut = 500;  // PAR
+      as. contigs [0] += op. substr (0, cut);
+      as. contigs [1]. insert (0, op. substr (cut));
+      assemblies << std::move (as);
+    }
+
+    {
+      Assembly as (isolate ("isolate_frameshift"));
+      as. operons = 1;
+      string op (gen. operon (gen. pick (gen. types)));
+      op. erase (400, 1);  // PAR, inside stxA
+      gen. insert (as. contigs [0], op);
+      assemblies << std::move (as);
+    }
+
+    for (const string& s : StringVector (metagenomeContigsS, ',', true))
+    {
+      Assembly as;
+      as. name = "metagenome_" + s;
+      const size_t contigs = str2<size_t> (s);
+      QC_ASSERT (contigs);
+      FFOR (size_t, i, contigs)
+        as. contigs << gen. dna (metagenomeContigLen / 2 + gen. rand. get (metagenomeContigLen + 1));
+      as. operons = metagenomeOperons;
+      FFOR (size_t, i, as. operons)
+        gen. insert (as. contigs [gen. rand. get (contigs)], gen. operon (gen. pick (gen. types)));
+      as. decoys = contigs * decoysPer1000 / 1000;
+      FFOR (size_t, i, as. decoys)
+        gen. insert (as. contigs [gen. rand. get (contigs)], gen. decoy ());
+      assemblies << std::move (as);
+    }
+
+    OFStream manifest (dir + "manifest.tsv");
+    OFStream corpus (dir + "corpus.tsv");
+    TsvOut td (corpus, 2, false);
+    td << "name" << "file" << "contigs" << "bp" << "operons" << "decoys";
+    td. newLn ();
+    for (const Assembly& as : assemblies)
+    {
+      const string fName (dir + as. name + ".fa");
+      as. save (fName);
+      manifest << as. name << '\t' << fName << '\n';
+      td << as. name << fName << as. contigs. size () << as. len () << as. operons << as. decoys;
+      td. newLn ();
+      cerr << as. name << '\t' << as. contigs. size () << " contigs\t" << as. len () << " bp" << endl;
+    }
+  }
+};
+
+
+
+}  // namespace
+
+
+
+int main (int argc,
+          const char* argv[])
+{
+  ThisApplication app;
+  return app. run (argc, argv);
+}
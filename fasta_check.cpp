@@ -49,7 +49,7 @@ namespace
 struct ThisApplication : Application
 {
   ThisApplication ()
-    : Application ("Check the correctness of a FASTA file. Exit with an error if it is incorrect. Print the number of sequences, max. sequence length and total sequence length")
+    : Application ("Check the correctness of a FASTA file. Exit with an error if it is incorrect. Print the number of sequences, max. sequence length and total sequence length", true, false, true)
     {
       addPositional ("in", "FASTA file");
       addFlag ("aa", "Amino acid sequenes, otherwise nucleotide");
@@ -67,15 +67,17 @@ struct ThisApplication : Application
   void body () const final
   {
     const string fName     = getArg ("in");
-    const bool aa          = getFlag ("aa");
-    const bool hyphen      = getFlag ("hyphen");
-    const bool ambig       = getFlag ("ambig");
-    const size_t ambig_max = str2<size_t> (getArg ("ambig_max"));
-    const bool stop_codon  = getFlag ("stop_codon");
     const string lenFName  = getArg ("len");
     const string outFName  = getArg ("out");
+
+    FastaCheck fc;
+    fc. aa         = getFlag ("aa");
+    fc. hyphen     = getFlag ("hyphen");
+    fc. ambig      = getFlag ("ambig");
+    fc. ambig_max  = str2<size_t> (getArg ("ambig_max"));
+    fc. stop_codon = getFlag ("stop_codon");
     
-    QC_IMPLY (stop_codon, aa);
+    QC_IMPLY (fc. stop_codon, fc. aa);
     
 
     unique_ptr<OFStream> lenF;
@@ -84,157 +86,14 @@ struct ThisApplication : Application
     unique_ptr<OFStream> outF;
     if (! outFName. empty ())
       outF. reset (new OFStream (outFName));
-    size_t lines = 0;
-    StringVector ids;  ids. reserve (100000);  // PAR
-    size_t seqSize_max = 0;
-    size_t seqSize_sum = 0;
-  //string errorS;
-    // One sequence
-    size_t xs = 0;
-    string header;
-    string seq;
-    
-    auto processSeq = [&] () 
-  	  {
-  	    if (! lines)
-  	      return;
- 	  		ASSERT (! header. empty ());
- 	  		ASSERT (! ids. empty ());
- 	  		const string id (ids. back ());
-  	    if (aa && ! stop_codon)
-  	    {  	    
-    	    while (! seq. empty () && seq. back () == '*')
-   	  		  if (outF)
-   	  		    seq. erase (seq. size () - 1);
-   	  		  else
-    		      throw runtime_error (id + ": '*' at the sequence end");
-    		}
-  	    if (seq. empty ())
- 	  		  throw runtime_error (id + ": Empty sequence");
- 	  		bool skip = false;
-  	    if (! ambig && xs > ambig_max)
-  	    {
- 	  		  if (outF)
- 	  		    skip = true;
- 	  		  else
-  		      throw runtime_error (id + ": Too many ambiguities");
-  		  }
-  		  if (skip)
-  		    { LOG ("Skipping " + id); }
-  		  else
-  		  {
-     	  	if (lenF. get ())
-     	  	  *lenF << id << '\t' << seq. size () << endl;
-  	      if (outF)
-  	        *outF << header << endl << seq << endl;
-   	  	  maximize (seqSize_max, seq. size ());
-   	  	  seqSize_sum += seq. size ();
-   	  	}
-    	  xs = 0;
-    	  header. clear ();
-    	  seq. clear ();
- 	    };
+    fc. lenF = lenF. get ();
+    fc. outF = outF. get ();
     
-    size_t nuc = 0;   
-    {
-      LineInput f (fName); 
-      string id;
-      while (f. nextLine ())
-      {
-        trimTrailing (f. line);
-        if (f. line. empty ())
-        	continue;
-      	const string errorS ("File " + fName + ", " + f. lineStr (false) + ": ");
-      	if (f. line [0] == '>')
-      	{
-      		size_t pos = 1;
-      		while (pos < f. line. size () && ! isspace (f. line [pos]))
-      		  pos++;
-      		id = f. line. substr (1, pos - 1);
-      		if (id. empty ())
-      			throw runtime_error (errorS + "Empty sequence identifier");
-        #if 0
-      		if (id. size () > 1000)  // PAR
-      			throw runtime_error (errorS + "Too long sequence identifier");
-        #endif
-      	  for (const char c : id)
-      	  	if (! printable (c))
-      	  		throw runtime_error (errorS + "Non-printable character in the sequence identifier: " + to_string ((int) c));
-      	  // BLAST: PD-4548
-      	  if (! aa)
-      	  {
-        	  if (id. front () == '?')
-       	  		throw runtime_error (errorS + "Sequence identifier starts with '?'");
-       	  	for (const char c : {',', ';', '.', '~'})
-          	  if (id. back () == c)
-         	  		throw runtime_error (errorS + "Sequence identifier ends with " + strQuote (string (1, c)));
-        	  if (contains (id, "\\t"))
-       	  		throw runtime_error (errorS + "Sequence identifier contains '\\t'");
-        	  if (contains (id, ",,"))
-       	  		throw runtime_error (errorS + "Sequence identifier contains ',,'");
-       	  }
-     	    processSeq ();
-      	  header = f. line;
-      	  ids << id;
-      	}
-      	else 
-      	{
-      		if (! lines)
-      			throw runtime_error (errorS + "FASTA should start with '>'");
-      	  for (const char c : f. line)
-      	  {
-      	    bool skip = false;
-      	  	if (c == '-')
-      	  		if (hyphen)
-      	  			;
-      	  		else
-      	  		{
-      	  		  if (outF)
-      	  		    skip = true;
-      	  		  else
-  	    	  		  throw runtime_error (errorS + "Hyphen in the sequence");  	    	  		  
-  	    	    }
-  	    	  else
-  	    	  {
-  	    	  	const char c1 = toLower (c);
-  	    	  	if (aa)
-  	    	  	{
-  		    	  	if (! charInSet (c1, "acdefghiklmnpqrstvwyxbzjuoacdefghiklmnpqrstvwyxbzjuo*"))
-  		    	  		throw runtime_error (errorS + "Wrong amino acid character: (code = " + to_string ((int) c) + ") '" + c + "'");
-  		    	    if (charInSet (c1, "acgt"))
-  		    	    	nuc++;
-  		    	    if (charInSet (c1, "xbzjuo"))
-  		    	      xs++;
-  		    	  }
-  	    	  	else
-  	    	  	{
-  		    	  	if (! charInSet (c1, "acgtbdhkmnrsvwyacgtbdhkmnrsvwy"))
-  		    	  		throw runtime_error (errorS + "Wrong nucleotide character: (code = " + to_string ((int) c) + ") '" + c + "'");
-  		    	    if (charInSet (c1, "bdhkmnrsvwy"))
-  		    	      xs++;
-  		    	  }
-  		    	}
-  		    	if (! skip)
-  		    	  seq += c;
-  		    }
-      	}
-      	lines++;
-  	  }
-  	}
-    processSeq ();	// Last sequence
-	  if (! lines)
-	  	throw runtime_error ("Empty file"); 
-  	if (aa && (double) nuc / (double) seqSize_sum > 0.9)  // PAR
-  		throw runtime_error ("Protein sequences looks like a nucleotide sequences");
-  		
-	  ids. sort ();
-	  const size_t index = ids. findDuplicate ();
-	  if (index != no_index)
-	  	throw runtime_error ("Duplicate identifier: " + ids [index]);
+    fc. run (fName);
 	  	
-	  cout << ids. size () << endl
-	       << seqSize_max << endl
-	       << seqSize_sum << endl;
+	  cout << fc. ids. size () << endl
+	       << fc. seqSize_max << endl
+	       << fc. seqSize_sum << endl;
   }
 };
 
@@ -0,0 +1,2384 @@
+// stx.cpp
+
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+* Author: Vyacheslav Brover
+*
+* File Description:
+*   stx typing: reference proteins, alignments, operons, prescreen and the built-in search
+*
+*/
+
+
+#undef NDEBUG
+
+#include "stx.hpp"
+
+#include "common.inc"
+
+
+
+namespace Stx_sp
+{
+
+
+
+const string stxS ("stx");
+const string na ("na");
+
+
+
+size_t stxRefIndex (string_view id)
+// Return: index of stxRefs[]
+{
+  const StxRef* it = lower_bound (begin (stxRefs), end (stxRefs), id, [] (const StxRef &ref, string_view id_) { return ref. id < id_; });
+  if (it == end (stxRefs) || it->id != id)
+    throw runtime_error ("Bad StxTyper database: unknown protein " + string (id));
+  return (size_t) (it - begin (stxRefs));
+}
+
+
+
+void checkStxRefs (const string &fName)
+// Requires: fName is the stx.prot which stxRefs[] is compiled from
+{
+  vector<pair<string,size_t>> id2len;
+  {
+    LineInput f (fName);
+    while (f. nextLine ())
+      if (isLeft (f. line, ">"))
+      {
+        size_t pos = 1;
+        while (pos < f. line. size () && ! isspace (f. line [pos]))
+          pos++;
+        id2len. push_back (make_pair (f. line. substr (1, pos - 1), 0));
+      }
+      else
+      {
+        QC_ASSERT (! id2len. empty ());
+        id2len. back (). second += f. line. size ();
+      }
+  }
+  sort (id2len. begin (), id2len. end ());
+  bool same = id2len. size () == size (stxRefs);
+  for (size_t i = 0; same && i < id2len. size (); i++)
+    same =    id2len [i]. first  == stxRefs [i]. id
+           && id2len [i]. second == stxRefs [i]. len;
+  if (! same)
+    throw runtime_error (fName + " is not the StxTyper database stxtyper is compiled with; re-make stxtyper");
+}
+  
+  
+  
+
+
+string stxType_reported_operon2elementName (const string &stxType_reported,
+                                            const string &operon)
+{
+  string elementName (stxType_reported  + " operon");
+       if (operon == "FRAMESHIFT")
+    elementName += " with frameshift";
+  else if (operon == "INTERNAL_STOP")
+    elementName += " with internal stop";
+  else if (contains (operon, "PARTIAL"))
+    elementName = "Partial " + elementName;
+  else if (operon == "EXTENDED")
+    elementName = "Extended " + elementName;
+  else if (contains (operon, "NOVEL"))
+    elementName = "Novel " + elementName;
+    
+  return elementName;
+}
+
+
+
+void saveReportHeader (TsvOut &td,
+                       const ReportFormat &format,
+                       bool nameP)
+{
+  if (nameP)
+    td << "name";
+  if (format. amrfinder)
+  {
+    td << /* 1*/ "Protein identifier"  
+       << /* 2*/ "Contig id"
+       << /* 3*/ "Start"
+       << /* 4*/ "Stop"
+       << /* 5*/ "Strand"
+       << /* 6*/ "Element symbol"  // PD-4924
+       << /* 7*/ "Element name"  // PD-4910
+       << /* 8*/ "Scope"
+       << /* 9*/ "Element type"
+       << /*10*/ "Element subtype"
+       << /*11*/ "Class"
+       << /*12*/ "Subclass"
+       << /*13*/ "Method"
+       << /*14*/ "Target length"
+       << /*15*/ "Reference sequence length"
+       << /*16*/ "% Coverage of reference sequence"
+       << /*17*/ "% Identity to reference sequence"
+       << /*18*/ "Alignment length"
+       << /*19*/ "Accession of closest sequence"
+       << /*20*/ "Name of closest sequence"
+       << /*21*/ "HMM id"
+       << /*22*/ "HMM description"
+       ;
+    if (format. print_node)
+      td << "Hierarchy node";  
+  }
+  else
+    td << "target_contig"
+       << "stx_type"
+       << "operon" 
+       << "identity"
+       << "target_start"
+       << "target_stop"
+       << "target_strand"
+       << "A_reference"
+       << "A_reference_subtype"
+       << "A_identity"
+       << "A_coverage"
+       << "B_reference"
+       << "B_reference_subtype"
+       << "B_identity"
+       << "B_coverage"
+       ; 
+  td. newLn ();
+}
+
+
+
+// ContigNames
+
+size_t ContigNames::operator[] (string_view name) const
+{
+  const auto it = name2index. find (name);
+  ASSERT (it != name2index. end ());
+  ASSERT (it->second != no_index);
+  return it->second;
+}
+
+
+
+// BlastAlignment
+
+BlastAlignment::BlastAlignment (string_view line,
+                                StringArena &arena,
+                                ContigNames &contigs)
+{
+  string_view targetName_, targetSeq_, refSeq_;
+  {
+    FieldSplitter fs (line);
+  // format:  sseqid       qseqid    sstart         send         slen         qstart      qend      qlen      sseq         qseq
+  // blast:                          62285          63017        88215        105         837       837          
+    try
+    {
+      targetName_ = fs. next ();
+      refIndex    = stxRefIndex (fs. next ());
+      targetStart = fs. nextNum<size_t> ();
+      targetEnd   = fs. nextNum<size_t> ();
+      targetLen   = fs. nextNum<size_t> ();
+      refStart    = fs. nextNum<size_t> ();
+      refEnd      = fs. nextNum<size_t> ();
+      refLen      = fs. nextNum<size_t> ();
+      targetSeq_  = fs. next ();
+      refSeq_     = fs. next ();
+    }
+    catch (const exception &e)
+    {
+      throw runtime_error (string ("Bad BLAST output line: ") + e. what () + "\n" + string (line));
+    }
+    QC_ASSERT (fs. empty ());
+    QC_ASSERT (! targetName_. empty ());
+    QC_ASSERT (! targetSeq_. empty ());	
+  }
+  {
+    const StxRef& ref = stxRefs [refIndex];
+    refAccession  = ref. accession;
+    subunit       = ref. subunit;
+    stxType       = ref. stxType;
+    stxClass      = ref. stxClass;
+    stxSuperClass = ref. stxSuperClass;
+    subClass      = ref. subClass;
+    QC_ASSERT (refLen == ref. len);
+  }
+  ASSERT (stxType. size () == 2);
+          
+  length = targetSeq_. size ();
+  nident = 0;
+  QC_ASSERT (targetSeq_. size () == refSeq_. size ());
+  FFOR (size_t, i, targetSeq_. size ())
+    if (targetSeq_ [i] == refSeq_ [i])
+      nident++;
+
+  QC_ASSERT (refStart < refEnd);
+
+  QC_ASSERT (targetStart != targetEnd);
+  targetStrand = targetStart < targetEnd;  
+  if (! targetStrand)
+    swap (targetStart, targetEnd);
+  
+  QC_ASSERT (refStart >= 1);
+  QC_ASSERT (targetStart >= 1);
+  refStart--;
+  targetStart--;
+  
+//targetAlign = targetEnd - targetStart;
+//QC_ASSERT (targetAlign_aa % 3 == 0);
+//targetAlign_aa /= 3;
+  
+  const size_t stopCodonPos = targetSeq_. find ('*');
+  if (stopCodonPos != string::npos && stopCodonPos + 1 < targetSeq_. size ())
+    stopCodon = true;
+    
+  targetName = contigs. intern (targetName_);
+  targetSeq  = arena. add (targetSeq_);
+  refSeq     = arena. add (refSeq_);
+}
+
+
+
+void BlastAlignment::qc () const
+{
+  if (! qc_on)
+    return;
+  QC_ASSERT (length);
+  QC_ASSERT (nident);
+  QC_ASSERT (nident <= length);
+  QC_ASSERT (targetStart < targetEnd);
+  QC_ASSERT (targetEnd <= targetLen);
+  QC_ASSERT (refStart < refEnd);
+  QC_ASSERT (refEnd <= refLen);
+  if (! frameshift)
+  {
+    QC_ASSERT (nident <= refEnd - refStart);
+    QC_ASSERT (refEnd - refStart <= length);	    
+  }
+  QC_ASSERT (! targetName. empty ());
+  QC_ASSERT (refIndex < size (stxRefs));
+  QC_ASSERT (stxType. substr (0, stxClass. size ()) == stxClass);
+  QC_ASSERT (subunit == 'A' || subunit == 'B');
+  QC_ASSERT (subClass. size () > stxS. size ());
+  QC_ASSERT (! refAccession. empty ());
+  QC_ASSERT (! targetSeq. empty ());
+  QC_ASSERT (! refSeq. empty ());
+  QC_ASSERT (targetSeq. size () == refSeq. size ());
+  QC_IMPLY (! frameshift, length == targetSeq. size ());
+  QC_ASSERT (stxType. size () == 2);
+}
+
+
+
+void BlastAlignment::getReported (bool verboseP,
+                                  string &stxType_reported,
+                                  string &operon) const
+{
+  stxType_reported = verboseP ? getGenesymbol () : (stxS + string (stxType. substr (0, 1)));
+  operon = frameshift 
+             ? "FRAMESHIFT"
+             : stopCodon 
+               ? "INTERNAL_STOP"
+               : truncated () || otherTruncated ()
+                 ? "PARTIAL_CONTIG_END"
+                 : verboseP && getRelCoverage () == 1.0
+                   ? "COMPLETE_SUBUNIT"
+                   : getExtended ()
+                     ? "EXTENDED"
+                     : "PARTIAL";
+}
+
+
+
+void BlastAlignment::saveTsvOut (TsvOut& td,
+                                 bool verboseP,
+                                 const ReportFormat &format) const
+{
+  if (! td. live ())
+    return;
+  string stxType_reported;
+  string operon;
+  getReported (verboseP, stxType_reported, operon);
+  const char strand (targetStrand ? '+' : '-');
+  const double refCoverage = getRelCoverage () * 100.0;
+  const double refIdentity = getIdentity ()    * 100.0; 
+  // td     
+  if (! format. name. empty ())
+    td << format. name;
+  if (format. amrfinder)
+  {
+    const string subunitS (1, subunit);
+    string subclass (stxType_reported /*stxS + stxType*/);
+    strUpper (subclass);
+    td << na               // 1 "Protein identifier"  
+       << targetName       // 2 "Contig id"
+       << targetStart + 1  // 3 "Start"
+       << targetEnd        // 4 "Stop"
+       << strand           // 5 "Strand"
+       << stxType_reported + "_operon" // 6 "Element symbol"
+       << stxType_reported_operon2elementName (stxType_reported, operon)    // 7 "Element name"
+       << "plus"           // 8 "Scope"
+       << "VIRULENCE"      // 9 "Element type"
+       << "STX_TYPE"       //10 "Element subtype"
+       << subclass. substr (0, 4)   //11 "Class"
+       << subclass         //12 "Subclass"
+       << operon           //13 "Method"  
+       << targetEnd - targetStart /*targetAlign*/      //14 "Target length" 
+       << noString /*refLen*/  //15 "Reference sequence length"
+       << noString /*refCoverage*/      //16 "% Coverage of reference sequence"
+       << refIdentity      //17 "% Identity to reference sequence"
+       << length           //18 "Alignment length"
+       << refAccession     //19 "Accession of closest sequence"
+       << "Shiga toxin " + stxS + string (stxType) + " subunit " + subunitS //20 "Name of closest sequence"
+       << na               //21 "HMM id"
+       << na               //22 "HMM description"
+       ;
+    if (format. print_node)
+      td << getGenesymbol ();
+  }
+  else
+  {
+    td << targetName
+       << stxType_reported
+       << operon
+       << noString
+       << targetStart + 1
+       << targetEnd
+       << strand;
+    if (subunit == 'B')
+      td << noString
+         << noString
+         << noString
+         << noString;
+    td << refAccession
+       << subClass
+       << refIdentity
+       << refCoverage;
+    if (subunit == 'A')
+      td << noString
+         << noString
+         << noString
+         << noString;
+  }
+  td. newLn ();
+}
+
+
+
+void BlastAlignment::merge (const BlastAlignment &prev)
+{
+  ASSERT (targetIndex  == prev. targetIndex);
+  ASSERT (refIndex     == prev. refIndex);
+  ASSERT (targetStrand == prev. targetStrand);
+  ASSERT (targetLen    == prev. targetLen);
+  ASSERT (refLen       == prev. refLen);
+  ASSERT (targetStart > prev. targetStart);
+  targetStart = prev. targetStart;
+  if (targetStrand)
+    refStart = prev. refStart;
+  else
+    refEnd = prev. refEnd;
+  length += prev. length;  // Approximately
+  nident += prev. nident;  // Approximately
+//targetAlign += prev. targetAlign;
+  if (prev. stopCodon)
+    stopCodon = true;
+  frameshift = true;
+}
+
+
+
+bool BlastAlignment::getExtended () const
+{
+  ASSERT (! truncated ());
+  return ! refStart && refEnd + 1 == refLen; 
+}
+
+
+
+string BlastAlignment::refMap (size_t len) const
+{
+  QC_ASSERT (refLen <= len);
+  string s = string (refStart, '-'); 
+  FFOR (size_t, i, refSeq. size ())
+    if (refSeq [i] != '-')
+      s += targetSeq [i];
+  s += string (len - refEnd, '-'); 
+  return s;
+}
+
+
+
+bool BlastAlignment::frameshiftLess (const BlastAlignment* a,
+                                     const BlastAlignment* b)
+{
+  ASSERT (a);
+  ASSERT (b);
+  ASSERT (! a->reported);
+  ASSERT (! b->reported);
+  LESS_PART (*a, *b, targetIndex);
+  LESS_PART (*a, *b, targetStrand);
+  LESS_PART (*a, *b, refIndex);
+  LESS_PART (*a, *b, targetStart);
+  LESS_PART (*a, *b, targetEnd);
+  return false;
+}
+
+
+
+bool BlastAlignment::sameTypeLess (const BlastAlignment* a,
+                                   const BlastAlignment* b)
+{
+  ASSERT (a);
+  ASSERT (b);
+  LESS_PART (*a, *b, reported);
+  LESS_PART (*a, *b, targetIndex);
+  LESS_PART (*a, *b, targetStrand);
+  LESS_PART (*a, *b, getClassIndex ());
+  LESS_PART (*a, *b, subunit);
+  LESS_PART (*a, *b, targetStart);
+  LESS_PART (*a, *b, getDiff ());
+  LESS_PART (*a, *b, refIndex);
+  return false;
+}
+
+
+
+bool BlastAlignment::less (const BlastAlignment* a,
+                           const BlastAlignment* b)
+{
+  ASSERT (a);
+  ASSERT (b);
+//LESS_PART (*a, *b, reported);
+  LESS_PART (*a, *b, targetIndex);
+  LESS_PART (*a, *b, targetStrand);
+  LESS_PART (*a, *b, subunit);
+  LESS_PART (*a, *b, targetStart);
+  LESS_PART (*a, *b, getDiff ());
+  LESS_PART (*a, *b, refIndex);
+  return false;
+}
+
+
+
+bool BlastAlignment::reportLess (const BlastAlignment* a,
+                                 const BlastAlignment* b)
+{
+  ASSERT (a);
+  ASSERT (b);
+  LESS_PART (*a, *b, reported);
+  LESS_PART (*a, *b, targetIndex);
+  LESS_PART (*a, *b, targetStrand);
+  LESS_PART (*b, *a, getAbsCoverage ());
+  LESS_PART (*a, *b, getDiff ());
+  LESS_PART (*a, *b, targetStart);
+  LESS_PART (*a, *b, refIndex);
+  return false;
+}
+
+
+
+// Operon
+
+void Operon::qc () const
+{
+  if (! qc_on)
+    return;
+  QC_ASSERT (al1);
+  al1->qc ();
+  QC_ASSERT (al1->reported);
+  if (! al2)
+    return;
+  al2->qc ();
+  QC_ASSERT (al1->targetIndex  == al2->targetIndex);
+  QC_ASSERT (al1->targetStrand == al2->targetStrand);
+  QC_ASSERT (al1->targetEnd    <  al2->targetStart);
+  QC_ASSERT (al1->subunit      != al2->subunit);
+  QC_ASSERT (al2->reported);
+}
+
+
+
+void Operon::getReported (bool verboseP,
+                          string &stxType_reported,
+                          string &operonType) const
+{
+  ASSERT (al1);
+  if (! al2)
+  {
+    al1->getReported (verboseP, stxType_reported, operonType);
+    return;
+  }
+  string stxType (getStxType (verboseP));
+  const string standard ("COMPLETE");
+  const bool novel =    al1->getClassIndex () != al2->getClassIndex () 
+                     || getIdentity () < al1->getIdentity_min ()
+                     || stxType. size () <= 1;
+  operonType =    getA () -> frameshift
+                || getB () -> frameshift
+                  ? "FRAMESHIFT"
+                  :    getA () -> stopCodon 
+                    || getB () -> stopCodon 
+                    ? "INTERNAL_STOP"
+                    :    getA () -> truncated () 
+                      || getB () -> truncated ()
+                      ? "PARTIAL_CONTIG_END"
+                      : partial ()
+                        ? "PARTIAL"  
+                        :    getA () -> getExtended ()
+                          || getB () -> getExtended ()
+                          ? "EXTENDED"
+                          : novel
+                            ? standard + "_NOVEL"
+                            : standard;
+  if (! verboseP)
+  {
+    ASSERT (stxType. size () <= 2);
+    if (operonType == standard)
+      { ASSERT (stxType. size () == 2); }
+    else
+      if (stxType. size () == 2)
+        stxType. erase (1);  
+  }
+  stxType_reported = stxS + stxType;
+}
+
+
+
+StxRecord Operon::getRecord () const
+{
+  ASSERT (al1);
+  StxRecord r;
+  getReported (false, r. stxType, r. operon);
+  r. contig = al1->targetName;
+  r. start  = al1->targetStart + 1;
+  r. stop   = (al2 ? al2 : al1) -> targetEnd;
+  r. strand = al1->targetStrand;
+  auto setSubunit = [] (StxRecord::Subunit &sub, const BlastAlignment* al)
+    { sub. reference = al->refAccession;
+      sub. subtype   = al->subClass;
+      sub. identity  = al->getIdentity ()    * 100.0;
+      sub. coverage  = al->getRelCoverage () * 100.0;
+    };
+  if (al2)
+  {
+    r. identity = getIdentity () * 100.0;
+    setSubunit (r. A, getA ());
+    setSubunit (r. B, getB ());
+  }
+  else
+    setSubunit (al1->subunit == 'A' ? r. A : r. B, al1);
+  return r;
+}
+
+
+
+void Operon::saveTsvOut (TsvOut& td,
+                         bool verboseP,
+                         const ReportFormat &format) const
+{
+  ASSERT (al1);
+  if (! td. live ())
+    return;
+  if (al2)
+  {
+    string stxType_reported;
+    string operonType;
+    getReported (verboseP, stxType_reported, operonType);
+    const string targetName (al1->targetName);
+    const size_t start = al1->targetStart + 1;
+    const size_t stop  = al2->targetEnd;
+    const char strand (al1->targetStrand ? '+' : '-');
+    const double refIdentity = getIdentity () * 100.0;
+    // td
+    if (! format. name. empty ())
+      td << format. name;
+    if (format. amrfinder)
+    {
+      const string genesymbol (al1->stxType == al2->stxType ? stxS + string (al1->stxType) : stxType_reported);
+      string subclass (stxType_reported /*genesymbol*/);
+      strUpper (subclass);
+      const size_t targetAlign = al2->targetEnd - al1->targetStart;
+    //const size_t refLen = al1->refLen + al2->refLen;
+    //const double refCoverage = double (al1->getAbsCoverage () + al2->getAbsCoverage ()) / double (refLen) * 100.0;
+      const size_t alignmentLen = al1->length + al2->length;
+      const string refAccessions (string (al1->refAccession) + ", " + string (al2->refAccession));
+      const string fam (al1->getGenesymbol () + ", " + al2->getGenesymbol ());
+      td << na                // 1 "Protein identifier"  
+         << targetName        // 2 "Contig id"
+         << start             // 3 "Start"
+         << stop              // 4 "Stop"
+         << strand            // 5 "Strand"
+         << stxType_reported + "_operon"  // 6 "Element symbol"
+         << stxType_reported_operon2elementName (stxType_reported, operonType)    // 7 "Element name"
+         << "plus"            // 8 "Scope"
+         << "VIRULENCE"       // 9 "Element type"
+         << "STX_TYPE"        //10 "Element subtype"
+         << subclass. substr (0, 4)   //11 "Class"
+         << subclass          //12 "Subclass"
+         << operonType        //13 "Method"  
+         << targetAlign       //14 "Target length" 
+         << noString /*refLen*/  //15 "Reference sequence length"
+         << noString /*refCoverage*/  //16 "% Coverage of reference sequence"
+         << refIdentity       //17 "% Identity to reference sequence"
+         << alignmentLen      //18 "Alignment length"
+         << refAccessions     //19 "Accession of closest sequence"
+         << "Shiga toxin " + genesymbol //20 "Name of closest sequence"
+         << na                //21 "HMM id"
+         << na                //22 "HMM description"
+         ;
+      if (format. print_node)
+        td << fam;
+    }
+    else
+      td << targetName
+         << stxType_reported
+         << operonType
+         << refIdentity
+         << start
+         << stop
+         << strand
+         // Approximately if frameshift
+         << getA () -> refAccession
+         << getA () -> subClass
+         << getA () -> getIdentity () * 100.0
+         << getA () -> getRelCoverage () * 100.0
+         << getB () -> refAccession
+         << getB () -> subClass
+         << getB () -> getIdentity () * 100.0
+         << getB () -> getRelCoverage () * 100.0
+         ;
+    td. newLn ();
+  }
+  else
+    al1->saveTsvOut (td, verboseP, format);
+}
+
+
+
+string Operon::getStxType (bool verboseP) const
+{
+  if (! al2)
+    return string (al1->stxType);
+  if (al1->getClassIndex () != al2->getClassIndex ())
+  {
+  //return al1->stxClass + "/" + al2->stxClass;  ??  // order alphabetically
+    if (al1->stxSuperClass == al2->stxSuperClass)
+      return string (al1->stxSuperClass);  
+    return noString;
+  }
+  if (al1->stxClass != "2")
+    return string (al1->stxType); 
+  const string a (getA () -> refMap (319 + 1));
+  const string b (getB () -> refMap ( 89 + 1));
+  if (   (a [312] == 'F' || a [312] == 'S')
+      && (a [318] == 'K' || a [318] == 'E')
+      && b [34] == 'D'
+     )
+    return "2a";
+  if (    a [312] == 'F'
+      && (a [318] == 'K' || a [318] == 'E')
+      && b [34] == 'N'
+     )
+    return "2c";
+  if (   a [312] == 'S'
+      && a [318] == 'E'
+      && b [34] == 'N'
+     )
+    return "2d";
+  if (verboseP)
+    return string ("2 ") + a [312] + a [318] + b [34];
+  return "2";
+}
+
+
+
+bool Operon::operator< (const Operon &other) const
+{
+  LESS_PART (*this, other, al1->targetIndex);
+  LESS_PART (other, *this, getIdentity ());
+  LESS_PART (*this, other, hasAl2 ());
+  LESS_PART (*this, other, al1->refIndex);
+  LESS_PART (*this, other, hasAl2 ());
+  LESS_PART (*this, other, getRefIndex2 ());
+  return false;
+}
+
+
+
+bool Operon::reportLess (const Operon &a,
+                         const Operon &b)
+{
+  LESS_PART (a, b, al1->targetIndex);
+  LESS_PART (a, b, al1->targetStart);
+  LESS_PART (a, b, al1->targetEnd);
+  LESS_PART (b, a, al1->targetStrand);
+  LESS_PART (a, b, al1->refIndex);
+  LESS_PART (a, b, hasAl2 ());
+  LESS_PART (a, b, getRefIndex2 ());
+  return false;
+}
+
+
+
+void goodBlasts2operons (const VectorPtr<BlastAlignment> &goodBlastAls, 
+                         Vector<Operon> &operons, 
+                         bool sameType,
+                         bool strong,
+                         TsvOut &logTd)
+{
+  IMPLY (sameType, strong);
+  
+  LOG ("\nGood blasts:");
+  
+  size_t lenA_max = 0;
+  for (const BlastAlignment* al : goodBlastAls)
+    if (al->subunit == 'A')
+      maximize (lenA_max, al->targetEnd - al->targetStart);
+  const size_t intergenic = intergenic_max * (strong ? 1 : 2);  // PAR  // PD-4897
+
+  size_t start = 0;
+  size_t stop = 0;
+    // goodBlastAls[start,stop): subunit A alignments of the group of alB sorted by targetStart
+  size_t stopStart = no_index;
+    // start for stop
+  FFOR (size_t, i, goodBlastAls. size ())
+  {
+    const BlastAlignment* alB = goodBlastAls [i];
+    ASSERT (alB);
+    if (alB->reported)
+      continue;
+    if (logTd. live ())
+      alB->saveTsvOut (logTd, true);
+    if (alB->subunit != 'B')
+      continue;
+    while (   start < i 
+           && ! (   goodBlastAls [start] -> targetIndex  == alB->targetIndex
+                 && goodBlastAls [start] -> targetStrand == alB->targetStrand
+                 && (   ! sameType 
+                     || goodBlastAls [start] -> getClassIndex () == alB->getClassIndex ()
+                    )
+                )
+          )
+      start++;
+    if (start != stopStart)
+    {
+      stopStart = start;
+      stop = start;
+      while (stop < i && goodBlastAls [stop] -> subunit == 'A')
+        stop++;
+    }
+    // alA->targetStart range
+    size_t lo = 0;
+    size_t hi = 0;
+    if (alB->targetStrand)
+    {
+      lo = alB->targetStart > intergenic + lenA_max ? alB->targetStart - intergenic - lenA_max : 0;
+      hi = alB->targetStart;
+    }
+    else
+    {
+      lo = alB->targetEnd;
+      hi = alB->targetEnd + intergenic;
+    }
+    const auto startLess = [] (const BlastAlignment* al, size_t pos) { return al->targetStart < pos; };
+    FOR_START (size_t, j, (size_t) (lower_bound (goodBlastAls. begin () + (long) start, goodBlastAls. begin () + (long) stop, lo, startLess) - goodBlastAls. begin ()), stop)
+    {
+      const BlastAlignment* alA = goodBlastAls [j];
+      ASSERT (alA);
+      if (alA->targetStart > hi)
+        break; 
+      if (alA->reported)
+        continue;
+      ASSERT (alA->targetIndex  == alB->targetIndex);
+      ASSERT (alA->targetStrand == alB->targetStrand);
+      IMPLY (sameType, alA->getClassIndex () == alB->getClassIndex ());
+      ASSERT (alA->subunit == 'A');
+      const BlastAlignment* al1 = alA;
+      const BlastAlignment* al2 = alB;
+      if (! al1->targetStrand)
+        swap (al1, al2);
+      if (   al1->targetEnd <= al2->targetStart  
+          && al2->targetStart - al1->targetEnd <= intergenic
+         )
+      {
+        Operon op (*al1, *al2);
+        TRACE (2, "Operon:\t" << op. al1->targetName << '\t' << op. al1->targetStart << '\t' << op. getIdentity () << '\t' << op. al1->getIdentity_min ());
+        if (logTd. live ())
+          op. saveTsvOut (logTd, true);  
+        if (   ! strong 
+            || (   op. getIdentity () >= op. al1->getIdentity_min ()
+                && op. getIdentity () >= op. al2->getIdentity_min ()
+               )
+           )
+        {
+          operons << std::move (op);
+          var_cast (al1) -> reported = true;
+          var_cast (al2) -> reported = true;
+        }
+      }
+    }
+  }
+  
+  LOG ("# Operons: " + to_string (operons. size ()));
+  LOG ("\nSuppress goodBlastAls by operons");
+
+  map<pair<size_t,bool>/*targetIndex,targetStrand*/, Operon::CoverIndex> operonIndexes;
+  {
+    map<pair<size_t,bool>, vector<size_t>> starts;
+    for (const Operon& op : operons)
+      starts [op. getGroup ()]. push_back (op. al1->targetStart);
+    for (auto& it : starts)
+      operonIndexes. emplace (it. first, Operon::CoverIndex (std::move (it. second)));
+    for (const Operon& op : operons)
+    {
+      ASSERT (op. al2);
+      operonIndexes. at (op. getGroup ()). add (op. al1->targetStart, op. al2->targetEnd);
+    }
+  }
+  for (const BlastAlignment* al : goodBlastAls)
+  {
+    ASSERT (al);
+    if (al->reported)
+      continue;
+    const auto it = operonIndexes. find (make_pair (al->targetIndex, al->targetStrand));
+    if (   it != operonIndexes. end ()
+        && it->second. dominated (al->targetStart + slack, al->targetEnd > slack ? al->targetEnd - slack : 0)
+       )
+      var_cast (al) -> reported = true;
+  }
+}
+
+
+
+void mergeFrameshifts (VectorPtr<BlastAlignment> &blastAls,
+                       TsvOut &logTd)
+{
+  LOG ("Finding frame shifts:");
+  {
+    // Multiple frame shifts are possible
+    blastAls. sort (BlastAlignment::frameshiftLess); 
+    const BlastAlignment* prev = nullptr;
+    for (const BlastAlignment* al : blastAls)
+    {        
+      ASSERT (al);
+      if (   prev
+          && al->targetIndex  == prev->targetIndex
+          && al->targetStrand == prev->targetStrand
+          && al->refIndex     == prev->refIndex
+          && al->targetStart  >  prev->targetStart
+          && (int) al->targetStart - (int) prev->targetEnd < 10  // PAR
+          && al->getFrame () != prev->getFrame ()
+         )
+      {
+        var_cast (al) -> merge (*prev);
+        al->qc ();
+        var_cast (prev) -> reported = true;
+      }
+      if (logTd. live ())
+        al->saveTsvOut (logTd, true);
+      prev = al;
+    }
+  }
+}
+
+
+
+VectorPtr<BlastAlignment> selectGoodBlasts (VectorPtr<BlastAlignment> &blastAls,
+                                            TsvOut &logTd)
+{
+  LOG ("All blasts:");
+  VectorPtr<BlastAlignment> goodBlastAls;   
+  {
+    blastAls. sort (BlastAlignment::sameTypeLess);
+    const auto sameGroup = [] (const BlastAlignment* a, const BlastAlignment* b)
+      { return    a->targetIndex      == b->targetIndex
+               && a->targetStrand     == b->targetStrand
+               && a->getClassIndex () == b->getClassIndex ()
+               && a->subunit          == b->subunit;
+      };
+    unique_ptr<BlastAlignment::InsideIndex> index;
+      // Of the alignments of the group of blastAls[i]
+    FFOR (size_t, i, blastAls. size ())
+    {
+      const BlastAlignment* al = blastAls [i];
+      ASSERT (al);
+      if (al->reported)
+        break; 
+      if (! i || ! sameGroup (blastAls [i - 1], al))
+      {
+        vector<size_t> ends;
+        for (size_t j = i; j < blastAls. size () && ! blastAls [j] -> reported && sameGroup (blastAls [j], al); j++)
+          ends. push_back (blastAls [j] -> targetEnd);
+        index. reset (new BlastAlignment::InsideIndex (std::move (ends)));
+      }
+      if (logTd. live ())
+        al->saveTsvOut (logTd, true);
+      if (! index->dominated (al->targetEnd, al->getDiff ()))
+        goodBlastAls << al;
+      index->add (al->targetEnd, al->getDiff ());
+    }
+  }
+  
+  return goodBlastAls;
+}
+
+
+
+void selectGoodOperons (Vector<Operon> &operons,
+                        Vector<Operon> &goodOperons,
+                        TsvOut &logTd)
+{
+  LOG ("\ngoodOperons");
+  {    
+    operons. sort ();
+    // A goodOp preceding op in operons[] has goodOp.getIdentity() >= op.getIdentity() if they are on the same contig
+    map<pair<size_t,bool>, Operon::CoverIndex> goodIndexes;
+    {
+      map<pair<size_t,bool>, vector<size_t>> starts;
+      for (const Operon& op : operons)
+        starts [op. getGroup ()]. push_back (op. al1->targetStart);
+      for (auto& it : starts)
+        goodIndexes. emplace (it. first, Operon::CoverIndex (std::move (it. second)));
+    }
+    for (const Operon& op : operons)
+    {
+   	  if (logTd. live ())
+   	    op. saveTsvOut (logTd, true); 
+     	op. qc ();     
+      Operon::CoverIndex& goodIndex = goodIndexes. at (op. getGroup ());
+      if (! goodIndex. dominated (op. al1->targetStart + slack, op. al2->targetEnd > slack ? op. al2->targetEnd - slack : 0))
+      {
+        goodOperons << op;          
+        goodIndex. add (op. al1->targetStart, op. al2->targetEnd);
+      }
+    }      
+  }
+}
+
+
+
+void singleSubunitOperons (VectorPtr<BlastAlignment> &goodBlastAls,
+                           Vector<Operon> &goodOperons,
+                           TsvOut &logTd)
+{
+  // De-redundify single-subunit operons
+  {
+    const auto sameGroup = [] (const BlastAlignment* a, const BlastAlignment* b)
+      { return    a->targetIndex  == b->targetIndex
+               && a->targetStrand == b->targetStrand
+               && a->subunit      == b->subunit;
+      };
+    unique_ptr<BlastAlignment::InsideIndex> index;
+      // Of the alignments of the group of goodBlastAls[i]
+    FFOR (size_t, i, goodBlastAls. size ())
+    {
+      const BlastAlignment* al = goodBlastAls [i];
+      ASSERT (al);
+      if (! i || ! sameGroup (goodBlastAls [i - 1], al))
+      {
+        vector<size_t> ends;
+        for (size_t j = i; j < goodBlastAls. size () && sameGroup (goodBlastAls [j], al); j++)
+          ends. push_back (goodBlastAls [j] -> targetEnd);
+        index. reset (new BlastAlignment::InsideIndex (std::move (ends)));
+      }
+      if (! al->reported)
+      {
+        if (logTd. live ())
+          al->saveTsvOut (logTd, true);
+        if (index->dominated (al->targetEnd, al->getDiff ()))
+          var_cast (al) -> reported = true;
+      }
+      index->add (al->targetEnd, al->getDiff ());
+    }
+  }
+
+  LOG ("\ngoodBlastAls -> goodOperons (single-subunit)");
+  goodBlastAls. sort (BlastAlignment::reportLess); 
+  {
+    Vector<size_t> byStart;
+      // Indexes of goodBlastAls[] of the same targetIndex and targetStrand as goodBlastAls[i], sorted by targetStart
+    FFOR (size_t, i, goodBlastAls. size ())
+    {
+      const BlastAlignment* al1 = goodBlastAls [i];
+      ASSERT (al1);
+      if (   ! i 
+          || ! (   goodBlastAls [i - 1] -> targetIndex  == al1->targetIndex
+                && goodBlastAls [i - 1] -> targetStrand == al1->targetStrand
+               )
+         )
+      {
+        byStart. clear ();
+        for (size_t j = i; j < goodBlastAls. size () && goodBlastAls [j] -> targetIndex == al1->targetIndex && goodBlastAls [j] -> targetStrand == al1->targetStrand; j++)
+          byStart << j;
+        std::sort (byStart. begin (), byStart. end (), [&goodBlastAls] (size_t a, size_t b) { return goodBlastAls [a] -> targetStart < goodBlastAls [b] -> targetStart; });
+      }
+      if (al1->reported)
+        continue;
+      Operon op (*al1);
+      goodOperons << std::move (op);
+      for (auto it = lower_bound (byStart. begin (), byStart. end (), al1->targetStart, [&goodBlastAls] (size_t j, size_t pos) { return goodBlastAls [j] -> targetStart < pos; });
+           it != byStart. end ();
+           it++
+          )
+      {
+        const size_t j = *it;
+        const BlastAlignment* al2 = goodBlastAls [j];
+        ASSERT (al2);          
+        if (al2->targetStart >= al1->targetEnd)
+          break;
+        if (   j > i
+            && ! al2->reported
+            && al2->insideEq (*al1)
+            && (   al2->stxType [0] == al1->stxType [0] 
+                || al2->getDiff () >= al1->getDiff ()
+              //|| al1->getIdentity () >= al2->getIdentity ()
+               )
+           )
+          var_cast (al2) -> reported = true;
+      }
+    }
+  }
+}
+
+
+
+void blastAls2operons (VectorPtr<BlastAlignment> blastAls,
+                       Vector<Operon> &goodOperons,
+                       TsvOut &logTd)
+{
+  mergeFrameshifts (blastAls, logTd);
+  
+  VectorPtr<BlastAlignment> goodBlastAls (selectGoodBlasts (blastAls, logTd));
+  
+  Vector<Operon> operons;
+
+  LOG ("\nSame type operons:");
+  goodBlasts2operons (goodBlastAls, operons, true, true, logTd);
+  
+  goodBlastAls. sort (BlastAlignment::less);
+
+  LOG ("\nStrong operons:");
+  goodBlasts2operons (goodBlastAls, operons, false, true, logTd);
+
+  LOG ("\nWeak operons:");
+  goodBlasts2operons (goodBlastAls, operons, false, false, logTd);
+
+  selectGoodOperons (operons, goodOperons, logTd);
+
+  singleSubunitOperons (goodBlastAls, goodOperons, logTd);
+}
+
+
+
+void groups2operons (size_t from,
+                     size_t to,
+                     Vector<Operon> &goodOperons,
+                     const Vector<VectorPtr<BlastAlignment>> &groups)
+// For arrayThreads()
+{
+  TsvOut noLogTd (nullptr);
+  FOR_START (size_t, i, from, to)
+    blastAls2operons (groups [i], goodOperons, noLogTd);
+}
+
+
+
+// PrescreenWindow
+
+size_t PrescreenWindow::index (string_view name)
+{
+  const string_view prefix (namePrefix);
+  if (name. substr (0, prefix. size ()) != prefix)
+    throw runtime_error ("Not a prescreen window name: " + strQuote (string (name)));
+  const size_t num = str2<size_t> (string (name. substr (prefix. size ())));
+  if (! num)
+    throw runtime_error ("Not a prescreen window name: " + strQuote (string (name)));
+  return num - 1;
+}
+
+
+
+// Prescreen
+
+Prescreen::Prescreen (const string &protFName)
+: kmers ((size_t) mask + 1, false)
+{
+  aa2num. fill (-1);
+  {
+    const string aas ("ACDEFGHIKLMNPQRSTVWY");
+    ASSERT (aas. size () <= (1 << bits));
+    FFOR (size_t, i, aas. size ())
+    {
+      aa2num [(uchar) aas [i]]            = (int) i;
+      aa2num [(uchar) toLower (aas [i])]  = (int) i;
+    }
+  }
+  nuc2num. fill (-1);
+  {
+    const string nucs ("TCAG");
+    FFOR (size_t, i, nucs. size ())
+    {
+      nuc2num [(uchar) nucs [i]]           = (int) i;
+      nuc2num [(uchar) toLower (nucs [i])] = (int) i;
+    }
+  }
+  
+  string seq;
+  auto processSeq = [this, &seq] ()
+    {
+      uint32_t code = 0;
+      size_t valid = 0;
+      FFOR (size_t, i, seq. size ())
+      {
+        const int a = aa2num [(uchar) seq [i]];
+        if (a == -1)
+        {
+          valid = 0;
+          continue;
+        }
+        code = ((code << bits) | (uint32_t) a) & mask;
+        valid++;
+        if (valid >= k)
+        {
+          QC_ASSERT (i <= numeric_limits<uint16_t>::max ());
+          kmer2refPos << pair<uint32_t,uint16_t> (code, (uint16_t) i);
+          kmers [code] = true;
+        }
+      }
+      seq. clear ();
+    };
+  LineInput f (protFName);
+  while (f. nextLine ())
+    if (isLeft (f. line, ">"))
+      processSeq ();
+    else
+      seq += f. line;
+  processSeq ();
+  kmer2refPos. sort ();
+  kmer2refPos. uniq ();
+  QC_ASSERT (! kmer2refPos. empty ());
+}
+
+
+
+void Prescreen::processSeq (const string &id,
+                            string_view seq,
+                            Vector<PrescreenWindow> &windows) const
+{
+  const Vector<Pair<size_t>> ranges (getRanges (seq));
+  if (ranges. empty ())
+    return;
+  if (seq. find ('-') != string_view::npos)
+  {
+    // BLAST coordinates may ignore '-'
+    windows << PrescreenWindow {id, 0, seq. size (), 0};
+    return;
+  }
+  for (const Pair<size_t>& range : ranges)
+  {
+    ASSERT (range. first < range. second);
+    windows << PrescreenWindow {id, range. first, range. second - range. first, seq. size ()};
+  }
+}
+
+
+
+Vector<Pair<size_t>> Prescreen::getRanges (string_view seq) const
+{
+  const size_t len = seq. size ();
+  Vector<Pair<size_t>> seeds;
+  if (len < 3 * k)
+    return seeds;
+    
+  static const string codon2aa ("FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG");  // genetic code 11, TCAG order
+  ASSERT (codon2aa. size () == 64);
+
+  vector<int> nucs (len);
+  for (const bool strand : {true, false})
+  {
+    // nucs[]
+    FFOR (size_t, i, len)
+      if (strand)
+        nucs [i] = nuc2num [(uchar) seq [i]];
+      else
+      {
+        const int n = nuc2num [(uchar) seq [len - 1 - i]];
+        nucs [i] = n == -1 ? -1 : (n ^ 2);  // Complement: T <-> A, C <-> G
+      }
+    FFOR (size_t, frame, 3)
+    {
+      unordered_map<long,size_t> diag2last;
+      uint32_t code = 0;
+      size_t valid = 0;
+      size_t j = 0;  // aa
+      for (size_t p = frame; p + 3 <= len; p += 3, j++)
+      {
+        if (nucs [p] == -1 || nucs [p + 1] == -1 || nucs [p + 2] == -1)
+        {
+          valid = 0;
+          continue;
+        }
+        const int a = aa2num [(uchar) codon2aa [(size_t) (nucs [p] * 16 + nucs [p + 1] * 4 + nucs [p + 2])]];
+        if (a == -1)
+        {
+          valid = 0;
+          continue;
+        }
+        code = ((code << bits) | (uint32_t) a) & mask;
+        valid++;
+        if (valid < k || ! kmers [code])
+          continue;
+        const auto it_end = kmer2refPos. end ();
+        for (auto it = lower_bound (kmer2refPos. begin (), it_end, pair<uint32_t,uint16_t> (code, 0)); it != it_end && it->first == code; it++)
+        {
+          const long diag = (long) j - (long) it->second;
+          auto lastIt = diag2last. find (diag);
+          if (lastIt == diag2last. end ())
+          {
+            diag2last [diag] = j;
+            continue;
+          }
+          const size_t last = lastIt->second;
+          ASSERT (last <= j);
+          if (j - last < k)  // Overlapping hits
+            continue;
+          if (j - last <= window)
+          {
+            const size_t start = frame + 3 * (last + 1 - k);
+            const size_t end   = frame + 3 * (j + 1);
+            ASSERT (start < end);
+            ASSERT (end <= len);
+            if (strand)
+              seeds << Pair<size_t> (start, end);
+            else
+              seeds << Pair<size_t> (len - end, len - start);
+          }
+          lastIt->second = j;
+        }
+      }
+    }
+  }
+  
+  Vector<Pair<size_t>> ranges;
+  if (seeds. empty ())
+    return ranges;
+  seeds. sort ();
+  for (const Pair<size_t>& seed : seeds)
+  {
+    const size_t start = seed. first > flank ? seed. first - flank : 0;
+    const size_t end   = min (seed. second + flank, len);
+    if (! ranges. empty () && start <= ranges. back (). second)
+      maximize (ranges. back (). second, end);
+    else
+      ranges << Pair<size_t> (start, end);
+  }
+  
+  return ranges;
+}
+
+
+
+// ReadAssembly
+
+namespace
+{
+
+const string nucs ("ACGT");
+  // Codes of ReadAssembly k-mers, complement = 3 - code
+
+int nuc2code (char c)
+{
+  switch (c)
+  {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+  }
+  return -1;
+}
+
+}
+
+
+
+void ReadAssembly::addRead (const string &seq)
+{
+  reads++;
+  uint64_t fwd = 0;
+  uint64_t rev = 0;
+  size_t valid = 0;
+  for (const char c : seq)
+  {
+    const int n = nuc2code (c);
+    if (n == -1)
+    {
+      valid = 0;
+      continue;
+    }
+    fwd = ((fwd << 2) | (uint64_t) n) & mask;
+    rev = (rev >> 2) | ((uint64_t) (3 - n) << (2 * (k - 1)));
+    valid++;
+    if (valid >= k)
+      kmer2count [min (fwd, rev)] ++;
+  }
+}
+
+
+
+uint64_t ReadAssembly::canonical (uint64_t kmer)
+{
+  uint64_t rev = 0;
+  uint64_t fwd = kmer;
+  FFOR (size_t, i, k)
+  {
+    rev = (rev << 2) | (3 - (fwd & 3));
+    fwd >>= 2;
+  }
+  return min (kmer, rev);
+}
+
+
+
+uint32_t ReadAssembly::getCount (uint64_t kmer) const
+{
+  const auto it = kmer2count. find (canonical (kmer));
+  if (it == kmer2count. end () || it->second < count_min)
+    return 0;
+  return it->second;
+}
+
+
+
+string ReadAssembly::extend (uint64_t kmer,
+                             bool right,
+                             unordered_set<uint64_t> &used) const
+{
+  string s;
+  for (;;)
+  {
+    uint32_t count_best = 0;
+    uint64_t next_best = 0;
+    int n_best = -1;
+    FFOR (int, n, 4)
+    {
+      const uint64_t next = right
+                              ? ((kmer << 2) | (uint64_t) n) & mask
+                              : (kmer >> 2) | ((uint64_t) n << (2 * (k - 1)));
+      const uint32_t count = getCount (next);
+      if (count > count_best)
+      {
+        count_best = count;
+        next_best = next;
+        n_best = n;
+      }
+    }
+    if (n_best == -1)
+      break;
+    if (! used. insert (canonical (next_best)). second)
+      break;  // Cycle or another contig
+    s += nucs [(size_t) n_best];
+    kmer = next_best;
+  }
+  return s;
+}
+
+
+
+StringVector ReadAssembly::getContigs () const
+{
+  Vector<pair<uint32_t,uint64_t>> seeds;
+  for (const auto& it : kmer2count)
+    if (it. second >= count_min)
+      seeds << pair<uint32_t,uint64_t> (it. second, it. first);
+  // Deterministic order
+  seeds. sort ([] (const pair<uint32_t,uint64_t> &a, const pair<uint32_t,uint64_t> &b) 
+                 { if (a. first != b. first)
+                     return a. first > b. first;
+                   return a. second < b. second;
+                 });
+
+  StringVector contigs;
+  unordered_set<uint64_t> used;
+  for (const auto& seed : seeds)
+  {
+    if (! used. insert (seed. second). second)
+      continue;
+    string contig (k, ' ');
+    {
+      uint64_t kmer = seed. second;
+      FFOR (size_t, i, k)
+      {
+        contig [k - 1 - i] = nucs [kmer & 3];
+        kmer >>= 2;
+      }
+    }
+    string left (extend (seed. second, false, used));
+    reverse (left);
+    contig = left + contig + extend (seed. second, true, used);
+    if (contig. size () >= contigLen_min)
+      contigs << std::move (contig);
+  }
+  return contigs;
+}
+
+
+
+// NativeSearch
+
+bool NativeSearch::KmerPos::operator< (const KmerPos &other) const
+{
+  LESS_PART (*this, other, code);
+  LESS_PART (*this, other, ref);
+  return pos < other. pos;
+}
+
+
+
+bool NativeSearch::Seed::operator< (const Seed &other) const
+{
+  LESS_PART (*this, other, ref);
+  LESS_PART (*this, other, start);
+  return end < other. end;
+}
+
+
+
+string NativeSearch::Hit::toCache () const
+{
+  const size_t pos = line. find ('\t');
+  ASSERT (pos != string::npos);
+  return to_string (score) + '\t' + to_string (ref) + line. substr (pos);
+}
+
+
+
+bool NativeSearch::Hit::operator< (const Hit &other) const
+{
+  LESS_PART (*this, other, ref);
+  LESS_PART (other, *this, score);
+  return line < other. line;
+}
+
+
+
+const string NativeSearch::aas ("ARNDCQEGHILKMFPSTWYVBZX*");
+
+
+
+const int NativeSearch::blosum62 [24] [24] =
+  {
+  // A   R   N   D   C   Q   E   G   H   I   L   K   M   F   P   S   T   W   Y   V   B   Z   X   *
+    { 4, -1, -2, -2,  0, -1, -1,  0, -2, -1, -1, -1, -1, -2, -1,  1,  0, -3, -2,  0, -2, -1,  0, -4},  // A
+    {-1,  5,  0, -2, -3,  1,  0, -2,  0, -3, -2,  2, -1, -3, -2, -1, -1, -3, -2, -3, -1,  0, -1, -4},  // R
+    {-2,  0,  6,  1, -3,  0,  0,  0,  1, -3, -3,  0, -2, -3, -2,  1,  0, -4, -2, -3,  3,  0, -1, -4},  // N
+    {-2, -2,  1,  6, -3,  0,  2, -1, -1, -3, -4, -1, -3, -3, -1,  0, -1, -4, -3, -3,  4,  1, -1, -4},  // D
+    { 0, -3, -3, -3,  9, -3, -4, -3, -3, -1, -1, -3, -1, -2, -3, -1, -1, -2, -2, -1, -3, -3, -2, -4},  // C
+    {-1,  1,  0,  0, -3,  5,  2, -2,  0, -3, -2,  1,  0, -3, -1,  0, -1, -2, -1, -2,  0,  3, -1, -4},  // Q
+    {-1,  0,  0,  2, -4,  2,  5, -2,  0, -3, -3,  1, -2, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},  // E
+    { 0, -2,  0, -1, -3, -2, -2,  6, -2, -4, -4, -2, -3, -3, -2,  0, -2, -2, -3, -3, -1, -2, -1, -4},  // G
+    {-2,  0,  1, -1, -3,  0,  0, -2,  8, -3, -3, -1, -2, -1, -2, -1, -2, -2,  2, -3,  0,  0, -1, -4},  // H
+    {-1, -3, -3, -3, -1, -3, -3, -4, -3,  4,  2, -3,  1,  0, -3, -2, -1, -3, -1,  3, -3, -3, -1, -4},  // I
+    {-1, -2, -3, -4, -1, -2, -3, -4, -3,  2,  4, -2,  2,  0, -3, -2, -1, -2, -1,  1, -4, -3, -1, -4},  // L
+    {-1,  2,  0, -1, -3,  1,  1, -2, -1, -3, -2,  5, -1, -3, -1,  0, -1, -3, -2, -2,  0,  1, -1, -4},  // K
+    {-1, -1, -2, -3, -1,  0, -2, -3, -2,  1,  2, -1,  5,  0, -2, -1, -1, -1, -1,  1, -3, -1, -1, -4},  // M
+    {-2, -3, -3, -3, -2, -3, -3, -3, -1,  0,  0, -3,  0,  6, -4, -2, -2,  1,  3, -1, -3, -3, -1, -4},  // F
+    {-1, -2, -2, -1, -3, -1, -1, -2, -2, -3, -3, -1, -2, -4,  7, -1, -1, -4, -3, -2, -2, -1, -2, -4},  // P
+    { 1, -1,  1,  0, -1,  0,  0,  0, -1, -2, -2,  0, -1, -2, -1,  4,  1, -3, -2, -2,  0,  0,  0, -4},  // S
+    { 0, -1,  0, -1, -1, -1, -1, -2, -2, -1, -1, -1, -1, -2, -1,  1,  5, -2, -2,  0, -1, -1,  0, -4},  // T
+    {-3, -3, -4, -4, -2, -2, -3, -2, -2, -3, -2, -3, -1,  1, -4, -3, -2, 11,  2, -3, -4, -3, -2, -4},  // W
+    {-2, -2, -2, -3, -2, -1, -2, -3,  2, -1, -1, -2, -1,  3, -3, -2, -2,  2,  7, -1, -3, -2, -1, -4},  // Y
+    { 0, -3, -3, -3, -1, -2, -2, -3, -3,  3,  1, -2,  1, -1, -2, -2,  0, -3, -1,  4, -3, -2, -1, -4},  // V
+    {-2, -1,  3,  4, -3,  0,  1, -1,  0, -3, -4,  0, -3, -3, -2,  0, -1, -4, -3, -3,  4,  1, -1, -4},  // B
+    {-1,  0,  0,  1, -3,  3,  4, -2,  0, -3, -3,  1, -1, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},  // Z
+    { 0, -1, -1, -1, -2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -2,  0,  0, -2, -1, -1, -1, -1, -1, -4},  // X
+    {-4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,  1}   // *
+  };
+
+
+
+NativeSearch::NativeSearch (const string &protFName)
+: kmers ((size_t) mask + 1, false)
+{
+  ASSERT (aas. size () == 24);
+  ASSERT (kmerAas <= (1 << bits));
+  
+  aa2num. fill ((uchar) aas. find ('X'));
+  FFOR (size_t, i, aas. size ())
+  {
+    aa2num [(uchar) aas [i]]           = (uchar) i;
+    aa2num [(uchar) toLower (aas [i])] = (uchar) i;
+  }
+
+  nuc2mask. fill (0);
+  {
+    const string iupac ("ACGTRYSWKMBDHVN");
+    const array<uchar,15> masks {{1, 2, 4, 8, 1|4, 2|8, 2|4, 1|8, 4|8, 1|2, 2|4|8, 1|4|8, 1|2|8, 1|2|4, 1|2|4|8}};
+    FFOR (size_t, i, iupac. size ())
+    {
+      nuc2mask [(uchar) iupac [i]]           = masks [i];
+      nuc2mask [(uchar) toLower (iupac [i])] = masks [i];
+    }
+  }
+  
+  // codon2aa[]: an ambiguous codon is translated if all its nucleotide sequences are translated into the same amino acid
+  {
+    const string standard ("FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG");  // TCAG order
+    const array<size_t,4> acgt2tcag {{2, 1, 3, 0}};
+    FFOR (size_t, m1, 16)
+    FFOR (size_t, m2, 16)
+    FFOR (size_t, m3, 16)
+    {
+      char aa = '\0';
+      FFOR (size_t, b1, 4)
+      FFOR (size_t, b2, 4)
+      FFOR (size_t, b3, 4)
+        if (   (m1 & (1 << b1))
+            && (m2 & (1 << b2))
+            && (m3 & (1 << b3))
+           )
+        {
+          const char c = standard [acgt2tcag [b1] * 16 + acgt2tcag [b2] * 4 + acgt2tcag [b3]];
+          if (! aa)
+            aa = c;
+          else if (aa != c)
+            aa = 'X';
+        }
+      codon2aa [(m1 << 8) | (m2 << 4) | m3] = aa ? aa : 'X';
+    }
+  }
+
+  // refs
+  {
+    LineInput f (protFName);
+    while (f. nextLine ())
+    {
+      trimTrailing (f. line);
+      if (f. line. empty ())
+        continue;
+      if (f. line [0] == '>')
+      {
+        refs << Ref ();
+        size_t pos = 1;
+        while (pos < f. line. size () && ! isspace (f. line [pos]))
+          pos++;
+        refs. back (). id = f. line. substr (1, pos - 1);
+        QC_ASSERT (! refs. back (). id. empty ());
+      }
+      else
+      {
+        QC_ASSERT (! refs. empty ());
+        refs. back (). seq += f. line;
+      }
+    }
+  }
+  QC_ASSERT (! refs. empty ());
+  QC_ASSERT (refs. size () <= numeric_limits<uint16_t>::max ());
+
+  FFOR (size_t, r, refs. size ())
+  {
+    Ref& ref = refs [r];
+    QC_ASSERT (! ref. seq. empty ());
+    QC_ASSERT (ref. seq. size () <= numeric_limits<uint16_t>::max ());
+    uint32_t code = 0;
+    size_t valid = 0;
+    FFOR (size_t, i, ref. seq. size ())
+    {
+      const uchar a = aa2num [(uchar) ref. seq [i]];
+      ref. nums << a;
+      if (a >= kmerAas)
+      {
+        valid = 0;
+        continue;
+      }
+      code = ((code << bits) | a) & mask;
+      valid++;
+      if (valid >= k)
+      {
+        kmer2refPos << KmerPos {code, (uint16_t) r, (uint16_t) i};
+        kmers [code] = true;
+      }
+    }
+  }
+  kmer2refPos. sort ();
+  QC_ASSERT (! kmer2refPos. empty ());
+}
+
+
+
+string NativeSearch::parameters ()
+{
+  return "k=" + to_string (k)
+         + " window=" + to_string (window)
+         + " margin=" + to_string (margin)
+         + " alignLen_min=" + to_string (alignLen_min)
+         + " score_min=" + to_string (score_min)
+         + " gap=" + to_string (gapOpen) + '/' + to_string (gapExtend)
+         + " lambda=" + toString (lambda)
+         + " K=" + toString (K)
+         + " alpha=" + toString (alpha)
+         + " beta=" + toString (beta);
+}
+
+
+
+void NativeSearch::search (const string &id,
+                           const string &seq,
+                           Vector<Hit> &hits) const
+{
+  const size_t len = seq. size ();
+  if (len < 3 * k)
+    return;
+    
+  string prot;
+  Vector<uchar> masks (len, 0);
+  for (const bool strand : {true, false})
+  {
+    FFOR (size_t, i, len)
+      if (strand)
+        masks [i] = nuc2mask [(uchar) seq [i]];
+      else
+      {
+        // Complement: reversed bits of ACGT
+        const uchar m = nuc2mask [(uchar) seq [len - 1 - i]];
+        masks [i] = uchar (((m & 1) << 3) | ((m & 2) << 1) | ((m & 4) >> 1) | ((m & 8) >> 3));
+      }
+    FFOR (size_t, frame, 3)
+    {
+      prot. clear ();
+      for (size_t p = frame; p + 3 <= len; p += 3)
+        prot += codon2aa [((size_t) masks [p] << 8) | ((size_t) masks [p + 1] << 4) | masks [p + 2]];
+        
+      // Seeds
+      unordered_map<long,size_t> diagRef2last;
+        // Key: diagonal * refs.size() + ref
+      Vector<Seed> seeds;
+      {
+        uint32_t code = 0;
+        size_t valid = 0;
+        FFOR (size_t, j, prot. size ())
+        {
+          const uchar a = aa2num [(uchar) prot [j]];
+          if (a >= kmerAas)
+          {
+            valid = 0;
+            continue;
+          }
+          code = ((code << bits) | a) & mask;
+          valid++;
+          if (valid < k || ! kmers [code])
+            continue;
+          const auto it_end = kmer2refPos. end ();
+          for (auto it = lower_bound (kmer2refPos. begin (), it_end, KmerPos {code, 0, 0}); it != it_end && it->code == code; it++)
+          {
+            const long diag = (long) j - (long) it->pos;
+            const long key = diag * (long) refs. size () + it->ref;
+            auto lastIt = diagRef2last. find (key);
+            if (lastIt == diagRef2last. end ())
+            {
+              diagRef2last [key] = j;
+              continue;
+            }
+            const size_t last = lastIt->second;
+            ASSERT (last <= j);
+            if (j - last < k)  // Overlapping hits
+              continue;
+            if (j - last <= window)
+            {
+              // The reference placed on the diagonal
+              const long start = diag - (long) margin;
+              const long end   = diag + (long) (refs [it->ref]. seq. size () + margin);
+              seeds << Seed {it->ref, (size_t) max (start, 0L), (size_t) min (end, (long) prot. size ()), diag, diag};
+            }
+            lastIt->second = j;
+          }
+        }
+      }
+      if (seeds. empty ())
+        continue;
+      
+      // Merged ranges of each reference
+      seeds. sort ();
+      size_t i = 0;
+      while (i < seeds. size ())
+      {
+        Seed range (seeds [i]);
+        i++;
+        while (   i < seeds. size () 
+               && seeds [i]. ref == range. ref
+               && seeds [i]. start <= range. end
+              )
+        {
+          maximize (range. end,     seeds [i]. end);
+          minimize (range. diagMin, seeds [i]. diagMin);
+          maximize (range. diagMax, seeds [i]. diagMax);
+          i++;
+        }
+        align (range, prot, range. start, range. end, id, len, strand, frame, hits);
+      }
+    }
+  }
+}
+
+
+
+namespace
+{
+
+// 8 lanes of 16 bits, compiled to SSE2 or NEON
+typedef short Shorts __attribute__ ((vector_size (16)));
+constexpr size_t shortsLanes = sizeof (Shorts) / sizeof (short);
+
+inline Shorts shortsLoad (const short* p)
+  { Shorts v;  memcpy (& v, p, sizeof (v));  return v; }
+
+inline void shortsStore (short* p,
+                         Shorts v)
+  { memcpy (p, & v, sizeof (v)); }
+
+inline Shorts shortsSplat (int x)
+  { Shorts v;  FFOR (size_t, lane, shortsLanes)  v [lane] = (short) x;  return v; }
+
+inline Shorts shortsMax (Shorts a,
+                         Shorts b)
+  { return a > b ? a : b; }
+
+template <int n>
+  inline Shorts shortsShift (Shorts v)
+    // Return: v moved by n lanes to the higher lanes, the lower n lanes are 0
+  {
+    static_assert (n > 0 && n < (int) shortsLanes);
+    const Shorts zero {};
+  #ifdef __clang__
+    return __builtin_shufflevector (v, zero, 0 >= n ? 0 - n : 8, 1 >= n ? 1 - n : 8, 2 >= n ? 2 - n : 8, 3 >= n ? 3 - n : 8,
+                                             4 >= n ? 4 - n : 8, 5 >= n ? 5 - n : 8, 6 >= n ? 6 - n : 8, 7 >= n ? 7 - n : 8);
+  #else
+    const Shorts index {0 >= n ? 0 - n : 8, 1 >= n ? 1 - n : 8, 2 >= n ? 2 - n : 8, 3 >= n ? 3 - n : 8,
+                        4 >= n ? 4 - n : 8, 5 >= n ? 5 - n : 8, 6 >= n ? 6 - n : 8, 7 >= n ? 7 - n : 8};
+    return __builtin_shuffle (v, zero, index);
+  #endif
+  }
+
+inline Shorts shortsLast (Shorts v)
+  // Return: all lanes are the highest lane of v
+  {
+  #ifdef __clang__
+    return __builtin_shufflevector (v, v, 7, 7, 7, 7, 7, 7, 7, 7);
+  #else
+    const Shorts index {7, 7, 7, 7, 7, 7, 7, 7};
+    return __builtin_shuffle (v, index);
+  #endif
+  }
+
+constexpr int blosum62_max = 11;
+  // Of NativeSearch::blosum62[][]
+
+}
+
+
+
+void NativeSearch::align (const Seed &seed,
+                          const string &prot,
+                          size_t start,
+                          size_t end,
+                          const string &id,
+                          size_t seqLen,
+                          bool strand,
+                          size_t frame,
+                          Vector<Hit> &hits) const
+{
+  ASSERT (start <= end);
+  ASSERT (end <= prot. size ());
+  
+  const size_t n = end - start;
+  if (n < alignLen_min)
+    return;
+  const Ref& ref = refs [seed. ref];
+  const size_t m = ref. nums. size ();
+  // Band: j - i in [bandMin, bandMax]
+  const long bandMin = seed. diagMin - (long) margin - (long) start;
+  const long bandMax = seed. diagMax + (long) margin - (long) start;
+  
+  vector<uchar> target (n, 0);
+  FFOR (size_t, j, n)
+    target [j] = aa2num [(uchar) prot [start + j]];
+  vector<short> tb;
+  size_t tbWidth = 0;
+  size_t best_i = 0;
+  size_t best_j = 0;
+  const int best = fillBand (ref, target. data (), n, bandMin, bandMax, tb, tbWidth, best_i, best_j);
+  if (best < score_min)
+    return;
+    
+  // Traceback
+  string refAlign;
+  string targetAlign;
+  size_t i = best_i;
+  size_t j = best_j;
+  uchar state = 1;  // 1 - H, 2 - E, 3 - F
+  for (;;)
+  {
+    const long k = (long) j - (long) i - bandMin;
+    const short t = k >= 0 && k < (long) tbWidth ? tb [i * tbWidth + (size_t) k] : 0;
+    if (state == 1)
+    {
+      const uchar src = uchar (t & 3);
+      if (! src)
+        break;
+      if (src == 1)
+      {
+        ASSERT (i);
+        ASSERT (j);
+        refAlign    += ref. seq [i - 1];
+        targetAlign += prot [start + j - 1];
+        i--;
+        j--;
+      }
+      else
+        state = src;
+    }
+    else if (state == 2)
+    {
+      ASSERT (j);
+      refAlign    += '-';
+      targetAlign += prot [start + j - 1];
+      if (! (t & 4))
+        state = 1;
+      j--;
+    }
+    else
+    {
+      ASSERT (state == 3);
+      ASSERT (i);
+      refAlign    += ref. seq [i - 1];
+      targetAlign += '-';
+      if (! (t & 8))
+        state = 1;
+      i--;
+    }
+  }
+  ASSERT (i < best_i);
+  ASSERT (j < best_j);
+  reverse (refAlign. begin (), refAlign. end ());
+  reverse (targetAlign. begin (), targetAlign. end ());
+  
+  // prot[alStart,alEnd)
+  const size_t alStart = start + j;
+  const size_t alEnd   = start + best_j;
+  size_t targetStart = frame + 3 * alStart + 1;
+  size_t targetEnd   = frame + 3 * alEnd;
+  if (! strand)
+  {
+    targetStart = seqLen - (targetStart - 1);
+    targetEnd   = seqLen - targetEnd + 1;
+  }
+  
+  Hit hit;
+  hit. ref = seed. ref;
+  hit. score = best;
+  hit. line =         id 
+              + '\t' + ref. id
+              + '\t' + to_string (targetStart)
+              + '\t' + to_string (targetEnd)
+              + '\t' + to_string (seqLen)
+              + '\t' + to_string (i + 1)
+              + '\t' + to_string (best_i)
+              + '\t' + to_string (m)
+              + '\t' + targetAlign
+              + '\t' + refAlign;
+  hits << std::move (hit);
+
+  align (seed, prot, start, alStart, id, seqLen, strand, frame, hits);
+  align (seed, prot, alEnd,  end,    id, seqLen, strand, frame, hits);
+}
+
+
+
+int NativeSearch::fillBand (const Ref &ref,
+                            const uchar* target,
+                            size_t n,
+                            long bandMin,
+                            long bandMax,
+                            vector<short> &tb,
+                            size_t &tbWidth,
+                            size_t &best_i,
+                            size_t &best_j)
+{
+  // Row i: cell k is j = i + bandMin + k
+  // E along a row is a prefix maximum:
+  //   E(k) = max_{l < k} (H(l) - gapOpen - gapExtend * (k - l)), where H(l) can be without E(l) since gapOpen > 0,
+  //   G(k) = E(k) + gapExtend * k = max (G(k - 1), U(k)), U(k) = H_noE(k - 1) - gapOpen - gapExtend + gapExtend * k;
+  //   E is extended iff G(k - 1) >= U(k)
+  static_assert (gapOpen > 0);
+  const size_t m = ref. nums. size ();
+  const long bandWidth = bandMax - bandMin + 1;
+  ASSERT (bandWidth > 0);
+  tbWidth = ((size_t) bandWidth + shortsLanes - 1) / shortsLanes * shortsLanes;
+  constexpr short minusInf = numeric_limits<short>::min () / 2;
+  if ((long) m * blosum62_max + (long) tbWidth * gapExtend >= numeric_limits<short>::max () / 2)
+    return fillBand_scalar (ref, target, n, bandMin, bandMax, tb, tbWidth, best_i, best_j);
+
+  tb. assign ((m + 1) * tbWidth, 0);
+  // profile[a * profileLen + pad + j]: blosum62[a][target[j]], 0 outside target[]
+  const size_t pad = tbWidth + shortsLanes;
+  const size_t profileLen = n + 2 * pad;
+  vector<short> profile (24 * profileLen, 0);
+  FFOR (size_t, a, 24)
+    FFOR (size_t, j, n)
+      profile [a * profileLen + pad + j] = (short) blosum62 [a] [target [j]];
+  // Of the previous row until overwritten, the trailing vector is outside the band
+  vector<short> H (tbWidth + shortsLanes, 0);
+  vector<short> F (tbWidth + shortsLanes, minusInf);
+    // Gap in the target
+  // Inner loop without the index checks of Vector
+  short* H_ = H. data ();
+  short* F_ = F. data ();
+
+  Shorts iota;
+  FFOR (size_t, lane, shortsLanes)
+    iota [lane] = (short) lane;
+  Shorts lane0 {};
+  lane0 [0] = -1;
+  const Shorts zero {};
+  const Shorts minusInf_ = shortsSplat (minusInf);
+  const Shorts gapOpenExtend_ = shortsSplat (gapOpen + gapExtend);
+  const Shorts gapExtend_ = shortsSplat (gapExtend);
+  const Shorts one   = shortsSplat (1);
+  const Shorts two   = shortsSplat (2);
+  const Shorts three = shortsSplat (3);
+  // minusInf in the lanes shifted in by shortsShift()
+  const Shorts shifted1 = iota < 1 ? minusInf_ : zero;
+  const Shorts shifted2 = iota < 2 ? minusInf_ : zero;
+  const Shorts shifted4 = iota < 4 ? minusInf_ : zero;
+
+  int best = 0;
+  best_i = 0;
+  best_j = 0;
+  FOR_START (size_t, i, 1, m + 1)
+  {
+    const long jBase = (long) i + bandMin;
+    // Cells with j in [1, n]
+    const long kLo = max (1 - jBase, 0L);
+    const long kHi = min ((long) n - jBase, bandWidth - 1);
+    if (kLo > kHi)
+    {
+      fill (H. begin (), H. begin () + (long) tbWidth, 0);
+      fill (F. begin (), F. begin () + (long) tbWidth, minusInf);
+      continue;
+    }
+    const short* score = & profile [ref. nums [i - 1] * profileLen + (size_t) ((long) pad + jBase - 1)];
+    short* tb_ = & tb [i * tbWidth];
+    const Shorts kLo_ = shortsSplat ((int) kLo);
+    const Shorts kHi_ = shortsSplat ((int) kHi);
+    Shorts hLast = zero;
+      // H without E of the last cell of the previous vector
+    Shorts gLast = minusInf_;
+    Shorts hMax = zero;
+    for (size_t k = 0; k < tbWidth; k += shortsLanes)
+    {
+      const Shorts kv = iota + (short) k;
+      const Shorts valid = (kv >= kLo_) & (kv <= kHi_);
+      // F
+      const Shorts fOpen = shortsLoad (H_ + k + 1) - gapOpenExtend_;
+      const Shorts fExt  = shortsLoad (F_ + k + 1) - gapExtend_;
+      const Shorts fExtP = fExt >= fOpen;
+      const Shorts f = valid ? (fExtP ? fExt : fOpen) : minusInf_;
+      // H without E
+      const Shorts diag = shortsLoad (H_ + k) + shortsLoad (score + k);
+      const Shorts hNoE = valid ? shortsMax (shortsMax (diag, f), zero) : zero;
+      // E
+      const Shorts u = shortsShift<1> (hNoE) + (hLast & lane0) - gapOpenExtend_ + kv * gapExtend_;
+      hLast = shortsLast (hNoE);
+      Shorts g = shortsMax (u, shortsShift<1> (u) + shifted1);
+      g = shortsMax (g, shortsShift<2> (g) + shifted2);
+      g = shortsMax (g, shortsShift<4> (g) + shifted4);
+      g = shortsMax (g, gLast);
+      const Shorts eExtP = shortsShift<1> (g) + (gLast & lane0) >= u;
+      gLast = shortsLast (g);
+      const Shorts e = g - kv * gapExtend_;
+      // H
+      const Shorts eP = e > diag;
+      Shorts h   = eP ? e : diag;
+      Shorts src = eP ? two : one;
+      const Shorts fP = f > h;
+      h   = fP ? f : h;
+      src = fP ? three : src;
+      const Shorts zeroP = (h <= zero) | ~ valid;
+      h   = zeroP ? zero : h;
+      src = zeroP ? zero : src;
+      shortsStore (F_ + k, f);
+      shortsStore (H_ + k, h);
+      shortsStore (tb_ + k, ((eExtP & 4) | (fExtP & 8) | src) & valid);
+      hMax = shortsMax (hMax, h);
+    }
+    short h_max = 0;
+    FFOR (size_t, lane, shortsLanes)
+      h_max = max (h_max, hMax [lane]);
+    if (h_max > best)
+    {
+      long k = kLo;
+      while (H_ [k] != h_max)
+        k++;
+      best = h_max;
+      best_i = i;
+      best_j = (size_t) (jBase + k);
+    }
+  }
+
+  return best;
+}
+
+
+
+int NativeSearch::fillBand_scalar (const Ref &ref,
+                                   const uchar* target,
+                                   size_t n,
+                                   long bandMin,
+                                   long bandMax,
+                                   vector<short> &tb,
+                                   size_t tbWidth,
+                                   size_t &best_i,
+                                   size_t &best_j)
+{
+  constexpr int minusInf = numeric_limits<int>::min () / 2;
+  vector<int> H_prev (n + 1, 0);
+  vector<int> H_cur  (n + 1, 0);
+  vector<int> F      (n + 1, minusInf);
+    // Gap in the target
+  tb. assign ((ref. nums. size () + 1) * tbWidth, 0);
+  // Inner loop without the index checks of Vector
+  const uchar* target_ = target;
+  int* F_ = F. data ();
+  int best = 0;
+  best_i = 0;
+  best_j = 0;
+  FOR_START (size_t, i, 1, ref. nums. size () + 1)
+  {
+    const int* row = blosum62 [ref. nums [i - 1]];
+    int E = minusInf;
+      // Gap in the reference
+    const int* H_prev_ = H_prev. data ();
+    int* H_cur_ = H_cur. data ();
+    short* tb_ = & tb [i * tbWidth];
+      // Index: j - jBase
+    const long jBase = (long) i + bandMin;
+    const long jLo = max ((long) i + bandMin, 1L);
+    const long jHi = min ((long) i + bandMax, (long) n);
+    if (jLo <= jHi)
+      H_cur_ [jLo - 1] = 0;
+    for (long j = jLo; j <= jHi; j++)
+    {
+      // Without branches
+      // E
+      const int eOpen = H_cur_ [j - 1] - gapOpen - gapExtend;
+      const int eExt  = E - gapExtend;
+      const bool eExtP = eExt >= eOpen;
+      E = eExtP ? eExt : eOpen;
+      // F
+      const int fOpen = H_prev_ [j] - gapOpen - gapExtend;
+      const int fExt  = F_ [j] - gapExtend;
+      const bool fExtP = fExt >= fOpen;
+      const int f = fExtP ? fExt : fOpen;
+      F_ [j] = f;
+      // H
+      const int diag = H_prev_ [j - 1] + row [target_ [j - 1]];
+      const bool eP = E > diag;
+      int h   = eP ? E : diag;
+      int src = eP ? 2 : 1;
+      const bool fP = f > h;
+      h   = fP ? f : h;
+      src = fP ? 3 : src;
+      const bool zeroP = h <= 0;
+      h   = zeroP ? 0 : h;
+      src = zeroP ? 0 : src;
+      const uchar t = uchar ((eExtP << 2) | (fExtP << 3));
+      H_cur_ [j] = h;
+      tb_ [j - jBase] = short (t | src);
+      if (h > best)
+      {
+        best = h;
+        best_i = i;
+        best_j = (size_t) j;
+      }
+    }
+    swap (H_prev, H_cur);
+  }
+
+  return best;
+}
+
+
+
+StringVector NativeSearch::finish (Vector<Hit> &&hits,
+                                   size_t dbLen,
+                                   size_t dbSeqs,
+                                   double evalue_max) const
+{
+  Vector<double> searchSpaces;  searchSpaces. reserve (refs. size ());
+  for (const Ref& ref : refs)
+    searchSpaces << getSearchSpace (ref. seq. size (), dbLen, dbSeqs);
+  
+  hits. sort ();
+  StringVector lines;  lines. reserve (hits. size ());
+  for (Hit& hit : hits)
+    if (getEvalue (hit. score, searchSpaces [hit. ref]) <= evalue_max)
+      lines << std::move (hit. line);
+    
+  return lines;
+}
+
+
+
+double NativeSearch::getSearchSpace (size_t queryLen,
+                                     size_t dbLen,
+                                     size_t dbSeqs)
+{
+  ASSERT (dbSeqs);
+  
+  const double n = (double) dbLen / 3.0;
+  const double N = (double) dbSeqs;
+  const double l = (double) getLengthAdjustment (queryLen, n, N);
+  return max (1.0, ((double) queryLen - l) * max (1.0, n - N * l));
+}
+
+
+
+size_t NativeSearch::getLengthAdjustment (size_t queryLen,
+                                          double n,
+                                          double N)
+{
+  constexpr size_t iter_max = 20;
+  const double m = (double) queryLen;
+  const double logK = log (K);
+  const double alpha_d_lambda = alpha / lambda;
+  
+  const double a = N;
+  const double mb = m * N + n;
+  const double c = n * m - max (m, n) / K;
+  if (c < 0)
+    return 0;
+  
+  double ell = 0;
+  double ell_min = 0;
+  double ell_max = 2 * c / (mb + sqrt (mb * mb - 4 * a * c));
+  bool converged = false;
+  FOR_START (size_t, i, 1, iter_max + 1)
+  {
+    const double ss = (m - ell) * (n - N * ell);
+    const double ell_bar = alpha_d_lambda * (logK + log (ss)) + beta;
+    if (ell_bar >= ell)
+    {
+      ell_min = ell;
+      if (ell_bar - ell_min <= 1.0)
+      {
+        converged = true;
+        break;
+      }
+      if (ell_min == ell_max)
+        break;
+    }
+    else
+      ell_max = ell;
+    if (ell_min <= ell_bar && ell_bar <= ell_max)
+      ell = ell_bar;
+    else
+      ell = i == 1 ? ell_max : (ell_min + ell_max) / 2;
+  }
+  
+  size_t res = (size_t) ell_min;
+  if (converged)
+  {
+    const double ell_ceil = ceil (ell_min);
+    if (ell_ceil <= ell_max)
+    {
+      const double ss = (m - ell_ceil) * (n - N * ell_ceil);
+      if (alpha_d_lambda * (logK + log (ss)) + beta >= ell_ceil)
+        res = (size_t) ell_ceil;
+    }
+  }
+  
+  return res;
+}
+
+
+
+// OperonTyping
+
+void OperonTyping::add (string_view line,
+                        const Vector<PrescreenWindow> &windows)
+{
+  alignments. emplace_back (line, arena, contigs);
+  BlastAlignment* al = & alignments. back ();
+  if (! windows. empty ())
+  {
+    const size_t i = PrescreenWindow::index (al->targetName);
+    QC_ASSERT (i < windows. size ());
+    const PrescreenWindow& w = windows [i];
+    al->targetName = contigs. intern (w. contig);
+    if (w. contigLen)
+    {
+      al->targetStart += w. offset;
+      al->targetEnd   += w. offset;
+      al->targetLen    = w. contigLen;
+    }
+  }
+  al->qc ();  
+  blastAls << al;
+}
+
+
+
+void OperonTyping::group ()
+{
+  contigs. index ();
+  for (BlastAlignment& al : alignments)
+    al. targetIndex = contigs [al. targetName];
+  
+  // Groups of blastAls[] with the same targetIndex and targetStrand are processed independently
+  blastAls. sort (BlastAlignment::frameshiftLess); 
+  groups. clear ();
+  for (const BlastAlignment* al : blastAls)
+  {
+    if (   groups. empty ()
+        || groups. back (). front () -> targetIndex  != al->targetIndex
+        || groups. back (). front () -> targetStrand != al->targetStrand
+       )
+      groups << VectorPtr<BlastAlignment> ();
+    groups. back () << al;
+  }
+}
+
+
+
+void OperonTyping::findOperons (TsvOut &logTd)
+{
+  goodOperons. clear ();
+  if (logTd. live ())
+    // LOG() and logTd are sequential
+    for (const VectorPtr<BlastAlignment>& group : groups)
+      blastAls2operons (group, goodOperons, logTd);
+  else
+  {
+    vector<Vector<Operon>> results;
+    arrayThreads (groups2operons, groups. size (), results, cref (groups));
+    for (const Vector<Operon>& res : results)
+      goodOperons << res;
+  }
+  goodOperons. sort (Operon::reportLess);     
+}
+
+
+
+// Typer
+
+Typer::Typer (const string &protFName)
+: prescreen (protFName)
+, native (protFName)
+{
+  checkStxRefs (protFName);
+}
+
+
+
+void Typer::addHits (Vector<NativeSearch::Hit> &&hits,
+                     const Vector<PrescreenWindow> &windows,
+                     size_t len,
+                     size_t seqs,
+                     OperonTyping &typing) const
+{
+  for (const string& line : native. finish (std::move (hits), len, seqs, 1e-10))
+  {
+    TRACE (3, line);
+    typing. add (line, windows);
+  }
+}
+
+
+
+void Typer::type (const Seqs &seqs,
+                  OperonTyping &typing) const
+{
+  {
+    // As stxtyper
+    FastaCheck fc;
+    fc. hyphen = true;
+    fc. ambig  = true;
+    fc. runSeqs (seqs, "assembly");
+  }
+
+  // As stxtyper --engine native
+  Vector<PrescreenWindow> windows;
+  Vector<NativeSearch::Hit> hits;
+  size_t len = 0;
+  for (const auto& it : seqs)
+  {
+    len += it. second. size ();
+    const size_t start = windows. size ();
+    prescreen. processSeq (string (it. first), it. second, windows);
+    FOR_START (size_t, i, start, windows. size ())
+    {
+      const PrescreenWindow& w = windows [i];
+      native. search (PrescreenWindow::name (i), string (it. second. substr (w. offset, w. len)), hits);
+    }
+  }
+  if (windows. empty ())
+    return;
+  addHits (std::move (hits), windows, len, seqs. size (), typing);
+  typing. group ();
+  TsvOut noLogTd (nullptr);
+  typing. findOperons (noLogTd);
+}
+
+
+
+Vector<StxRecord> Typer::type (const Seqs &seqs) const
+{
+  OperonTyping typing;
+  type (seqs, typing);
+  Vector<StxRecord> records;  records. reserve (typing. goodOperons. size ());
+  for (const Operon& op : typing. goodOperons)
+    records << op. getRecord ();
+  return records;
+}
+
+
+
+void Typer::saveTsvOut (const Seqs &seqs,
+                        const ReportFormat &format,
+                        TsvOut &td) const
+{
+  OperonTyping typing;
+  type (seqs, typing);
+  for (const Operon& op : typing. goodOperons)
+    op. saveTsvOut (td, false, format);
+}
+
+
+
+
+}  // namespace
+
+
+
@@ -0,0 +1,855 @@
+// stx.hpp
+
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+* Author: Vyacheslav Brover
+*
+* File Description:
+*   stx typing: reference proteins, alignments, operons, prescreen and the built-in search
+*
+*/
+
+
+#ifndef STX_HPP
+#define STX_HPP
+
+
+#include "common.hpp"
+#include "tsv.hpp"
+using namespace Common_sp;
+
+
+
+namespace Stx_sp
+{
+
+
+// PAR
+constexpr size_t intergenic_max {36};  // Max. intergenic region in the reference set + 2
+constexpr size_t slack = 30;
+
+extern const string stxS;
+extern const string na;
+
+
+
+struct StxClass
+{
+  string_view name;
+  double identity;
+    // Min. operon identity of a known type
+};
+
+inline constexpr StxClass stxClasses [] =
+  { {"1a", 0.983}
+  , {"1c", 0.983}
+  , {"1d", 0.983}
+  , {"1e", 0.983}
+  , {"2",  0.98}
+  , {"2b", 0.98}
+  , {"2e", 0.98}
+  , {"2f", 0.98}
+  , {"2g", 0.98}
+  , {"2h", 0.98}
+  , {"2i", 0.98}
+  , {"2j", 0.98}
+  , {"2k", 0.985}
+  , {"2l", 0.985}
+  , {"2m", 0.98}
+  , {"2n", 0.98}
+  , {"2o", 0.98}
+  };  // PAR
+
+
+constexpr bool stxClassesSorted ()
+{
+  for (size_t i = 1; i < size (stxClasses); i++)
+    if (! (stxClasses [i - 1]. name < stxClasses [i]. name))
+      return false;
+  return true;
+}
+static_assert (stxClassesSorted ());
+  // The order of class indexes is the order of class names
+
+
+constexpr size_t stxClassIndex (string_view name)
+{
+  for (size_t i = 0; i < size (stxClasses); i++)
+    if (stxClasses [i]. name == name)
+      return i;
+  throw logic_error ("Unknown Stx class");
+}
+
+
+
+struct StxRef
+// Protein of stx.prot
+{
+  string_view id;
+    // Sequence id in stx.prot
+  string_view accession;
+  char subunit;
+    // 'A' or 'B'
+  string_view stxType;
+  string_view stxClass;
+    // Function of stxType
+  string_view stxSuperClass;
+    // Function of stxClass
+  string_view subClass;
+    // = as in AMRFinderPlus report
+  size_t len;
+    // aa, with the ending '*'
+  size_t classIndex;
+    // Index of stxClasses[]
+};
+
+inline constexpr StxRef stxRefs [] =
+  {
+  #include "stx_ref.inc"
+    // Generated from stx.prot by Makefile
+  };
+
+
+constexpr bool stxRefsSorted ()
+{
+  for (size_t i = 1; i < size (stxRefs); i++)
+    if (! (   stxRefs [i - 1]. id        < stxRefs [i]. id
+           && stxRefs [i - 1]. accession < stxRefs [i]. accession
+          ))
+      return false;
+  return true;
+}
+static_assert (stxRefsSorted ());
+  // The order of reference indexes is the order of accessions
+
+
+
+size_t stxRefIndex (string_view id);
+// Return: index of stxRefs[]
+
+void checkStxRefs (const string &fName);
+// Requires: fName is the stx.prot which stxRefs[] is compiled from
+
+string stxType_reported_operon2elementName (const string &stxType_reported,
+                                            const string &operon);
+
+
+
+struct ReportFormat
+{
+  string name;
+    // !empty() => first column "name"
+  bool amrfinder {false};
+    // Nucleotide AMRFinderPlus format
+  bool print_node {false};
+    // AMRFinderPlus hierarchy node
+    // => amrfinder
+};
+
+void saveReportHeader (TsvOut &td,
+                       const ReportFormat &format,
+                       bool nameP);
+// Input: nameP: column "name"
+
+
+
+struct StxRecord
+// Row of the report in the stxtyper format
+{
+  string contig;
+  string stxType;
+  string operon;
+  double identity {NaN};
+    // %
+    // NaN <=> one subunit
+  size_t start {0};
+  size_t stop {0};
+    // 1-based
+  bool strand {true};
+    // false <=> negative
+  struct Subunit
+  {
+    string reference;
+      // Accession
+      // empty() <=> no subunit
+    string subtype;
+    double identity {NaN};
+    double coverage {NaN};
+      // %
+  };
+  Subunit A;
+  Subunit B;
+};
+
+
+
+struct StringArena
+// Strings are stored in large chunks which are never moved
+{
+private:
+  static constexpr size_t chunkSize {64 * 1024};  // PAR
+  vector<unique_ptr<char []>> chunks;
+  size_t capacity {0};
+  size_t used {0};
+    // In chunks.back()
+public:
+
+  string_view add (string_view s)
+    { if (used + s. size () > capacity)
+      { capacity = max (chunkSize, s. size ());
+        chunks. emplace_back (new char [capacity]);
+        used = 0;
+      }
+      char* p = chunks. back (). get () + used;
+      memcpy (p, s. data (), s. size ());
+      used += s. size ();
+      return string_view (p, s. size ());
+    }
+};
+
+
+
+struct ContigNames
+// Interned contig names
+{
+private:
+  map<string,size_t,less<>> name2index;
+public:
+
+  string_view intern (string_view name)
+    { auto it = name2index. find (name);
+      if (it == name2index. end ())
+        it = name2index. emplace (string (name), no_index). first;
+      return it->first;
+    }
+  void index ()
+    // Output: operator[] is the order of name
+    { size_t i = 0;
+      for (auto& it : name2index)
+        it. second = i++;
+    }
+  size_t operator[] (string_view name) const;
+};
+
+
+
+template <typename Key, typename Value, typename KeyLess = less<Key>, typename ValueLess = less<Value>>
+struct DominanceIndex
+// Points (key,value) with the keys known in advance
+// Query: is there an added point (key',value') such that key' <= key and value' >= value
+// Time: O(log n)
+{
+private:
+  vector<Key> keys;
+    // Sorted, unique
+  vector<Value> best;
+  vector<bool> present;
+    // Fenwick tree over keys[], 1-based: max. value
+public:
+
+  explicit DominanceIndex (vector<Key> &&keys_arg)
+    : keys (std::move (keys_arg))
+    { sort (keys. begin (), keys. end (), KeyLess ());
+      keys. erase (unique (keys. begin (), keys. end (), [] (const Key &a, const Key &b) { return ! KeyLess () (a, b) && ! KeyLess () (b, a); }), keys. end ());
+      best. resize (keys. size () + 1);
+      present. resize (keys. size () + 1, false);
+    }
+
+  void add (const Key &key,
+            const Value &value)
+    { size_t i = (size_t) (lower_bound (keys. begin (), keys. end (), key, KeyLess ()) - keys. begin ());
+      if (i >= keys. size ())
+        throw logic_error ("DominanceIndex: unknown key");
+      for (i++; i < best. size (); i += i & (~i + 1))
+        if (! present [i] || ValueLess () (best [i], value))
+        { best [i] = value;
+          present [i] = true;
+        }
+    }
+  bool dominated (const Key &key,
+                  const Value &value) const
+    { for (size_t i = (size_t) (upper_bound (keys. begin (), keys. end (), key, KeyLess ()) - keys. begin ()); i; i -= i & (~i + 1))
+        if (present [i] && ! ValueLess () (best [i], value))
+          return true;
+      return false;
+    }
+};
+
+
+
+struct BlastAlignment
+{
+  size_t length {0}, nident {0}  // aa
+       ,    refStart {0},    refEnd {0},    refLen {0}
+       , targetStart {0}, targetEnd {0}, targetLen {0};
+    // Positions are 0-based
+    // targetStart < targetEnd
+  bool stopCodon {false};
+  bool frameshift {false};
+
+  // target
+  string_view targetName;
+    // In ContigNames
+  size_t targetIndex {no_index};
+    // ContigNames::operator[](targetName)
+  string_view targetSeq;
+    // In StringArena
+  bool targetStrand {true};
+    // false <=> negative
+//size_t targetAlign {0};
+    // bp
+
+  // Reference
+  // Whole sequence ends with '*'
+  size_t refIndex {no_index};
+    // Index of stxRefs[]
+  string_view refAccession;
+  string_view refSeq;
+    // In StringArena
+  // Function of refIndex
+  string_view stxType;
+  string_view stxClass;
+  string_view stxSuperClass;
+  char subunit {'\0'};
+  string_view subClass;
+
+  bool reported {false};
+
+
+  BlastAlignment (string_view line,
+                  StringArena &arena,
+                  ContigNames &contigs);
+    // Input: line: tblastn -outfmt '6 sseqid qseqid sstart send slen qstart qend qlen sseq qseq',
+    //              the subject is the contig (target), the query is the reference protein
+  void qc () const;
+  void saveTsvOut (TsvOut& td,
+                   bool verboseP,
+                   const ReportFormat &format = ReportFormat ()) const;
+  void getReported (bool verboseP,
+                    string &stxType_reported,
+                    string &operon) const;
+    // Output: stx_type and operon columns of the report
+
+
+  string getGenesymbol () const
+    { return stxS + subunit + string (stxType); }
+  void merge (const BlastAlignment &prev);
+  size_t getFrame () const
+    { return (targetStart % 3) + 1; }
+  double getIdentity () const
+    { return (double) nident / (double) (length); }
+  size_t getClassIndex () const
+    { return stxRefs [refIndex]. classIndex; }
+  double getIdentity_min () const
+    { return stxClasses [stxRefs [refIndex]. classIndex]. identity; }
+  size_t getAbsCoverage () const
+    { return refEnd - refStart; }
+  double getRelCoverage () const
+    { return (double) getAbsCoverage () / (double) refLen; }
+  size_t getDiff () const
+    { return refStart + (refLen - refEnd) + (length - nident); }
+  bool truncated () const
+    { return    (targetStart           <= 3 /*Locus::end_delta*/ && ((targetStrand && refStart)            || (! targetStrand && refEnd + 1 < refLen)))
+             || (targetLen - targetEnd <= 3 /*Locus::end_delta*/ && ((targetStrand && refEnd + 1 < refLen) || (! targetStrand && refStart)));
+    }
+  bool otherTruncated () const
+    { constexpr size_t missed_max = intergenic_max + 3 * 20 /*min. domain length*/;  // PAR
+      return    (targetStrand == (subunit == 'B') && targetStart           <= missed_max)
+             || (targetStrand == (subunit == 'A') && targetLen - targetEnd <= missed_max);
+    }
+  bool getExtended () const;
+  bool insideEq (const BlastAlignment &other) const
+    { return    targetStart >= other. targetStart
+             && targetEnd   <= other. targetEnd;
+    }
+  string refMap (size_t len) const;
+  typedef  DominanceIndex<size_t,size_t,greater<size_t>,greater<size_t>>  InsideIndex;
+    // Key: targetEnd, value: getDiff()
+    // Query for *this after the added BlastAlignment's in the order of targetStart: insideEq() && getDiff() >= prev.getDiff()
+  static bool frameshiftLess (const BlastAlignment* a,
+                              const BlastAlignment* b);
+  static bool sameTypeLess (const BlastAlignment* a,
+                            const BlastAlignment* b);
+  static bool less (const BlastAlignment* a,
+                    const BlastAlignment* b);
+    // = sameTypeLess(), but without stxClass
+  static bool reportLess (const BlastAlignment* a,
+                          const BlastAlignment* b);
+};
+
+
+
+struct Operon
+{
+  const BlastAlignment* al1 {nullptr};
+    // !nullptr
+  const BlastAlignment* al2 {nullptr};
+  // al1->targetEnd < al2->targetStart
+
+
+  Operon () = default;
+  Operon (const BlastAlignment& al1_arg,
+          const BlastAlignment& al2_arg)
+    : al1 (& al1_arg)
+    , al2 (& al2_arg)
+    {}
+  explicit Operon (const BlastAlignment& al1_arg)
+    : al1 (& al1_arg)
+    {}
+  void qc () const;
+  void saveTsvOut (TsvOut& td,
+                   bool verboseP,
+                   const ReportFormat &format = ReportFormat ()) const;
+  void getReported (bool verboseP,
+                    string &stxType_reported,
+                    string &operonType) const;
+    // Output: stx_type and operon columns of the report
+  StxRecord getRecord () const;
+
+
+private:
+  const BlastAlignment* getA () const
+    { return al1->targetStrand ? al1 : al2; }
+  const BlastAlignment* getB () const
+    { return al1->targetStrand ? al2 : al1; }
+  bool hasAl2 () const
+    { return al2; }
+  size_t getRefIndex2 () const
+    { if (al2)
+        return al2->refIndex;
+      return no_index;
+    }
+  string getStxType (bool verboseP) const;
+  bool partial () const
+    { return    (getA () -> getRelCoverage () < 1.0 && ! getA () -> getExtended ())
+             || (getB () -> getRelCoverage () < 1.0 && ! getB () -> getExtended ());
+    }
+public:
+  double getIdentity () const
+    { return double (al1->nident + al2->nident) / double (al1->length/*refLen*/ + al2->length/*refLen*/); }
+  bool insideEq (const Operon &other) const
+    { return    al1->targetStrand        == other. al1->targetStrand
+    	       && al1->targetStart + slack >= other. al1->targetStart
+             && al2->targetEnd           <= other. al2->targetEnd + slack;
+    }
+  typedef  DominanceIndex<size_t,size_t>  CoverIndex;
+    // Key: al1->targetStart, value: al2->targetEnd
+    // For the Operon's of the same getGroup()
+  pair<size_t,bool> getGroup () const
+    { return make_pair (al1->targetIndex, al1->targetStrand); }
+  bool operator< (const Operon &other) const;
+  static bool reportLess (const Operon &a,
+                          const Operon &b);
+};
+
+
+
+// Stages of blastAls2operons()
+
+void mergeFrameshifts (VectorPtr<BlastAlignment> &blastAls,
+                       TsvOut &logTd);
+// Output: blastAls: sorted by BlastAlignment::frameshiftLess()
+
+VectorPtr<BlastAlignment> selectGoodBlasts (VectorPtr<BlastAlignment> &blastAls,
+                                            TsvOut &logTd);
+// Return: not reported blastAls which are not inside a better alignment of the same type and subunit, sorted by BlastAlignment::sameTypeLess()
+// Output: blastAls: sorted by BlastAlignment::sameTypeLess()
+
+void goodBlasts2operons (const VectorPtr<BlastAlignment> &goodBlastAls,
+                         Vector<Operon> &operons,
+                         bool sameType,
+                         bool strong,
+                         TsvOut &logTd);
+// Append: operons
+
+void selectGoodOperons (Vector<Operon> &operons,
+                        Vector<Operon> &goodOperons,
+                        TsvOut &logTd);
+// Append: goodOperons: operons not covered by a better operon
+// Output: operons: sorted
+
+void singleSubunitOperons (VectorPtr<BlastAlignment> &goodBlastAls,
+                           Vector<Operon> &goodOperons,
+                           TsvOut &logTd);
+// Append: goodOperons: single-subunit operons of the not reported goodBlastAls
+// Output: goodBlastAls: sorted by BlastAlignment::reportLess()
+
+void blastAls2operons (VectorPtr<BlastAlignment> blastAls,
+                       Vector<Operon> &goodOperons,
+                       TsvOut &logTd);
+// Input: blastAls: of the same targetIndex and targetStrand
+// Update: goodOperons: reported operons are appended
+
+void groups2operons (size_t from,
+                     size_t to,
+                     Vector<Operon> &goodOperons,
+                     const Vector<VectorPtr<BlastAlignment>> &groups);
+// For arrayThreads()
+
+
+
+// Prescreen
+
+struct PrescreenWindow
+// Part of a contig searched by BLAST
+{
+  string contig;
+  size_t offset {0};
+  size_t len {0};
+  size_t contigLen {0};
+    // 0 <=> the whole contig with the coordinates of BLAST
+
+  static constexpr const char* namePrefix {"window_"};
+  static string name (size_t index)
+    { return namePrefix + to_string (index + 1); }
+    // Return: BLAST sequence name of the window
+    // Input: index: in the vector of windows
+  static size_t index (string_view name);
+    // Inverse of name()
+    // Throws: if name is not a window name
+};
+
+
+
+struct Prescreen
+// Translated contigs are matched against the k-mers of the reference proteins.
+// A seed is two non-overlapping k-mer hits on the same diagonal, like the BLAST two-hit method
+{
+  // PAR
+  static constexpr size_t k {5};
+  static constexpr size_t window {40};  // aa
+  static constexpr size_t flank {3000};  // bp, > 2 * operon length
+private:
+  static constexpr size_t bits {5};  // per amino acid
+  static constexpr uint32_t mask {((uint32_t) 1 << (bits * k)) - 1};
+  array<int,256> aa2num;
+    // -1 <=> not a standard amino acid
+  array<int,256> nuc2num;
+    // TCAG order; -1 <=> ambiguous
+  vector<bool> kmers;
+    // Index: k-mer code
+  Vector<pair<uint32_t,uint16_t>> kmer2refPos;
+    // refPos: end of the k-mer in a reference protein
+    // Sorted, unique
+public:
+
+
+  explicit Prescreen (const string &protFName);
+
+
+  void processSeq (const string &id,
+                   string_view seq,
+                   Vector<PrescreenWindow> &windows) const;
+  // Append: windows
+  bool hasSeed (string_view seq) const
+    { return ! getRanges (seq). empty (); }
+private:
+  Vector<Pair<size_t>> getRanges (string_view seq) const;
+  // Return: merged ranges [start,end) of seq with flanks around the seeds
+};
+
+
+
+
+// ReadAssembly
+
+struct ReadAssembly
+// Local assembly of the reads recruited by Prescreen, instead of a genome assembly.
+// Greedy extension in the de Bruijn graph of the reads: a contig is extended by the most frequent next k-mer,
+//   low-frequency k-mers of sequencing errors are ignored.
+// Both strands are used
+{
+  // PAR
+  static constexpr size_t k {31};
+  static constexpr uint32_t count_min {2};  // of a k-mer
+  static constexpr size_t contigLen_min {100};  // bp
+private:
+  static constexpr uint64_t mask {((uint64_t) 1 << (2 * k)) - 1};
+  unordered_map<uint64_t,uint32_t> kmer2count;
+    // Key: canonical k-mer
+public:
+  size_t reads {0};
+
+
+  void addRead (const string &seq);
+  StringVector getContigs () const;
+    // Return: each k-mer is in one contig, in the order of decreasing frequency of the most frequent k-mer
+private:
+  uint32_t getCount (uint64_t kmer) const;
+    // Return: 0 if < count_min
+  static uint64_t canonical (uint64_t kmer);
+  string extend (uint64_t kmer,
+                 bool right,
+                 unordered_set<uint64_t> &used) const;
+    // Return: nucleotides added to the right end of kmer, or to the left end in the reverse order
+    // Update: used: canonical k-mers
+};
+
+
+
+// NativeSearch
+
+struct NativeSearch
+// Search of the reference proteins in the six-frame translations of nucleotide sequences, instead of tblastn:
+//   a seed is two non-overlapping exact k-mer hits on the same diagonal of a reference protein,
+//   an alignment is local (Smith-Waterman-Gotoh) with BLOSUM62 and the gap cost of tblastn: 11 + <gap length>
+// Alignments are printed as by tblastn -outfmt '6 sseqid qseqid sstart send slen qstart qend qlen sseq qseq'
+// Genetic code 11
+{
+  // PAR
+  static constexpr size_t k {5};
+  static constexpr size_t window {40};  // aa
+  static constexpr size_t margin {50};  // aa, around a reference placed on a seed diagonal
+  static constexpr size_t alignLen_min {10};  // aa
+  static constexpr int score_min {30};
+  static constexpr int gapOpen {11};
+  static constexpr int gapExtend {1};
+  // Karlin-Altschul parameters of BLOSUM62 with gap costs 11/1
+  static constexpr double lambda {0.267};
+  static constexpr double K {0.041};
+  static constexpr double alpha {1.9};
+  static constexpr double beta {-30.0};
+private:
+  static constexpr size_t bits {5};  // per amino acid
+  static constexpr uint32_t mask {((uint32_t) 1 << (bits * k)) - 1};
+  static constexpr size_t kmerAas {20};
+  static const string aas;
+    // BLOSUM62 order, k-mers consist of the first kmerAas amino acids
+  static const int blosum62 [24] [24];
+  array<uchar,256> aa2num;
+    // Index of aas
+  array<uchar,256> nuc2mask;
+    // IUPAC nucleotide -> bits of ACGT
+  array<char,4096> codon2aa;
+    // Index: nuc2mask[] of 3 nucleotides
+
+  struct Ref
+  {
+    string id;
+      // tblastn qseqid
+    string seq;
+    Vector<uchar> nums;
+      // aa2num[seq[]]
+  };
+  Vector<Ref> refs;
+  vector<bool> kmers;
+    // Index: k-mer code
+  struct KmerPos
+  {
+    uint32_t code {0};
+    uint16_t ref {0};
+      // Index of refs
+    uint16_t pos {0};
+      // End of the k-mer in refs[ref].seq
+    bool operator< (const KmerPos &other) const;
+  };
+  Vector<KmerPos> kmer2refPos;
+    // Sorted
+  struct Seed
+  {
+    size_t ref {0};
+      // Index of refs
+    // Range in a translated sequence
+    size_t start {0};
+    size_t end {0};
+    long diagMin {0};
+    long diagMax {0};
+      // Diagonal = position in the translated sequence - position in the reference
+    bool operator< (const Seed &other) const;
+  };
+public:
+
+
+  struct Hit
+  {
+    string line;
+      // tblastn output line
+    size_t ref {0};
+      // Index of refs
+    int score {0};
+
+    Hit () = default;
+    Hit (const string &name,
+         string cacheLine)
+      // Input: cacheLine: toCache()
+      { score = str2<int>    (findSplit (cacheLine, '\t'));
+        ref   = str2<size_t> (findSplit (cacheLine, '\t'));
+        line = name + '\t' + cacheLine;
+      }
+    string toCache () const;
+      // Return: without the name of the nucleotide sequence
+    bool operator< (const Hit &other) const;
+  };
+
+
+  explicit NativeSearch (const string &protFName);
+  static string parameters ();
+    // Return: PAR, for cache keys
+
+
+  void search (const string &id,
+               const string &seq,
+               Vector<Hit> &hits) const;
+    // Append: hits
+  StringVector finish (Vector<Hit> &&hits,
+                       size_t dbLen,
+                       size_t dbSeqs,
+                       double evalue_max) const;
+    // Return: lines of hits with E-value <= evalue_max, in the order of refs
+    // Input: dbLen: total length of the nucleotide sequences
+    //        dbSeqs: number of the nucleotide sequences
+  static double getSearchSpace (size_t queryLen,
+                                size_t dbLen,
+                                size_t dbSeqs);
+    // Return: effective search space of a query protein, as tblastn for a translated database
+    // Input: dbLen, dbSeqs: as in finish()
+  static double getEvalue (int score,
+                           double searchSpace)
+    { return K * searchSpace * exp (- lambda * score); }
+private:
+  void align (const Seed &seed,
+              const string &prot,
+              size_t start,
+              size_t end,
+              const string &id,
+              size_t seqLen,
+              bool strand,
+              size_t frame,
+              Vector<Hit> &hits) const;
+    // Local alignment of refs[seed.ref] with prot[start,end) in the band of diagonals [seed.diagMin - margin, seed.diagMax + margin],
+    // recursively in the parts of prot outside the best alignment
+    // Append: hits
+  static int fillBand (const Ref &ref,
+                       const uchar* target,
+                       size_t n,
+                       long bandMin,
+                       long bandMax,
+                       vector<short> &tb,
+                       size_t &tbWidth,
+                       size_t &best_i,
+                       size_t &best_j);
+    // Smith-Waterman-Gotoh matrix of ref (i) and target[0,n) (j) in the band j - i in [bandMin, bandMax],
+    //   8 cells of a row at a time (SSE2, NEON)
+    // Return: best score
+    // Output: tb: traceback of cell (i,j) at i * tbWidth + j - i - bandMin, 0 outside the band:
+    //               bits 0-1: source of H: 0 - start, 1 - diagonal, 2 - E, 3 - F; bit 2: E is extended; bit 3: F is extended
+    //         best_i, best_j: the first cell with the best score in the row-major order
+  static int fillBand_scalar (const Ref &ref,
+                              const uchar* target,
+                              size_t n,
+                              long bandMin,
+                              long bandMax,
+                              vector<short> &tb,
+                              size_t tbWidth,
+                              size_t &best_i,
+                              size_t &best_j);
+    // Cell by cell, the same result as fillBand()
+    // For the scores which do not fit in 16 bits
+  static size_t getLengthAdjustment (size_t queryLen,
+                                     double dbLen,
+                                     double dbSeqs);
+    // As in BLAST: Blast_ComputeLengthAdjustment()
+};
+
+
+
+// Library API
+
+struct OperonTyping : Nocopy
+// BlastAlignment's of an assembly and their reported operons
+{
+  deque<BlastAlignment> alignments;
+  StringArena arena;
+  ContigNames contigs;
+  VectorPtr<BlastAlignment> blastAls;
+  Vector<VectorPtr<BlastAlignment>> groups;
+    // Of blastAls with the same targetIndex and targetStrand
+  Vector<Operon> goodOperons;
+    // Sorted by Operon::reportLess()
+
+
+  OperonTyping () = default;
+
+
+  void add (string_view line,
+            const Vector<PrescreenWindow> &windows);
+    // Input: line: tblastn -outfmt '6 sseqid qseqid sstart send slen qstart qend qlen sseq qseq'
+    //        windows: empty, or sseqid = PrescreenWindow::name(<index of windows>)
+  void group ();
+    // Output: groups
+    // Requires: all add()'s are done
+  void findOperons (TsvOut &logTd);
+    // Output: goodOperons
+    // Invokes: blastAls2operons() of groups by arrayThreads() if !logTd.live()
+};
+
+
+
+struct Typer : Nocopy
+// Typing of assemblies by NativeSearch, without BLAST and files
+// type() types in-memory assemblies; stxtyper --engine native searches by native and adds the hits by addHits()
+// Reentrant: type() can be invoked by concurrent threads
+// Process-wide state used: Trace, logPtr, ThreadPool::global()
+{
+private:
+  const Prescreen prescreen;
+public:
+  const NativeSearch native;
+
+
+  explicit Typer (const string &protFName);
+    // Input: protFName: stx.prot
+    // Invokes: checkStxRefs()
+
+
+  void addHits (Vector<NativeSearch::Hit> &&hits,
+                const Vector<PrescreenWindow> &windows,
+                size_t len,
+                size_t seqs,
+                OperonTyping &typing) const;
+    // Input: hits: found by native, named as in OperonTyping::add()
+    //        len, seqs: total length and number of the sequences of the assembly, for the E-values
+    // Output: typing: add()'ed
+  typedef  Vector<pair<string_view,string_view>>  Seqs;
+    // Pairs (sequence id, nucleotide sequence) of an assembly
+  void type (const Seqs &seqs,
+             OperonTyping &typing) const;
+    // Output: typing
+    // Throws: if seqs is not a valid FASTA as checked by stxtyper
+  Vector<StxRecord> type (const Seqs &seqs) const;
+    // Return: in the report order
+  void saveTsvOut (const Seqs &seqs,
+                   const ReportFormat &format,
+                   TsvOut &td) const;
+    // Output: td: report rows without a header, as by stxtyper --engine native
+};
+
+
+
+}  // namespace
+
+
+
+#endif
@@ -29,7 +29,7 @@
 * File Description:
 *   stx typing using protein reference sequences
 *   
-* Dependencies: NCBI BLAST, gunzip (optional)
+* Dependencies: NCBI BLAST, zlib
 *
 * Release changes:
 *  1.0.20 05/21/2024 PD-5002  {A|B}_reference_subtype
@@ -90,686 +90,716 @@
 #include "common.hpp"
 #include "tsv.hpp"
 using namespace Common_sp;
+#include "stx.hpp"
+using namespace Stx_sp;
 
 #include "common.inc"
 
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utime.h>
+
 
 
 namespace 
 {
 
 
-string input_name;
-bool amrfinder = false;
-bool print_node = false;
-map<string,double> stxClass2identity;
-
 // PAR
-constexpr size_t intergenic_max {36};  // Max. intergenic region in the reference set + 2
-constexpr size_t slack = 30;  
+const string tblastnParams ("-comp_based_stats 0  -seg no  -max_target_seqs 10000  -word_size 5");
+constexpr double tblastnEvalue {1e-10};
+constexpr double tblastnEvalue_locus {1.0};
+  // For the windows saved in LocusCache: the hits are saved with their scores and filtered by tblastnEvalue for each assembly
+const string tblastnFastParams ("-task tblastn-fast  -threshold 100  -window_size 15");  // from amrfinder.cpp: Reduces time by 9%
 
-const string stxS ("stx");
-const string na ("na");
 
 
+// --serve
 
-string stxType_reported_operon2elementName (const string &stxType_reported,
-                                            const string &operon)
+string jsonUnescape (const string &s)
+// Input: s: JSON string without the quotes, the JSON tokenizer keeps the escapes
+// Throws: on an invalid escape
 {
-  string elementName (stxType_reported  + " operon");
-       if (operon == "FRAMESHIFT")
-    elementName += " with frameshift";
-  else if (operon == "INTERNAL_STOP")
-    elementName += " with internal stop";
-  else if (contains (operon, "PARTIAL"))
-    elementName = "Partial " + elementName;
-  else if (operon == "EXTENDED")
-    elementName = "Extended " + elementName;
-  else if (contains (operon, "NOVEL"))
-    elementName = "Novel " + elementName;
-    
-  return elementName;
+  string res;
+  res. reserve (s. size ());
+  auto hex4 = [&s] (size_t pos)
+    // Return: code of \uXXXX at s[pos]
+    {
+      if (pos + 4 > s. size ())
+        throw runtime_error ("Incomplete \\u escape in JSON string");
+      uint32_t code = 0;
+      FOR_START (size_t, i, pos, pos + 4)
+      {
+        const char c = s [i];
+        code <<= 4;
+        if (c >= '0' && c <= '9')
+          code |= (uint32_t) (c - '0');
+        else if (c >= 'a' && c <= 'f')
+          code |= (uint32_t) (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+          code |= (uint32_t) (c - 'A' + 10);
+        else
+          throw runtime_error ("Invalid \\u escape in JSON string");
+      }
+      return code;
+    };
+  FFOR (size_t, i, s. size ())
+  {
+    if (s [i] != '\\')
+    {
+      res += s [i];
+      continue;
+    }
+    i++;
+    if (i == s. size ())
+      throw runtime_error ("Incomplete escape in JSON string");
+    switch (s [i])
+    {
+      case '"':  res += '"';  break;
+      case '\\': res += '\\'; break;
+      case '/':  res += '/';  break;
+      case 'b':  res += '\b'; break;
+      case 'f':  res += '\f'; break;
+      case 'n':  res += '\n'; break;
+      case 'r':  res += '\r'; break;
+      case 't':  res += '\t'; break;
+      case 'u':
+        {
+          uint32_t code = hex4 (i + 1);
+          i += 4;
+          if (code >= 0xD800 && code <= 0xDBFF)
+          {
+            // Surrogate pair
+            if (i + 2 >= s. size () || s [i + 1] != '\\' || s [i + 2] != 'u')
+              throw runtime_error ("Unpaired surrogate in JSON string");
+            const uint32_t low = hex4 (i + 3);
+            if (low < 0xDC00 || low > 0xDFFF)
+              throw runtime_error ("Unpaired surrogate in JSON string");
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            i += 6;
+          }
+          else if (code >= 0xDC00 && code <= 0xDFFF)
+            throw runtime_error ("Unpaired surrogate in JSON string");
+          // UTF-8
+          if (code < 0x80)
+            res += (char) code;
+          else if (code < 0x800)
+          {
+            res += (char) (0xC0 | (code >> 6));
+            res += (char) (0x80 | (code & 0x3F));
+          }
+          else if (code < 0x10000)
+          {
+            res += (char) (0xE0 | (code >> 12));
+            res += (char) (0x80 | ((code >> 6) & 0x3F));
+            res += (char) (0x80 | (code & 0x3F));
+          }
+          else
+          {
+            res += (char) (0xF0 | (code >> 18));
+            res += (char) (0x80 | ((code >> 12) & 0x3F));
+            res += (char) (0x80 | ((code >> 6) & 0x3F));
+            res += (char) (0x80 | (code & 0x3F));
+          }
+        }
+        break;
+      default:
+        throw runtime_error ("Invalid escape in JSON string: \\" + string (1, s [i]));
+    }
+  }
+  return res;
 }
 
 
 
-struct BlastAlignment 
+string jsonRawValue (const string &line,
+                     const string &key)
+// Input: line: JSON object
+// Return: text of the value of key in line as is, or empty() if there is no key
 {
-  size_t length {0}, nident {0}  // aa
-       ,    refStart {0},    refEnd {0},    refLen {0}
-       , targetStart {0}, targetEnd {0}, targetLen {0};
-    // Positions are 0-based
-    // targetStart < targetEnd
-  bool stopCodon {false};
-  bool frameshift {false};
-
-  // target    
-  string targetName; 
-  string targetSeq;  
-  bool targetStrand {true}; 
-    // false <=> negative
-//size_t targetAlign {0};
-    // bp
-  
-  // Reference
-  // Whole sequence ends with '*'
-  string refAccession;
-  string refSeq;
-  // Function of refAccession
-  string stxType;
-  string stxClass;
-    // Function of stxType
-  string stxSuperClass;
-    // Function of stxClass
-  char subunit {'\0'};
-    // 'A' or 'B'
-  string subClass;  // = as in AMRFinderPlus report
-  
-  bool reported {false};
-
-
-  BlastAlignment (const string &line)
-    {
+  size_t pos = 0;
+  auto skipSpaces = [&line, &pos] ()
+    { while (pos < line. size () && isspace (line [pos]))
+        pos++;
+    };
+  auto skipString = [&line, &pos] ()
+    // Requires: line[pos] = '"'
+    { pos++;
+      while (pos < line. size () && line [pos] != '"')
+        pos += line [pos] == '\\' ? 2 : 1;
+      pos++;
+    };
+  auto skipValue = [&line, &pos, &skipString] ()
+    { size_t depth = 0;
+      while (pos < line. size ())
       {
-        string sseqid;
+        const char c = line [pos];
+        if (c == '"')
         {
-    	    istringstream iss (line);
-    	    iss >> targetName >> sseqid >> targetStart >> targetEnd >> targetLen >> refStart >> refEnd >> refLen >> targetSeq >> refSeq;
-  	  // format:  qseqid       sseqid    qstart         qend         qlen         sstart      send      slen      qseq         sseq
-      // blast:                          62285          63017        88215        105         837       837          
+          skipString ();
+          if (! depth)
+            return;
+          continue;
         }
-  	    QC_ASSERT (! targetSeq. empty ());	
-  	    
-  	    string famId;
-        try
-        {	
-  		    subClass     = rfindSplit (sseqid, '|');  
-  		    famId        = rfindSplit (sseqid, '|');  
-  		    refAccession = rfindSplit (sseqid, '|');
-  		  }
-  		  catch (const exception &e)
-  		  {
-  		  	throw runtime_error (string ("Bad StxTyper database\n") + e. what () + "\n" + line);
-  		  }
-        QC_ASSERT (famId. size () == 6);
-        QC_ASSERT (isLeft (famId, stxS));
-        subunit = famId [3];
-        stxType = famId. substr (4);
+        if (c == '{' || c == '[')
+          depth++;
+        else if (c == '}' || c == ']')
+        {
+          if (! depth)
+            return;
+          depth--;
+          if (! depth)
+          {
+            pos++;
+            return;
+          }
+        }
+        else if (c == ',' && ! depth)
+          return;
+        pos++;
       }
-      ASSERT (stxType. size () == 2);
-      	      
-	    length = targetSeq. size ();
-	    nident = 0;
-	    QC_ASSERT (targetSeq. size () == refSeq. size ());
-	    FFOR (size_t, i, targetSeq. size ())
-	      if (targetSeq [i] == refSeq [i])
-	        nident++;
-
-      stxClass = stxType;
-      if (   stxType == "2a"
-          || stxType == "2c"
-          || stxType == "2d"
-         )
-        stxClass = "2";
-      
-      stxSuperClass = stxClass. substr (0, 1);
+    };
+  skipSpaces ();
+  if (pos == line. size () || line [pos] != '{')
+    return noString;
+  pos++;
+  for (;;)
+  {
+    skipSpaces ();
+    if (pos >= line. size () || line [pos] != '"')
+      return noString;
+    const size_t keyStart = pos + 1;
+    skipString ();
+    if (pos > line. size ())
+      return noString;
+    const string name (line. substr (keyStart, pos - 1 - keyStart));
+    skipSpaces ();
+    if (pos == line. size () || line [pos] != ':')
+      return noString;
+    pos++;
+    skipSpaces ();
+    const size_t valueStart = pos;
+    skipValue ();
+    if (jsonUnescape (name) == key)
+    {
+      string value (line. substr (valueStart, pos - valueStart));
+      trimTrailing (value);
+      return value;
+    }
+    skipSpaces ();
+    if (pos >= line. size () || line [pos] != ',')
+      return noString;
+    pos++;
+  }
+}
 
-	    QC_ASSERT (refStart < refEnd);
 
-	    QC_ASSERT (targetStart != targetEnd);
-	    targetStrand = targetStart < targetEnd;  
-	    if (! targetStrand)
-	      swap (targetStart, targetEnd);
-	    
-	    QC_ASSERT (refStart >= 1);
-	    QC_ASSERT (targetStart >= 1);
-	    refStart--;
-	    targetStart--;
-	    
-    //targetAlign = targetEnd - targetStart;
-    //QC_ASSERT (targetAlign_aa % 3 == 0);
-    //targetAlign_aa /= 3;
-	    
-	    const size_t stopCodonPos = targetSeq. find ('*');
-	    if (stopCodonPos != string::npos && stopCodonPos + 1 < targetSeq. size ())
-	      stopCodon = true;
+
+int serveStopPipe [2] {-1, -1};
+  // Written by serveStopHandler()
+
+
+
+void serveStopHandler (int /*sig*/)
+{
+  const int errno_ = errno;
+  const char c = '\0';
+  if (::write (serveStopPipe [1], & c, 1) < 0)
+    {}  // The pipe is full: a stop is pending
+  errno = errno_;
+}
+
+
+
+struct ServeConnection
+// Client of --serve
+{
+  const int fd;
+  const bool isSocket;
+    // fd is closed by the destructor
+private:
+  mutex mtx;
+public:
+
+  ServeConnection (int fd_arg,
+                   bool isSocket_arg)
+    : fd (fd_arg)
+    , isSocket (isSocket_arg)
+    {}
+ ~ServeConnection ()
+    { if (isSocket)
+        ::close (fd);
     }
-  void qc () const
-    {
-      if (! qc_on)
-        return;
-      QC_ASSERT (length);
-      QC_ASSERT (nident);
-      QC_ASSERT (nident <= length);
-	    QC_ASSERT (targetStart < targetEnd);
-	    QC_ASSERT (targetEnd <= targetLen);
-      QC_ASSERT (refStart < refEnd);
-	    QC_ASSERT (refEnd <= refLen);
-	    if (! frameshift)
-	    {
-  	    QC_ASSERT (nident <= refEnd - refStart);
-  	    QC_ASSERT (refEnd - refStart <= length);	    
-  	  }
-      QC_ASSERT (! targetName. empty ());
-      QC_ASSERT (contains (stxClass2identity, stxClass));
-      QC_ASSERT (isLeft (stxType, stxClass));
-      QC_ASSERT (subunit == 'A' || subunit == 'B');
-      QC_ASSERT (subClass. size () > stxS. size ());
-      QC_ASSERT (! refAccession. empty ());
-      QC_ASSERT (! targetSeq. empty ());
-      QC_ASSERT (! refSeq. empty ());
-      QC_ASSERT (targetSeq. size () == refSeq. size ());
-      QC_IMPLY (! frameshift, length == targetSeq. size ());
-      QC_ASSERT (stxType. size () == 2);
-    }
-  void saveTsvOut (TsvOut& td,
-                   bool verboseP) const 
-    { if (! td. live ())
-        return;
-      const string stxType_reported (verboseP ? getGenesymbol () : (stxS + stxType. substr (0, 1)));
-      const string operon (frameshift 
-                             ? "FRAMESHIFT"
-                             : stopCodon 
-                               ? "INTERNAL_STOP"
-                               : truncated () || otherTruncated ()
-                                 ? "PARTIAL_CONTIG_END"
-                                 : verboseP && getRelCoverage () == 1.0
-                                   ? "COMPLETE_SUBUNIT"
-                                   : getExtended ()
-                                     ? "EXTENDED"
-                                     : "PARTIAL"
-                          );
-      const char strand (targetStrand ? '+' : '-');
-      const double refCoverage = getRelCoverage () * 100.0;
-      const double refIdentity = getIdentity ()    * 100.0; 
-      // td     
-      if (! input_name. empty ())
-  	    td << input_name;
-      if (amrfinder)
-      {
-        const string subunitS (1, subunit);
-        string subclass (stxType_reported /*stxS + stxType*/);
-        strUpper (subclass);
-        td << na               // 1 "Protein identifier"  
-           << targetName       // 2 "Contig id"
-           << targetStart + 1  // 3 "Start"
-           << targetEnd        // 4 "Stop"
-           << strand           // 5 "Strand"
-           << stxType_reported + "_operon" // 6 "Element symbol"
-           << stxType_reported_operon2elementName (stxType_reported, operon)    // 7 "Element name"
-           << "plus"           // 8 "Scope"
-           << "VIRULENCE"      // 9 "Element type"
-           << "STX_TYPE"       //10 "Element subtype"
-           << subclass. substr (0, 4)   //11 "Class"
-           << subclass         //12 "Subclass"
-           << operon           //13 "Method"  
-           << targetEnd - targetStart /*targetAlign*/      //14 "Target length" 
-           << noString /*refLen*/  //15 "Reference sequence length"
-           << noString /*refCoverage*/      //16 "% Coverage of reference sequence"
-           << refIdentity      //17 "% Identity to reference sequence"
-           << length           //18 "Alignment length"
-           << refAccession     //19 "Accession of closest sequence"
-           << "Shiga toxin " + stxS + stxType + " subunit " + subunitS //20 "Name of closest sequence"
-           << na               //21 "HMM id"
-           << na               //22 "HMM description"
-           ;
-        if (print_node)
-          td << getGenesymbol ();
-      }
-      else
+
+  void reply (const string &json)
+    // Replies of concurrent requests are not interleaved
+    { const string s (json + '\n');
+      const lock_guard<mutex> lock (mtx);
+      size_t done = 0;
+      while (done < s. size ())
       {
-        td << targetName
-           << stxType_reported
-           << operon
-           << noString
-           << targetStart + 1
-           << targetEnd
-           << strand;
-        if (subunit == 'B')
-          td << noString
-             << noString
-             << noString
-             << noString;
-        td << refAccession
-           << subClass
-           << refIdentity
-           << refCoverage;
-        if (subunit == 'A')
-          td << noString
-             << noString
-             << noString
-             << noString;
+        const ssize_t n = isSocket
+                            ? ::send (fd, s. c_str () + done, s. size () - done, MSG_NOSIGNAL)
+                            : ::write (fd, s. c_str () + done, s. size () - done);
+        if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return;  // The client is gone
+        }
+        done += (size_t) n;
       }
-      td. newLn ();
     }
-    
+};
 
-  string getGenesymbol () const
-    { return stxS + subunit + stxType; }
-  void merge (const BlastAlignment &prev)
-    { ASSERT (targetName   == prev. targetName);
-      ASSERT (refAccession == prev. refAccession);
-      ASSERT (targetStrand == prev. targetStrand);
-      ASSERT (targetLen    == prev. targetLen);
-      ASSERT (refLen       == prev. refLen);
-      ASSERT (targetStart > prev. targetStart);
-      targetStart = prev. targetStart;
-      if (targetStrand)
-        refStart = prev. refStart;
-      else
-        refEnd = prev. refEnd;
-      length += prev. length;  // Approximately
-      nident += prev. nident;  // Approximately
-    //targetAlign += prev. targetAlign;
-      if (prev. stopCodon)
-        stopCodon = true;
-      frameshift = true;
-    }
-  size_t getFrame () const
-    { return (targetStart % 3) + 1; }
-  double getIdentity () const 
-    { return (double) nident / (double) (length); }
-  size_t getAbsCoverage () const 
-    { return refEnd - refStart; }
-  double getRelCoverage () const 
-    { return (double) getAbsCoverage () / (double) refLen; }
-  size_t getDiff () const
-    { return refStart + (refLen - refEnd) + (length - nident); }
-  bool truncated () const
-    { return    (targetStart           <= 3 /*Locus::end_delta*/ && ((targetStrand && refStart)            || (! targetStrand && refEnd + 1 < refLen)))
-             || (targetLen - targetEnd <= 3 /*Locus::end_delta*/ && ((targetStrand && refEnd + 1 < refLen) || (! targetStrand && refStart)));
-    }
-  bool otherTruncated () const
-    { constexpr size_t missed_max = intergenic_max + 3 * 20 /*min. domain length*/;  // PAR
-      return    (targetStrand == (subunit == 'B') && targetStart           <= missed_max)
-             || (targetStrand == (subunit == 'A') && targetLen - targetEnd <= missed_max);
-    }
-  bool getExtended () const
-    { ASSERT (! truncated ());
-      return ! refStart && refEnd + 1 == refLen; 
-    }
-  bool insideEq (const BlastAlignment &other) const
-    { return    targetStart >= other. targetStart 
-             && targetEnd   <= other. targetEnd;
-    }  
-  string refMap (size_t len) const
-    { QC_ASSERT (refLen <= len);
-      string s = string (refStart, '-'); 
-      FFOR (size_t, i, refSeq. size ())
-        if (refSeq [i] != '-')
-          s += targetSeq [i];
-      s += string (len - refEnd, '-'); 
-      return s;
-    }
-  static bool frameshiftLess (const BlastAlignment* a,
-                              const BlastAlignment* b)
-    { ASSERT (a);
-      ASSERT (b);
-      ASSERT (! a->reported);
-      ASSERT (! b->reported);
-      LESS_PART (*a, *b, targetName);
-      LESS_PART (*a, *b, targetStrand);
-      LESS_PART (*a, *b, refAccession);
-      LESS_PART (*a, *b, targetStart);
-      LESS_PART (*a, *b, targetEnd);
-      return false;
-    }
-  static bool sameTypeLess (const BlastAlignment* a,
-                            const BlastAlignment* b) 
-    { ASSERT (a);
-      ASSERT (b);
-      LESS_PART (*a, *b, reported);
-      LESS_PART (*a, *b, targetName);
-      LESS_PART (*a, *b, targetStrand);
-      LESS_PART (*a, *b, stxClass);
-      LESS_PART (*a, *b, subunit);
-      LESS_PART (*a, *b, targetStart);
-      LESS_PART (*a, *b, getDiff ());
-      LESS_PART (*a, *b, refAccession);
-      return false;
-    }
-  static bool less (const BlastAlignment* a,
-                    const BlastAlignment* b) 
-    // = sameTypeLess(), but without stxClass
-    { ASSERT (a);
-      ASSERT (b);
-    //LESS_PART (*a, *b, reported);
-      LESS_PART (*a, *b, targetName);
-      LESS_PART (*a, *b, targetStrand);
-      LESS_PART (*a, *b, subunit);
-      LESS_PART (*a, *b, targetStart);
-      LESS_PART (*a, *b, getDiff ());
-      LESS_PART (*a, *b, refAccession);
-      return false;
-    }
-  static bool reportLess (const BlastAlignment* a,
-                          const BlastAlignment* b)  
-    { ASSERT (a);
-      ASSERT (b);
-      LESS_PART (*a, *b, reported);
-      LESS_PART (*a, *b, targetName);
-      LESS_PART (*a, *b, targetStrand);
-      LESS_PART (*b, *a, getAbsCoverage ());
-      LESS_PART (*a, *b, getDiff ());
-      LESS_PART (*a, *b, targetStart);
-      LESS_PART (*a, *b, refAccession);
-      return false;
-    }
+
+
+struct ServeRequest
+{
+  shared_ptr<ServeConnection> conn;
+  string line;
+    // JSON
 };
 
 
 
-struct Operon
+
+// LocusCache
+
+struct LocusCache
+// Search results of prescreen windows: tabular lines without the first column (window name), with the score
+//   native: NativeSearch::Hit::toCache()
+//   tblastn: -outfmt '6 sseqid qseqid sstart send slen qstart qend qlen sseq qseq score'
+// Shared by threads
 {
-  const BlastAlignment* al1 {nullptr};
-    // !nullptr
-  const BlastAlignment* al2 {nullptr};
-  // al1->targetEnd < al2->targetStart
-  
+private:
+  const string dir;
+    // Persistent cache if not empty, ends with '/'
+  const uint64_t salt;
+  const string processId;
+    // Unique among the processes using dir
+  mutable mutex mtx;
+  unordered_map<uint64_t,StringVector> key2lines;
+public:
 
-  Operon () = default;
-  Operon (const BlastAlignment& al1_arg,
-          const BlastAlignment& al2_arg)
-    : al1 (& al1_arg)
-    , al2 (& al2_arg)
-    {}
-  explicit Operon (const BlastAlignment& al1_arg)
-    : al1 (& al1_arg)
-    {}
-  void qc () const
-    { if (! qc_on)
-        return;
-      QC_ASSERT (al1);
-      al1->qc ();
-      QC_ASSERT (al1->reported);
-      if (! al2)
-        return;
-      al2->qc ();
-      QC_ASSERT (al1->targetName   == al2->targetName);
-      QC_ASSERT (al1->targetStrand == al2->targetStrand);
-      QC_ASSERT (al1->targetEnd    <  al2->targetStart);
-      QC_ASSERT (al1->subunit      != al2->subunit);
-      QC_ASSERT (al2->reported);
-    }
-  void saveTsvOut (TsvOut& td,
-                   bool verboseP) const 
-    { ASSERT (al1);
-      if (! td. live ())
-        return;
-      if (al2)
+
+  LocusCache (const string &dir_arg,
+              uint64_t salt_arg,
+              const string &processId_arg)
+    : dir (dir_arg)
+    , salt (salt_arg)
+    , processId (processId_arg)
+    { if (! dir. empty () && ! directoryExists (dir))
+        createDirectory (dir);
+    }
+
+
+  uint64_t getKey (const string &seq,
+                   size_t start,
+                   size_t len) const
+    // Return: key of seq[start,start+len)
+    //         The cached hits are before the E-value filter, so they do not depend on the search space
+    { ASSERT (start + len <= seq. size ());
+      const string lenS (to_string (len) + '\n');
+      return fnv1a (seq. c_str () + start, len, fnv1a (lenS, salt)); 
+    }
+  bool get (uint64_t key,
+            StringVector &lines)
+    // Output: lines
+    { lines. clear ();
       {
-        string stxType (getStxType (verboseP));
-        const string standard ("COMPLETE");
-        const bool novel =    al1->stxClass != al2->stxClass 
-                           || getIdentity () < stxClass2identity [al1->stxClass]
-                           || stxType. size () <= 1;
-        const string operonType =    getA () -> frameshift
-                                  || getB () -> frameshift
-                                    ? "FRAMESHIFT"
-                                    :    getA () -> stopCodon 
-                                      || getB () -> stopCodon 
-                                      ? "INTERNAL_STOP"
-                                      :    getA () -> truncated () 
-                                        || getB () -> truncated ()
-                                        ? "PARTIAL_CONTIG_END"
-                                        : partial ()
-                                          ? "PARTIAL"  
-                                          :    getA () -> getExtended ()
-                                            || getB () -> getExtended ()
-                                            ? "EXTENDED"
-                                            : novel
-                                              ? standard + "_NOVEL"
-                                              : standard;
-        if (! verboseP)
+        const lock_guard<mutex> lg (mtx);
+        const auto it = key2lines. find (key);
+        if (it != key2lines. end ())
         {
-          ASSERT (stxType. size () <= 2);
-          if (operonType == standard)
-            { ASSERT (stxType. size () == 2); }
-          else
-            if (stxType. size () == 2)
-              stxType. erase (1);  
+          lines = it->second;
+          return true;
         }
-        const string targetName (al1->targetName);
-        const size_t start = al1->targetStart + 1;
-        const size_t stop  = al2->targetEnd;
-  	    const char strand (al1->targetStrand ? '+' : '-');
-  	    const string stxType_reported (stxS + stxType);
-  	    const double refIdentity = getIdentity () * 100.0;
-  	    // td
-        if (! input_name. empty ())
-  	      td << input_name;
-        if (amrfinder)
+      }
+      if (dir. empty ())
+        return false;
+      const string fName (key2fName (key));
+      if (! fileExists (fName))
+        return false;
+      {
+        LineInput f (fName);
+        while (f. nextLine ())
+          lines << f. line;
+      }
+      const lock_guard<mutex> lg (mtx);
+      key2lines [key] = lines;
+      return true;
+    }
+  void set (uint64_t key,
+            const StringVector &lines)
+    { if (! dir. empty ())
+      {
+        // Atomic for concurrent processes
+        const string fName (key2fName (key));
+        const string tmpFName (fName + "." + processId + "." + to_string (hash<thread::id> () (this_thread::get_id ())) + ".tmp");
         {
-          const string genesymbol (al1->stxType == al2->stxType ? stxS + al1->stxType : stxType_reported);
-          string subclass (stxType_reported /*genesymbol*/);
-          strUpper (subclass);
-          const size_t targetAlign = al2->targetEnd - al1->targetStart;
-        //const size_t refLen = al1->refLen + al2->refLen;
-        //const double refCoverage = double (al1->getAbsCoverage () + al2->getAbsCoverage ()) / double (refLen) * 100.0;
-          const size_t alignmentLen = al1->length + al2->length;
-          const string refAccessions (al1->refAccession + ", " + al2->refAccession);
-          const string fam (al1->getGenesymbol () + ", " + al2->getGenesymbol ());
-          td << na                // 1 "Protein identifier"  
-             << targetName        // 2 "Contig id"
-             << start             // 3 "Start"
-             << stop              // 4 "Stop"
-             << strand            // 5 "Strand"
-             << stxType_reported + "_operon"  // 6 "Element symbol"
-             << stxType_reported_operon2elementName (stxType_reported, operonType)    // 7 "Element name"
-             << "plus"            // 8 "Scope"
-             << "VIRULENCE"       // 9 "Element type"
-             << "STX_TYPE"        //10 "Element subtype"
-             << subclass. substr (0, 4)   //11 "Class"
-             << subclass          //12 "Subclass"
-             << operonType        //13 "Method"  
-             << targetAlign       //14 "Target length" 
-             << noString /*refLen*/  //15 "Reference sequence length"
-             << noString /*refCoverage*/  //16 "% Coverage of reference sequence"
-             << refIdentity       //17 "% Identity to reference sequence"
-             << alignmentLen      //18 "Alignment length"
-             << refAccessions     //19 "Accession of closest sequence"
-             << "Shiga toxin " + genesymbol //20 "Name of closest sequence"
-             << na                //21 "HMM id"
-             << na                //22 "HMM description"
-             ;
-          if (print_node)
-            td << fam;
+          OFStream f (tmpFName);
+          for (const string& line : lines)
+            f << line << '\n';
         }
-        else
-    	    td << targetName
-             << stxType_reported
-             << operonType
-             << refIdentity
-             << start
-             << stop
-             << strand
-             // Approximately if frameshift
-             << getA () -> refAccession
-             << getA () -> subClass
-             << getA () -> getIdentity () * 100.0
-             << getA () -> getRelCoverage () * 100.0
-             << getB () -> refAccession
-             << getB () -> subClass
-             << getB () -> getIdentity () * 100.0
-             << getB () -> getRelCoverage () * 100.0
-             ;
-        td. newLn ();
+        moveFile (tmpFName, fName);
       }
-      else
-        al1->saveTsvOut (td, verboseP);
+      const lock_guard<mutex> lg (mtx);
+      key2lines [key] = lines;
+    }
+private:
+  string key2fName (uint64_t key) const
+    { ostringstream oss;
+      oss << hex << setw (16) << setfill ('0') << key;
+      return dir + oss. str ();
     }
+};
+
 
 
+// ResultCache
+
+struct ResultCache
+// Reports of assemblies: TsvOut lines without the header and the column "name"
+// Shared by threads and by processes
+{
 private:
-  const BlastAlignment* getA () const
-    { return al1->targetStrand ? al1 : al2; }
-  const BlastAlignment* getB () const
-    { return al1->targetStrand ? al2 : al1; }
-  bool hasAl2 () const
-    { return al2; }
-  string getRefAccession2 () const
-    { if (al2)
-        return al2->refAccession;
-      return noString;
+  const string dir;
+    // Ends with '/'
+  const uint64_t salt;
+  const string processId;
+    // Unique among the processes using dir
+  const streamsize size_max;
+    // Of the files in dir
+  static constexpr const char* tmpSuffix {".tmp"};
+public:
+
+
+  ResultCache (const string &dir_arg,
+               uint64_t salt_arg,
+               const string &processId_arg,
+               streamsize size_max_arg)
+    : dir (dir_arg)
+    , salt (salt_arg)
+    , processId (processId_arg)
+    , size_max (size_max_arg)
+    { ASSERT (isRight (dir, "/"));
+      if (! directoryExists (dir))
+        createDirectory (dir);
     }
-  string getStxType (bool verboseP) const
-    { if (! al2)
-        return al1->stxType;
-      if (al1->stxClass != al2->stxClass)
+
+
+  string getKey (const string &fName,
+                 const ReportFormat &format) const
+    // Return: 128-bit hash of the content of fName and of the report format
+    { const string formatS (string (format. amrfinder ? "amrfinder" : "stxtyper") + (format. print_node ? " print_node" : "") + '\n');
+      uint64_t h1 = fnv1a (formatS, salt);
+      uint64_t h2 = fnv1a (formatS, ~ salt);
       {
-      //return al1->stxClass + "/" + al2->stxClass;  ??  // order alphabetically
-        if (al1->stxSuperClass == al2->stxSuperClass)
-          return al1->stxSuperClass;  
-        return noString;
+        ifstream f (fName, ios::binary);
+        if (! f. good ())
+          throw runtime_error ("Cannot open " + shellQuote (fName));
+        constexpr size_t bufSize = 1 << 20;  // PAR
+        vector<char> buf (bufSize);
+        streamsize size = 0;
+        while (f)
+        {
+          f. read (buf. data (), (streamsize) bufSize);
+          const streamsize n = f. gcount ();
+          h1 = fnv1a (buf. data (), (size_t) n, h1);
+          h2 = fnv1a (buf. data (), (size_t) n, h2);
+          size += n;
+        }
+        h1 = fnv1a (to_string (size), h1);
       }
-      if (al1->stxClass != "2")
-        return al1->stxType; 
-      const string a (getA () -> refMap (319 + 1));
-      const string b (getB () -> refMap ( 89 + 1));
-      if (   (a [312] == 'F' || a [312] == 'S')
-          && (a [318] == 'K' || a [318] == 'E')
-          && b [34] == 'D'
-         )
-        return "2a";
-      if (    a [312] == 'F'
-          && (a [318] == 'K' || a [318] == 'E')
-          && b [34] == 'N'
-         )
-        return "2c";
-      if (   a [312] == 'S'
-          && a [318] == 'E'
-          && b [34] == 'N'
-         )
-        return "2d";
-      if (verboseP)
-        return string ("2 ") + a [312] + a [318] + b [34];
-      return "2";
+      ostringstream oss;
+      oss << hex << setfill ('0') << setw (16) << h1 << setw (16) << h2;
+      return oss. str ();
     }
-  bool partial () const
-    { return    (getA () -> getRelCoverage () < 1.0 && ! getA () -> getExtended ())
-             || (getB () -> getRelCoverage () < 1.0 && ! getB () -> getExtended ());
+  bool get (const string &key,
+            string &rows) const
+    // Output: rows
+    { rows. clear ();
+      const string fName (dir + key);
+      ifstream f (fName, ios::binary);
+      if (! f. good ())
+        return false;
+      ostringstream oss;
+      oss << f. rdbuf ();
+      if (f. bad ())
+        return false;
+      rows = oss. str ();
+      ::utime (fName. c_str (), nullptr);
+        // For eviction
+      return true;
     }
-public:
-  double getIdentity () const
-    { return double (al1->nident + al2->nident) / double (al1->length/*refLen*/ + al2->length/*refLen*/); }
-  bool insideEq (const Operon &other) const
-    { return    al1->targetStrand        == other. al1->targetStrand
-    	       && al1->targetStart + slack >= other. al1->targetStart 
-             && al2->targetEnd           <= other. al2->targetEnd + slack;
-    }
-  bool operator< (const Operon &other) const
-    { LESS_PART (*this, other, al1->targetName);
-      LESS_PART (other, *this, getIdentity ());
-      LESS_PART (*this, other, hasAl2 ());
-      LESS_PART (*this, other, al1->refAccession);
-      LESS_PART (*this, other, hasAl2 ());
-      LESS_PART (*this, other, getRefAccession2 ());
-      return false;
+  void set (const string &key,
+            const string &rows) const
+    { save (key, rows);
+      evict ();
     }
-  static bool reportLess (const Operon &a,
-                          const Operon &b)
-    { LESS_PART (a, b, al1->targetName);
-      LESS_PART (a, b, al1->targetStart);
-      LESS_PART (a, b, al1->targetEnd);
-      LESS_PART (b, a, al1->targetStrand);
-      LESS_PART (a, b, al1->refAccession);
-      LESS_PART (a, b, hasAl2 ());
-      LESS_PART (a, b, getRefAccession2 ());
-      return false;
+  size_t merge (const string &otherDir) const
+    // Input: otherDir: of another ResultCache, ends with '/'
+    // Return: number of the entries of otherDir copied to dir
+    { ASSERT (isRight (otherDir, "/"));
+      size_t n = 0;
+      {
+        RawDirItemGenerator dig (0, otherDir, false);
+        string item;
+        while (dig. next (item))
+        {
+          if (isRight (item, tmpSuffix) || fileExists (dir + item))
+            continue;
+          string rows;
+          {
+            ifstream f (otherDir + item, ios::binary);
+            if (! f. good ())
+              continue;
+            ostringstream oss;
+            oss << f. rdbuf ();
+            rows = oss. str ();
+          }
+          save (item, rows);
+          n++;
+        }
+      }
+      evict ();
+      return n;
+    }
+private:
+  void save (const string &key,
+             const string &rows) const
+    { // Atomic for concurrent processes
+      const string fName (dir + key);
+      const string tmpFName (fName + "." + processId + "." + to_string (hash<thread::id> () (this_thread::get_id ())) + tmpSuffix);
+      {
+        OFStream f (tmpFName);
+        f << rows;
+      }
+      moveFile (tmpFName, fName);
+    }
+  void evict () const
+    // Remove the least recently used entries so that the size of dir <= size_max
+    // Concurrent evictions may remove the same files
+    { Vector<pair<time_t,string>> files;
+        // mtime, file name
+      streamsize size = 0;
+      {
+        RawDirItemGenerator dig (0, dir, false);
+        string item;
+        while (dig. next (item))
+        {
+          if (isRight (item, tmpSuffix))
+            continue;
+          struct stat st;
+          if (::stat ((dir + item). c_str (), & st) || ! S_ISREG (st. st_mode))
+            continue;
+          size += st. st_size;
+          files << pair<time_t,string> (st. st_mtime, item);
+        }
+      }
+      if (size <= size_max)
+        return;
+      files. sort ();
+      for (const auto& it : files)
+      {
+        struct stat st;
+        if (::stat ((dir + it. second). c_str (), & st))
+          continue;
+        if (! ::remove ((dir + it. second). c_str ()))
+          size -= st. st_size;
+        if (size <= size_max)
+          break;
+      }
     }
 };
 
 
 
-void goodBlasts2operons (const VectorPtr<BlastAlignment> &goodBlastAls, 
-                         Vector<Operon> &operons, 
-                         bool sameType,
-                         bool strong,
-                         TsvOut &logTd)
+// Contig search
+
+struct WindowSearch
+// Search of a prescreen window before the windows are numbered
 {
-  IMPLY (sameType, strong);
-  
-  LOG ("\nGood blasts:");
+  PrescreenWindow window;
+  uint64_t key {0};
+    // If locusCache
+    // LocusCache::getKey(seq,start,len)
+  bool cached {false};
+  StringVector cachedLines;
+    // cached
+    // Without the window name
+  Vector<NativeSearch::Hit> hits;
+    // !cached and native, named by the contig
+  string seq;
+    // !cached and tblastn
+};
 
-  size_t start = 0;
-  FFOR (size_t, i, goodBlastAls. size ())
-  {
-    const BlastAlignment* alB = goodBlastAls [i];
-    ASSERT (alB);
-    if (alB->reported)
-      continue;
-    alB->saveTsvOut (logTd, true);
-    if (alB->subunit != 'B')
-      continue;
-    while (   start < i 
-           && ! (   goodBlastAls [start] -> targetName   == alB->targetName
-                 && goodBlastAls [start] -> targetStrand == alB->targetStrand
-                 && (   ! sameType 
-                     || goodBlastAls [start] -> stxClass == alB->stxClass
-                    )
-                )
-          )
-      start++;
-    FOR_START (size_t, j, start, i)
-    {
-      const BlastAlignment* alA = goodBlastAls [j];
-      ASSERT (alA);
-      if (alA->reported)
-        continue;
-      ASSERT (alA->targetName   == alB->targetName);
-      ASSERT (alA->targetStrand == alB->targetStrand);
-      IMPLY (sameType, alA->stxClass == alB->stxClass);
-      ASSERT (alA->subunit <= alB->subunit);
-      if (alA->subunit == alB->subunit)
-        break;
-      ASSERT (alA->subunit == 'A');
-      const BlastAlignment* al1 = alA;
-      const BlastAlignment* al2 = alB;
-      if (! al1->targetStrand)
-        swap (al1, al2);
-      if (   al1->targetEnd <= al2->targetStart  
-          && al2->targetStart - al1->targetEnd <= intergenic_max * (strong ? 1 : 2)  // PAR  // PD-4897
-         )
+
+
+struct ContigSearch
+{
+  Vector<WindowSearch> windows;
+    // If prescreen
+  Vector<NativeSearch::Hit> hits;
+    // If no prescreen and native
+};
+
+
+
+struct ContigBatch
+// Contigs in the file order
+{
+  size_t index {0};
+  StringVector ids;
+  StringVector seqs;
+  size_t len {0};
+};
+
+
+
+
+// RunStats
+
+struct RunStats
+// For --stats
+// CPU time is of the process and its finished child processes, therefore the CPU times of the stages of concurrent workers overlap
+{
+  ResourceChronometer reads         {"reads"};
+    // --reads: prescreen and local assembly of the reads
+  ResourceChronometer fasta_check   {"fasta_check"};
+    // Including decompression, prescreen and native search of the prescreen windows
+  ResourceChronometer native_search {"native_search"};
+    // Including the parsing of the native hits
+  ResourceChronometer makeblastdb   {"makeblastdb"};
+  ResourceChronometer tblastn       {"tblastn"};
+    // Including parsing of the tblastn output
+  ResourceChronometer parsing       {"parsing"};
+    // Of the cached tblastn hits, grouping
+  ResourceChronometer operons       {"operons"};
+  ResourceChronometer report        {"report"};
+  size_t assemblies {0};
+  size_t cachedReports {0};
+  size_t contigs {0};
+  size_t bp {0};
+  size_t windows {0};
+  size_t cachedWindows {0};
+  size_t hits {0};
+  size_t groups {0};
+  size_t reportedOperons {0};
+  size_t blastSubject {0};
+  size_t blastDb {0};
+    // Numbers of tblastn searches by strategy
+  size_t tieredFallback {0};
+  size_t readsTotal {0};
+  size_t recruitedReads {0};
+  size_t scratchRam {0};
+  size_t scratchDisk {0};
+    // Numbers of assemblies with the temporary files in RAM and on disk
+
+
+  void add (const RunStats &other)
+    { reads.         add (other. reads);
+      fasta_check.   add (other. fasta_check);
+      native_search. add (other. native_search);
+      makeblastdb.   add (other. makeblastdb);
+      tblastn.       add (other. tblastn);
+      parsing.       add (other. parsing);
+      operons.       add (other. operons);
+      report.        add (other. report);
+      assemblies      += other. assemblies;
+      cachedReports   += other. cachedReports;
+      contigs         += other. contigs;
+      bp              += other. bp;
+      windows         += other. windows;
+      cachedWindows   += other. cachedWindows;
+      hits            += other. hits;
+      groups          += other. groups;
+      reportedOperons += other. reportedOperons;
+      blastSubject    += other. blastSubject;
+      blastDb         += other. blastDb;
+      tieredFallback  += other. tieredFallback;
+      readsTotal      += other. readsTotal;
+      recruitedReads  += other. recruitedReads;
+      scratchRam      += other. scratchRam;
+      scratchDisk     += other. scratchDisk;
+    }
+  void saveJson (JsonContainer* parent) const
+    { auto jStages = new JsonMap (parent, "stages");
+      for (const ResourceChronometer* rc : {& reads, & fasta_check, & native_search, & makeblastdb, & tblastn, & parsing, & operons, & report})
+        if (rc->runs)
+          rc->saveJson (jStages);
+      auto jCounters = new JsonMap (parent, "counters");
+      new JsonInt ((long long) assemblies,      jCounters, "assemblies");
+      new JsonInt ((long long) cachedReports,   jCounters, "cached_reports");
+      new JsonInt ((long long) contigs,         jCounters, "contigs");
+      new JsonInt ((long long) bp,              jCounters, "bp");
+      new JsonInt ((long long) windows,         jCounters, "prescreen_windows");
+      new JsonInt ((long long) cachedWindows,   jCounters, "cached_prescreen_windows");
+      new JsonInt ((long long) hits,            jCounters, "hits");
+      new JsonInt ((long long) groups,          jCounters, "contig_strands");
+      new JsonInt ((long long) reportedOperons, jCounters, "reported_operons");
+      new JsonInt ((long long) blastSubject,    jCounters, "tblastn_subject");
+      new JsonInt ((long long) blastDb,         jCounters, "tblastn_db");
+      new JsonInt ((long long) tieredFallback,  jCounters, "tiered_fallback");
+      if (readsTotal)
       {
-        Operon op (*al1, *al2);
-        LOG ("Operon:\t" + to_string (op. getIdentity ()) + "\t" + to_string (stxClass2identity [op. al1->stxClass]));
-        op. saveTsvOut (logTd, true);  
-        if (   ! strong 
-            || (   op. getIdentity () >= stxClass2identity [op. al1->stxClass]
-                && op. getIdentity () >= stxClass2identity [op. al2->stxClass]
-               )
-           )
-        {
-          operons << std::move (op);
-          var_cast (al1) -> reported = true;
-          var_cast (al2) -> reported = true;
-        }
+        new JsonInt ((long long) readsTotal,      jCounters, "reads");
+        new JsonInt ((long long) recruitedReads,  jCounters, "recruited_reads");
       }
+      if (scratchRam)
+        new JsonInt ((long long) scratchRam,      jCounters, "scratch_ram");
+      if (scratchDisk)
+        new JsonInt ((long long) scratchDisk,     jCounters, "scratch_disk");
     }
-  }
-  
-  LOG ("# Operons: " + to_string (operons. size ()));
-  LOG ("\nSuppress goodBlastAls by operons");
+  void addJson (const Json* jStats)
+    // Input: jStats: saved by saveJson()
+    { ASSERT (jStats);
+      if (const Json* jStages = jStats->at ("stages"))
+        for (ResourceChronometer* rc : {& reads, & fasta_check, & native_search, & makeblastdb, & tblastn, & parsing, & operons, & report})
+          if (const Json* j = jStages->at (rc->name))
+            addJson (*rc, j);
+      const Json* jCounters = jStats->at ("counters");
+      if (! jCounters)
+        throw runtime_error ("No counters");
+      auto counter = [jCounters] (size_t &n, const char* name)
+        { if (const Json* j = jCounters->at (name))
+            n += (size_t) j->getInt ();
+        };
+      counter (assemblies,      "assemblies");
+      counter (cachedReports,   "cached_reports");
+      counter (contigs,         "contigs");
+      counter (bp,              "bp");
+      counter (windows,         "prescreen_windows");
+      counter (cachedWindows,   "cached_prescreen_windows");
+      counter (hits,            "hits");
+      counter (groups,          "contig_strands");
+      counter (reportedOperons, "reported_operons");
+      counter (blastSubject,    "tblastn_subject");
+      counter (blastDb,         "tblastn_db");
+      counter (tieredFallback,  "tiered_fallback");
+      counter (readsTotal,      "reads");
+      counter (recruitedReads,  "recruited_reads");
+      counter (scratchRam,      "scratch_ram");
+      counter (scratchDisk,     "scratch_disk");
+    }
+  static void addJson (ResourceChronometer &rc,
+                       const Json* j)
+    // Input: j: saved by ResourceChronometer::saveJson()
+    { ResourceChronometer other (rc. name);
+      other. wall         = j->at ("wall_sec") -> getDouble ();
+      other. cpu          = j->at ("cpu_sec")  -> getDouble ();
+      other. rss_max      = (size_t) j->at ("peak_rss_kb")       -> getInt ();
+      other. childRss_max = (size_t) j->at ("peak_child_rss_kb") -> getInt ();
+      other. runs         = (size_t) j->at ("runs")              -> getInt ();
+      rc. add (other);
+    }
+};
 
-  for (const BlastAlignment* al : goodBlastAls)
-  {
-    ASSERT (al);
-    if (! al->reported)
-      for (const Operon& op : operons)
-      {
-        ASSERT (op. al2);
-        if (   al->targetName          == op. al1->targetName
-            && al->targetStart + slack >= op. al1->targetStart 
-            && al->targetEnd           <= op. al2->targetEnd + slack
-            && al->targetStrand        == op. al1->targetStrand
-           ) 
-        {
-          var_cast (al) -> reported = true;
-          break;
-        }
-      }
-  }
-}
 
 
 
@@ -777,16 +807,66 @@ void goodBlasts2operons (const VectorPtr<BlastAlignment> &goodBlastAls,
 
 struct ThisApplication : ShellApplication
 {
+private:
+  // Set by setBlastThreads()
+  mutable string tblastnThreadsParam;
+  mutable StringVector queryFNames;
+    // Parts of stx.prot searched by concurrent tblastn's
+  unique_ptr<const Prescreen> prescreen;
+    // nullptr <=> --no_prescreen or native
+  unique_ptr<const Typer> typer;
+    // nullptr <=> tblastn
+  const NativeSearch* native {nullptr};
+    // = &typer->native
+  unique_ptr<LocusCache> locusCache;
+    // !nullptr => prescreen
+  unique_ptr<const ResultCache> resultCache;
+  // --stats
+  mutable RunStats stats;
+  mutable mutex statsMtx;
+  string blastStrategy;
+  bool jsonLines {false};
+  bool tiered {false};
+  size_t shard {0};
+  size_t shards_num {0};
+    // --shard shard/shards_num, shard = 0 <=> all assemblies
+  ReportFormat format;
+    // Default of the requests of --serve, without name in --batch
+public:
+
+
   ThisApplication ()
-    : ShellApplication ("Determine stx type(s) of a genome, print .tsv-file", true, false, true, true)
+    : ShellApplication ("Determine stx type(s) of a genome, print .tsv-file", true, true, true, true)
     {
     	addKey ("nucleotide", "Input nucleotide FASTA file (can be gzipped)", "", 'n', "NUC_FASTA");
     //addKey ("translation_table", "NCBI genetic code for translated BLAST", "11", 't', "TRANSLATION_TABLE");
+      addKey ("batch", "Manifest file with lines: <name><tab><nucleotide FASTA file (can be gzipped)>. The assemblies are typed by THREADS workers of one process, the report has the first column \"name\"", "", '\0', "MANIFEST");
+      addKey ("serve", "Resident server: process requests from a Unix socket SOCKET, or from STDIN if SOCKET is \"-\". A request is a line with a JSON object: {\"id\": <echoed>, \"file\": <nucleotide FASTA file> | \"sequence\": <nucleotide FASTA text>, \"name\": <NAME>, \"format\": \"stxtyper\" | \"amrfinder\", \"print_node\": <boolean>}. A reply is a line with a JSON object: {\"id\": .., \"status\": \"ok\", \"report\": <report>} or {\"id\": .., \"status\": \"error\", \"error\": <message>}. Requests are processed by THREADS workers", "", '\0', "SOCKET");
+      addKey ("reads", "Input FASTQ file(s) of reads (can be gzipped), separated by commas, e.g., of paired-end reads. The reads with stx protein k-mers are assembled locally, and the contigs are typed instead of an assembly", "", '\0', "FASTQ");
       addKey ("name", "Text to be added as the first column \"name\" to all rows of the report, for example it can be an assembly name", "", '\0', "NAME");
       addKey ("output", "Write output to OUTPUT_FILE instead of STDOUT", "", 'o', "OUTPUT_FILE");
     	addKey ("blast_bin", "Directory for BLAST. Deafult: $BLAST_BIN", "", '\0', "BLAST_DIR");
     	addFlag ("amrfinder", "Print output in the nucleotide AMRFinderPlus format");
     	addFlag ("print_node", "Print AMRFinderPlus hierarchy node");
+    	addFlag ("no_prescreen", "Do not prescreen the contigs by protein k-mers, BLAST all contigs");
+    	addKey ("locus_cache", "Directory of the persistent cache of the search results of the contig regions found by the prescreen. In the --batch mode the regions are cached in memory anyway", "", '\0', "CACHE_DIR");
+    	addKey ("cache_dir", "Directory of the persistent cache of the reports, keyed by the input file content, the reference proteins, the StxTyper and BLAST versions, the search engine, --no_prescreen and the output format. The directory can be shared by concurrent runs", "", '\0', "CACHE_DIR");
+    	addKey ("cache_size", "Max. size of CACHE_DIR in MB, the least recently used reports are removed", "1000", '\0', "CACHE_SIZE");
+    	addKey ("engine", "Search engine: tblastn, native (built-in translated search, BLAST is not needed)", "tblastn", '\0', "ENGINE");
+    	addKey ("blast_strategy", "How tblastn searches the contigs: auto, subject (tblastn -subject without a BLAST database, for small inputs), db (makeblastdb, then tblastn -db with -num_threads, for large inputs). auto chooses by the number and the total length of the sequences to be searched", "auto", '\0', "BLAST_STRATEGY");
+    	addFlag ("tiered", "Two-tier tblastn search: a fast search (-task tblastn-fast) of all contigs, then the sensitive search of the contigs with hits. If a hit of the fast search is partial or at a contig end, then all contigs are searched by the sensitive search");
+    	addFlag ("json_lines", "Print the report in the JSON Lines format: a JSON object per row with the header fields as keys and string values");
+    	addKey ("stats", "Save a JSON object with the wall time, CPU time and peak memory of the run and of its stages, and counters of contigs, prescreen windows, hits and operons, in STATS_FILE", "", '\0', "STATS_FILE");
+    	addKey ("shard", "Type only the shard I of N (1 <= I <= N) of the --batch manifest: the assemblies whose names hash to I. The reports of all shards are combined by --merge", "", '\0', "I/N");
+    	addKey ("merge", "Combine the reports of the shards of the --batch manifest, separated by commas, into one report in the manifest order, as if the manifest were typed by one run. No assembly is typed", "", '\0', "REPORTS");
+    	addKey ("merge_stats", "With --merge: combine the --stats files of the shards, separated by commas, into STATS_FILE", "", '\0', "SHARD_STATS_FILES");
+    	addKey ("merge_cache", "With --merge: copy the entries of the --cache_dir directories of the shards, separated by commas, which are missing in CACHE_DIR", "", '\0', "SHARD_CACHE_DIRS");
+    	addKey ("trace", "Trace level: 0 - off, 1 - assemblies, 2 - operon candidates, 3 - hits. The last " + to_string (Trace::ring_size) + " trace records of each thread are appended to the LOG file at the end of the run or on an error, or are printed to STDERR on an error", "0", '\0', "TRACE_LEVEL");
+
+    	setRequiredGroup ("nucleotide", "input");
+    	setRequiredGroup ("batch",      "input");
+    	setRequiredGroup ("serve",      "input");
+    	setRequiredGroup ("reads",      "input");
 
       version = SVN_REV;
     }
@@ -795,25 +875,123 @@ struct ThisApplication : ShellApplication
 
   void shellBody () const final
   {
-    const string fName      = shellQuote (getArg ("nucleotide"));
-    const uint   gencode    =             /*arg2uint ("translation_table")*/ 11; 
-                 input_name =             getArg ("name");
+    const string fName      =             getArg ("nucleotide");
+    const string batchFName =             getArg ("batch");
+    const string serveSocket =            getArg ("serve");
+    const string readsFNames =            getArg ("reads");
+    var_cast (this) -> format. name =     getArg ("name");
     const string output     =             getArg ("output");
           string blast_bin  =             getArg ("blast_bin");
-                 amrfinder  =             getFlag ("amrfinder");
-                 print_node =             getFlag ("print_node");
+    var_cast (this) -> format. amrfinder =  getFlag ("amrfinder");
+    var_cast (this) -> format. print_node = getFlag ("print_node");
+    const bool no_prescreen =             getFlag ("no_prescreen");
+    const string engine     =             getArg ("engine");
+          string locusCacheDir =          getArg ("locus_cache");
+          string cacheDir   =             getArg ("cache_dir");
+    const double cacheSize  =             str2<double> (getArg ("cache_size"));
+    const string statsFName =             getArg ("stats");
+    var_cast (this) -> blastStrategy =    getArg ("blast_strategy");
+    var_cast (this) -> jsonLines =        getFlag ("json_lines");
+    var_cast (this) -> tiered =           getFlag ("tiered");
+    const int traceLevel    =             str2<int> (getArg ("trace"));
+    const string shardS     =             getArg ("shard");
+    const string mergeFNames =            getArg ("merge");
+    const string mergeStatsFNames =       getArg ("merge_stats");
+    const string mergeCacheDirs =         getArg ("merge_cache");
     
-    if (contains (input_name, '\t'))
+    if (contains (format. name, '\t'))
       throw runtime_error ("NAME cannot contain a tab character");
-    if (print_node && ! amrfinder)
+    if (format. print_node && ! format. amrfinder)
       throw runtime_error ("--print_node requires --amrfinder");
+    if (! batchFName. empty () && ! format. name. empty ())
+      throw runtime_error ("--name cannot be used with --batch, names are taken from the manifest");
+    if (! serveSocket. empty () && ! format. name. empty ())
+      throw runtime_error ("--name cannot be used with --serve, names are taken from the requests");
+    if (! serveSocket. empty () && ! output. empty ())
+      throw runtime_error ("--output cannot be used with --serve");
+    if (engine != "tblastn" && engine != "native")
+      throw runtime_error ("Unknown search engine: " + strQuote (engine));
+    if (no_prescreen && ! locusCacheDir. empty ())
+      throw runtime_error ("--locus_cache requires the prescreen");
+    if (cacheSize <= 0.0)
+      throw runtime_error ("CACHE_SIZE should be positive");
+    if (blastStrategy != "auto" && blastStrategy != "subject" && blastStrategy != "db")
+      throw runtime_error ("Unknown BLAST strategy: " + strQuote (blastStrategy));
+    if (engine == "native" && blastStrategy != "auto")
+      throw runtime_error ("--blast_strategy requires --engine tblastn");
+    if (engine == "native" && tiered)
+      throw runtime_error ("--tiered requires --engine tblastn");
+    if (! serveSocket. empty () && ! statsFName. empty ())
+      throw runtime_error ("--stats cannot be used with --serve");
+    if (! shardS. empty ())
+    {
+      if (batchFName. empty ())
+        throw runtime_error ("--shard requires --batch");
+      string n (shardS);
+      const string i (findSplit (n, '/'));
+      try
+      {
+        var_cast (this) -> shard     = str2<size_t> (i);
+        var_cast (this) -> shards_num = str2<size_t> (n);
+      }
+      catch (...)
+      {
+        throw runtime_error ("--shard I/N is expected, e.g., 1/4: " + strQuote (shardS));
+      }
+      if (! shard || shard > shards_num)
+        throw runtime_error ("--shard I/N requires 1 <= I <= N: " + strQuote (shardS));
+    }
+    if (! mergeFNames. empty ())
+    {
+      if (batchFName. empty ())
+        throw runtime_error ("--merge requires --batch");
+      if (! shardS. empty ())
+        throw runtime_error ("--merge cannot be used with --shard");
+    }
+    if (! mergeStatsFNames. empty () && (mergeFNames. empty () || statsFName. empty ()))
+      throw runtime_error ("--merge_stats requires --merge and --stats");
+    if (! mergeCacheDirs. empty () && (mergeFNames. empty () || cacheDir. empty ()))
+      throw runtime_error ("--merge_cache requires --merge and --cache_dir");
+    if (traceLevel < 0 || traceLevel > 3)
+      throw runtime_error ("TRACE_LEVEL should be 0..3");
+    if (traceLevel > TRACE_LEVEL_MAX)
+      stderr << "Trace points of a level greater than " << TRACE_LEVEL_MAX << " are not compiled" << '\n';
+    Trace::level = traceLevel;
+
+    ResourceChronometer total ("total");
+    total. start ();
 
 
     stderr << "Software directory: " << shellQuote (execDir) << '\n';
     stderr << "Version: " << version << '\n'; 
+    if (! no_prescreen)
+      stderr << "Prescreen: only the contig regions with exact 5-amino-acid matches to the reference proteins are searched, distant stx variants may be missed; use --no_prescreen to search all contigs" << '\n';
+    
+    
+    if (! mergeFNames. empty ())
+    {
+      {
+        Cout out (output);
+        mergeShards (batchFName, mergeFNames, *out);
+      }
+      if (! mergeStatsFNames. empty ())
+      {
+        total. stop ();
+        mergeStats (batchFName, mergeStatsFNames, total, statsFName);
+      }
+      if (! mergeCacheDirs. empty ())
+      {
+        addDirSlash (cacheDir);
+        const ResultCache cache (cacheDir, 0, to_string (fnv1a (tmp)), (streamsize) (cacheSize * 1e6));  // The salt is not used
+        for (string shardDir : StringVector (mergeCacheDirs, ',', true))
+        {
+          addDirSlash (shardDir);
+          stderr << "Cache entries copied from " << shellQuote (shardDir) << ": " << cache. merge (shardDir) << '\n';
+        }
+      }
+      return;
+    }
     
-		const string logFName (tmp + "/log"); 
-    const string qcS (qc_on ? " -qc" : "");
 
 
     #define BLASTX 0
@@ -832,324 +1010,1413 @@ struct ThisApplication : ShellApplication
 	    prog2dir ["makeblastdb"] = blast_bin;  
 	  #endif
 	  }
-
-    const string dna_flat = uncompress (fName,  "dna_flat");
-    
-  #if BLASTX
-    size_t nDna = 0;
-    size_t dnaLen_max = 0;
-    size_t dnaLen_total = 0;
-  #endif
+    if (engine == "native")
+    {
+      var_cast (this) -> typer. reset (new Typer (execDir + "stx.prot"));
+      var_cast (this) -> native = & typer->native;
+    }
+    else
     {
-      prog2dir ["fasta_check"] = execDir;
-      exec (fullProg ("fasta_check") + dna_flat + "  -hyphen  -ambig  " + qcS + "  -log " + logFName + " > " + tmp + "/nseq", logFName); 
-    	const StringVector vec (tmp + "/nseq", (size_t) 10, true); 
-    	if (vec. size () != 3)
-        throw runtime_error ("fasta_check failed: " + vec. toString ("\n"));
     #if BLASTX
-      nDna         = str2<size_t> (vec [0]);
-      dnaLen_max   = str2<size_t> (vec [1]);
-      dnaLen_total = str2<size_t> (vec [2]);
+   	  findProg ("blastx");
+    #else
+   	  findProg ("makeblastdb");
+   	  findProg ("tblastn");
     #endif
+      if (tiered)
+      {
+        if (! contains (progOutput ("tblastn", "-help"), "tblastn-fast"))
+          throw runtime_error ("--tiered requires tblastn with -task tblastn-fast (BLAST+ 2.10 or later)");
+      }
     }
-  #if BLASTX
-    QC_ASSERT (nDna);
-    QC_ASSERT (dnaLen_max);
-    QC_ASSERT (dnaLen_total);
-  #endif
-
-	//stderr. section ("Running blast");
-	  const string blastOut (tmp + "/blast");
-		{
-			const Chronometer_OnePass_cerr cop ("blast");
- 			// Database: created by ~brovervv/code/database/stx.prot.sh
-    #if BLASTX
- 			findProg ("blastx");
-  		const string blast_fmt ("-outfmt '6 qseqid sseqid qstart qend qlen sstart send slen qseq sseq'");
-			exec (fullProg ("blastx") + " -query " + dna_flat + " -db " + execDir + "stx.prot  " 
-			      + "-comp_based_stats 0  -evalue 1e-10  -seg no  -max_target_seqs 10000  -word_size 5  -query_gencode " + to_string (gencode) + " "
-			      + getBlastThreadsParam ("blastx", min (nDna, dnaLen_total / 10002)) 
-			      + " " + blast_fmt + " -out " + blastOut + " > /dev/null 2> " + tmp + "/blast-err", tmp + "/blast-err");
- 		#else
- 			findProg ("makeblastdb");
- 			exec (fullProg ("makeblastdb") + "-in " + dna_flat + "  -dbtype nucl  -out " + tmp + "/db  -logfile " + tmp + "/db.log  > /dev/null", tmp + "db.log");
- 			findProg ("tblastn");
-  		const string blast_fmt ("-outfmt '6 sseqid qseqid sstart send slen qstart qend qlen sseq qseq'");
-			exec (fullProg ("tblastn") + " -query " + execDir + "stx.prot  -db " + tmp + "/db  "
-			      + "-comp_based_stats 0  -evalue 1e-10  -seg no  -max_target_seqs 10000  -word_size 5  -db_gencode " + to_string (gencode) 
-			    //+ "  -task tblastn-fast  -threshold 100  -window_size 15"  // from amrfinder.cpp: Reduces time by 9% 
-			    //+ "   -num_threads 10  -mt_mode 1"  // Reduces time by 30%
-			      + " " + blast_fmt + " -out " + blastOut + " > /dev/null 2> " + tmp + "/blast-err", tmp + "/blast-err");
-		#endif
-		}
 
 
-    // stxClass2identity[]
-    stxClass2identity ["1a"] = 0.983;
-    stxClass2identity ["1c"] = 0.983;
-    stxClass2identity ["1d"] = 0.983;
-    stxClass2identity ["1e"] = 0.983;
-    stxClass2identity ["2"]  = 0.98;  
-    stxClass2identity ["2b"] = 0.98;  
-    stxClass2identity ["2e"] = 0.98;
-    stxClass2identity ["2f"] = 0.98;
-    stxClass2identity ["2g"] = 0.98;
-    stxClass2identity ["2h"] = 0.98;
-    stxClass2identity ["2i"] = 0.98;
-    stxClass2identity ["2j"] = 0.98;
-    stxClass2identity ["2k"] = 0.985;
-    stxClass2identity ["2l"] = 0.985;
-    stxClass2identity ["2m"] = 0.98;
-    stxClass2identity ["2n"] = 0.98;
-    stxClass2identity ["2o"] = 0.98;
+    checkStxRefs (execDir + "stx.prot");
     
     
-    Cout out (output);
-    TsvOut td (& *out, 2, false);
-    TsvOut logTd (logPtr, 2, false);
-
-    
-    if (! input_name. empty ())
-      td << "name";
-    if (amrfinder)
+    const bool locusCached =    ! no_prescreen
+                             && (! locusCacheDir. empty () || ! batchFName. empty () || ! serveSocket. empty ());
+    uint64_t salt = 0;
+      // Hash of the search engine, its parameters and the references
+    if (! cacheDir. empty () || locusCached)
     {
-      td << /* 1*/ "Protein identifier"  
-         << /* 2*/ "Contig id"
-         << /* 3*/ "Start"
-         << /* 4*/ "Stop"
-         << /* 5*/ "Strand"
-         << /* 6*/ "Element symbol"  // PD-4924
-         << /* 7*/ "Element name"  // PD-4910
-         << /* 8*/ "Scope"
-         << /* 9*/ "Element type"
-         << /*10*/ "Element subtype"
-         << /*11*/ "Class"
-         << /*12*/ "Subclass"
-         << /*13*/ "Method"
-         << /*14*/ "Target length"
-         << /*15*/ "Reference sequence length"
-         << /*16*/ "% Coverage of reference sequence"
-         << /*17*/ "% Identity to reference sequence"
-         << /*18*/ "Alignment length"
-         << /*19*/ "Accession of closest sequence"
-         << /*20*/ "Name of closest sequence"
-         << /*21*/ "HMM id"
-         << /*22*/ "HMM description"
-         ;
-      if (print_node)
-        td << "Hierarchy node";  
+      salt = fnv1a (version + '\n' + engine + (tiered ? "/tiered" : "") + (no_prescreen ? "/no_prescreen" : "") + '\n');
+      if (native)
+        salt = fnv1a (NativeSearch::parameters () + '\n', salt);
+      else
+        salt = fnv1a (tblastnParams + "  -evalue " + toString (tblastnEvalue) + '/' + toString (tblastnEvalue_locus) + '\n' + (tiered ? tblastnFastParams : noString) + '\n' + progOutput ("tblastn", "-version"), salt);
+      LineInput f (execDir + "stx.prot");
+      while (f. nextLine ())
+        salt = fnv1a (f. line + '\n', salt);
+    }
+    
+    if (! cacheDir. empty ())
+    {
+      addDirSlash (cacheDir);
+      var_cast (this) -> resultCache. reset (new ResultCache (cacheDir, salt, to_string (fnv1a (tmp)), (streamsize) (cacheSize * 1e6)));  // tmp is unique
+    }
+    
+    
+    if (! no_prescreen)
+    {
+      var_cast (this) -> prescreen. reset (new Prescreen (execDir + "stx.prot"));
+      if (locusCached)
+      {
+        if (! locusCacheDir. empty ())
+          addDirSlash (locusCacheDir);
+        var_cast (this) -> locusCache. reset (new LocusCache (locusCacheDir, salt, to_string (fnv1a (tmp))));  // tmp is unique
+      }
+    }
+    
+    
+    if (! serveSocket. empty ())
+    {
+      serve (serveSocket);
+      return;
+    }
+    
+    
+    Cout out (output);
+    TsvOut td (& *out, 2, false);
+    td. flushLn   = false;
+    td. jsonLines = jsonLines;
+    TsvOut logTd (logPtr, 2, false);
+
+    saveReportHeader (td, format, ! format. name. empty () || ! batchFName. empty ());
+
+    if (! readsFNames. empty ())
+    {
+      if (! native)
+        setBlastThreads (threads_max, true);
+      const string contigsFName (tmp + "/reads.fa");
+      if (reads2contigs (readsFNames, contigsFName))
+        typeAssemblyCached (contigsFName, noString, format, td, logTd);
+    }
+    else if (batchFName. empty ())
+    {
+      if (! native)
+        setBlastThreads (threads_max, true);
+      typeAssemblyCached (fName, noString, format, td, logTd);
     }
     else
-      td << "target_contig"
-         << "stx_type"
-         << "operon" 
-         << "identity"
-         << "target_start"
-         << "target_stop"
-         << "target_strand"
-         << "A_reference"
-         << "A_reference_subtype"
-         << "A_identity"
-         << "A_coverage"
-         << "B_reference"
-         << "B_reference_subtype"
-         << "B_identity"
-         << "B_coverage"
-         ; 
-    td. newLn ();
-
-	  VectorOwn<BlastAlignment> blastAls;   
+      typeBatch (batchFName, td, logTd);
+
+    if (! statsFName. empty ())
     {
-      LineInput f (blastOut);
-  	  while (f. nextLine ())
-  	  {
-  	    const Unverbose unv;
-  	    LOG (f. line);
-  	    auto al = new BlastAlignment (f. line);
-  	    al->qc ();  
- 	      blastAls << al;
-  	  }
-  	}
-  	
-  	LOG ("# All stx blasts: " + to_string (blastAls. size ()));
-    LOG ("Finding frame shifts:");
-	  {
-      // Multiple frame shifts are possible
-      blastAls. sort (BlastAlignment::frameshiftLess); 
-      const BlastAlignment* prev = nullptr;
-      for (const BlastAlignment* al : blastAls)
-      {        
-        ASSERT (al);
-        if (   prev
-            && al->targetName   == prev->targetName
-            && al->targetStrand == prev->targetStrand
-            && al->refAccession == prev->refAccession
-            && al->targetStart  >  prev->targetStart
-            && (int) al->targetStart - (int) prev->targetEnd < 10  // PAR
-            && al->getFrame () != prev->getFrame ()
-           )
+      total. stop ();
+      auto jStats = new JsonMap ();
+      new JsonString (version, jStats, "version");
+      new JsonString (engine, jStats, "engine");
+      new JsonString (blastStrategy, jStats, "blast_strategy");
+      if (! readsFNames. empty ())
+        new JsonString (readsFNames, jStats, "reads");
+      else
+        new JsonString (batchFName. empty () ? fName : batchFName, jStats, batchFName. empty () ? "nucleotide" : "batch");
+      new JsonInt ((long long) threads_max, jStats, "threads");
+      if (shard)
+        new JsonString (shardS, jStats, "shard");
+      total. saveJson (jStats);
+      stats. saveJson (jStats);
+      {
+        OFStream f (statsFName);
+        jRoot->saveText (f);
+        f << endl;
+      }
+      jRoot. reset ();
+    }
+  }
+
+
+
+  size_t reads2contigs (const string &readsFNames,
+                        const string &contigsFName) const
+  // Input: readsFNames: FASTQ files separated by commas
+  // Output: contigsFName: FASTA file of the local assembly of the reads with stx protein k-mers
+  // Return: number of contigs
+  {
+    constexpr size_t block = 100000;  // PAR, reads screened in parallel
+    RunStats st;
+    st. reads. start ();
+    const Prescreen screen (execDir + "stx.prot");
+    ReadAssembly assembly;
+    StringVector reads;  reads. reserve (block);
+    vector<StringVector> recruited;
+    auto screenReads = [&] ()
+      {
+        arrayThreads ([&screen, &reads] (size_t from, size_t to, StringVector &res)
+                              { FOR_START (size_t, i, from, to)
+                                  if (screen. hasSeed (reads [i]))
+                                    res << reads [i];
+                              }, 
+                      reads. size (), recruited);
+        for (const StringVector& res : recruited)
+          for (const string& read : res)
+            assembly. addRead (read);
+        st. readsTotal += reads. size ();
+        reads. clear ();
+      };
+    for (const string& fName : StringVector (readsFNames, ',', true))
+    {
+      FastqInput f (fName);
+      try
+      {
+        while (f. nextRecord ())
+        {
+          reads << std::move (f. seq);
+          if (reads. size () == block)
+            screenReads ();
+        }
+      }
+      catch (const exception &e)
+      {
+        throw runtime_error ("FASTQ file " + shellQuote (fName) + ": " + e. what ());
+      }
+    }
+    screenReads ();
+    st. recruitedReads = assembly. reads;
+
+    const StringVector contigs (assembly. getContigs ());
+    {
+      OFStream f (contigsFName);
+      FFOR (size_t, i, contigs. size ())
+        f << ">contig_" << i + 1 << '\n' << contigs [i] << '\n';
+    }
+    st. reads. stop ();
+    stderr << "Reads: " << st. readsTotal << ", with stx k-mers: " << st. recruitedReads << ", contigs: " << contigs. size () << '\n';
+    {
+      const lock_guard<mutex> lg (statsMtx);
+      stats. add (st);
+    }
+    return contigs. size ();
+  }
+
+
+
+  static void readManifest (const string &batchFName,
+                            StringVector &names,
+                            StringVector &fNames)
+  // Output: names, fNames: parallel, in the manifest order
+  {
+    names. clear ();
+    fNames. clear ();
+    {
+      LineInput f (batchFName);
+      while (f. nextLine ())
+      {
+        trim (f. line);
+        if (f. line. empty () || f. line [0] == '#')
+          continue;
+        const string errorS ("Manifest " + shellQuote (batchFName) + ", " + f. lineStr () + ": ");
+        string fName_ (f. line);
+        string name (findSplit (fName_, '\t'));
+        trim (name);
+        trim (fName_);
+        if (name. empty ())
+          throw runtime_error (errorS + "Empty name");
+        if (fName_. empty ())
+          throw runtime_error (errorS + "<name><tab><file name> is expected");
+        if (contains (fName_, '\t'))
+          throw runtime_error (errorS + "More than 2 columns");
+        names  << std::move (name);
+        fNames << std::move (fName_);
+      }
+    }
+    if (names. empty ())
+      throw runtime_error ("Manifest " + shellQuote (batchFName) + " is empty");
+    {
+      StringVector names_ (names);
+      names_. sort ();
+      const size_t index = names_. findDuplicate ();
+      if (index != no_index)
+        throw runtime_error ("Duplicate name in manifest " + shellQuote (batchFName) + ": " + names_ [index]);
+    }
+  }
+  
+  
+  
+  static size_t name2shard (const string &name,
+                            size_t shards_num_arg)
+  // Return: 1 .. shards_num_arg
+  { 
+    ASSERT (shards_num_arg);
+    return fnv1a (name) % shards_num_arg + 1; 
+  }
+
+
+
+  void typeBatch (const string &batchFName,
+                  TsvOut &td,
+                  TsvOut &logTd) const
+  // Output: td
+  {
+    StringVector names;
+    StringVector fNames;
+    readManifest (batchFName, names, fNames);
+    if (shard)
+    {
+      StringVector shardNames;
+      StringVector shardFNames;
+      FFOR (size_t, i, names. size ())
+        if (name2shard (names [i], shards_num) == shard)
         {
-          var_cast (al) -> merge (*prev);
-          al->qc ();
-          var_cast (prev) -> reported = true;
+          shardNames  << std::move (names [i]);
+          shardFNames << std::move (fNames [i]);
         }
-        al->saveTsvOut (logTd, true);
-        prev = al;
+      names  = std::move (shardNames);
+      fNames = std::move (shardFNames);
+      stderr << "Shard " << shard << '/' << shards_num << '\n';
+      if (names. empty ())
+      {
+        stderr << "Assemblies: 0" << '\n';
+        return;
       }
     }
-    
-    LOG ("All blasts:");
-	  VectorPtr<BlastAlignment> goodBlastAls;   
-	  {
-      blastAls. sort (BlastAlignment::sameTypeLess);
-	    size_t start = 0;
-      FFOR (size_t, i, blastAls. size ())
+    stderr << "Assemblies: " << names. size () << '\n';
+
+    // The log file is shared, therefore with --log the assemblies are typed sequentially
+    const size_t workers = logPtr ? 1 : min (threads_max, names. size ());
+    if (logPtr && threads_max > 1)
+      stderr << "Assemblies are typed sequentially because of --log" << '\n';
+    if (! native)
+      setBlastThreads (threads_max / workers, workers == 1);
+    StringVector reports (names. size ());
+    StringVector errors  (names. size ());
+    atomic<bool> failed {false};
+    auto job = [&] (size_t i)
       {
-        const BlastAlignment* al = blastAls [i];
-        ASSERT (al);
-        while (   start < i 
-               && ! (   blastAls [start] -> targetName   == al->targetName
-                     && blastAls [start] -> targetStrand == al->targetStrand
-                     && blastAls [start] -> stxClass     == al->stxClass
-                     && blastAls [start] -> subunit      == al->subunit
-                     && blastAls [start] -> targetEnd    >  al->targetStart
-                    )
-              )
-          start++;
-        if (al->reported)
-          break; 
-        al->saveTsvOut (logTd, true);
-        bool suppress = false;
-        FOR_START (size_t, j, start, i)
+        if (failed)
+          return;
+        TsvOut noLogTd (nullptr);
+        const string subDir (to_string (i + 1) + "/");
+        try
         {
-          const BlastAlignment* prev = blastAls [j];
-          ASSERT (prev);
-          ASSERT (! prev->reported);
-          ASSERT (al->targetName   == prev->targetName);
-          ASSERT (al->targetStrand == prev->targetStrand);
-          ASSERT (al->stxClass     == prev->stxClass);
-          ASSERT (al->subunit      == prev->subunit);
-          if (   al->insideEq (*prev)
-              && al->getDiff () >= prev->getDiff ()
-            //&& al->getIdentity () <= prev-> getIdentity ()
-             )
+          ostringstream os;
           {
-            suppress = true;
-            break;
+            TsvOut jobTd (os, 2, false);
+            jobTd. usePound = false;
+            jobTd. flushLn  = false;
+            typeAssemblyCached (fNames [i], subDir, format, jobTd, workers == 1 ? logTd : noLogTd);
           }
+          reports [i] = os. str ();
         }
-        if (! suppress)
-          goodBlastAls << al;
+        catch (const exception &e)
+        {
+          errors [i] = e. what ();
+          failed = true;
+        }
+      };
+    if (workers == 1)
+    {
+      FFOR (size_t, i, names. size ())
+        job (i);
+    }
+    else
+    {
+      // An assembly per task of ThreadPool::global(), at most threads_max assemblies are typed at a time
+      TaskGroup tg;
+      FFOR (size_t, i, names. size ())
+        tg. run ([&job, i] () { job (i); });
+      tg. wait ();
+    }
+    FFOR (size_t, i, names. size ())
+      if (! errors [i]. empty ())
+        throw runtime_error ("Assembly " + strQuote (names [i]) + ", file " + shellQuote (fNames [i]) + ":\n" + errors [i]);
+
+    // Combined report in the manifest order
+    FFOR (size_t, i, names. size ())
+    {
+      saveRows (td, names [i], reports [i]);
+      td. flush ();
+    }
+  }
+
+
+
+  void mergeShards (const string &batchFName,
+                    const string &reportFNames,
+                    ostream &os) const
+  // Input: reportFNames: reports of --batch --shard, TSV or JSON Lines, separated by commas
+  // Output: os: one header, rows in the manifest order
+  {
+    StringVector names;
+    StringVector fNames;
+    readManifest (batchFName, names, fNames);
+    unordered_map<string,size_t> name2index;
+    FFOR (size_t, i, names. size ())
+      name2index [names [i]] = i;
+
+    string header;
+    Vector<StringVector> rows (names. size ());
+      // Index: index in names
+    Vector<size_t> name2report (names. size (), no_index);
+    const StringVector reports (reportFNames, ',', true);
+    FFOR (size_t, reportIndex, reports. size ())
+    {
+      const string& fName = reports [reportIndex];
+      LineInput f (fName);
+      while (f. nextLine ())
+      {
+        if (f. line. empty ())
+          continue;
+        const string errorS ("Report " + shellQuote (fName) + ", " + f. lineStr () + ": ");
+        if (f. line [0] == '#')
+        {
+          if (header. empty ())
+            header = f. line;
+          else if (f. line != header)
+            throw runtime_error (errorS + "The header differs from the header of the previous reports");
+          continue;
+        }
+        string name;
+        if (f. line [0] == '{')
+        {
+          istringstream iss (f. line);
+          const JsonMap j (iss);
+          if (const Json* jName = j. at ("name"))
+            name = jsonUnescape (jName->getString ());
+        }
+        else
+          name = f. line. substr (0, f. line. find ('\t'));
+        const auto it = name2index. find (name);
+        if (it == name2index. end ())
+          throw runtime_error (errorS + "Name " + strQuote (name) + " is not in the manifest " + shellQuote (batchFName));
+        size_t& report = name2report [it->second];
+        if (report == no_index)
+          report = reportIndex;
+        else if (report != reportIndex)
+          throw runtime_error (errorS + "Name " + strQuote (name) + " is also in the report " + shellQuote (reports [report]));
+        rows [it->second] << f. line;
       }
     }
-    
-    Vector<Operon> operons;
 
-    LOG ("\nSame type operons:");
-    goodBlasts2operons (goodBlastAls, operons, true, true, logTd);
+    if (! header. empty ())
+      os << header << '\n';
+    for (const StringVector& lines : rows)
+      for (const string& line : lines)
+        os << line << '\n';
+    os. flush ();
+  }
+
+
+
+  void mergeStats (const string &batchFName,
+                   const string &statsFNames,
+                   const ResourceChronometer &mergeTotal,
+                   const string &statsFName) const
+  // Output: statsFName: total: wall time and peak memory are the maximum over the shards, CPU time is the sum
+  //                     merge: of this run
+  {
+    RunStats merged;
+    ResourceChronometer total ("total");
+    string engine;
+    string blastStrategy_;
+    size_t threads = 0;
+    double wall_max = 0.0;
+    const StringVector fNames (statsFNames, ',', true);
+    for (const string& fName : fNames)
+    {
+      const JsonMap j (fName);
+      try
+      {
+        merged. addJson (& j);
+        RunStats::addJson (total, j. at ("total"));
+        maximize (wall_max, j. at ("total") -> at ("wall_sec") -> getDouble ());
+        const string engine_ (j. at ("engine") -> getString ());
+        if (engine. empty ())
+          engine = engine_;
+        else if (engine != engine_)
+          throw runtime_error ("Different engines: " + engine + ", " + engine_);
+        blastStrategy_ = j. at ("blast_strategy") -> getString ();
+        maximize (threads, (size_t) j. at ("threads") -> getInt ());
+      }
+      catch (const exception &e)
+      {
+        throw runtime_error ("Stats file " + shellQuote (fName) + ": " + e. what ());
+      }
+    }
+    total. wall = wall_max;  // The shards run in parallel
+    ResourceChronometer merge (mergeTotal);
+    merge. name = "merge";
     
-    goodBlastAls. sort (BlastAlignment::less);
-
-    LOG ("\nStrong operons:");
-    goodBlasts2operons (goodBlastAls, operons, false, true, logTd);
-
-    LOG ("\nWeak operons:");
-    goodBlasts2operons (goodBlastAls, operons, false, false, logTd);
-   	  
-  	LOG ("\ngoodOperons");
-    Vector<Operon> goodOperons;
-    {    
-      operons. sort ();
-      for (const Operon& op : operons)
+    auto jStats = new JsonMap ();
+    new JsonString (version, jStats, "version");
+    new JsonString (engine, jStats, "engine");
+    new JsonString (blastStrategy_, jStats, "blast_strategy");
+    new JsonString (batchFName, jStats, "batch");
+    new JsonInt ((long long) threads, jStats, "threads");
+    new JsonInt ((long long) fNames. size (), jStats, "shards");
+    total. saveJson (jStats);
+    merge. saveJson (jStats);
+    merged. saveJson (jStats);
+    {
+      OFStream f (statsFName);
+      jRoot->saveText (f);
+      f << endl;
+    }
+    jRoot. reset ();
+  }
+
+
+
+  void serve (const string &socketPath) const
+  // Input: socketPath: Unix socket or "-"
+  {
+    // The log file is shared, therefore with --log the requests are processed sequentially
+    const size_t workers = logPtr ? 1 : threads_max;
+    if (logPtr && threads_max > 1)
+      stderr << "Requests are processed sequentially because of --log" << '\n';
+    if (! native)
+      setBlastThreads (threads_max / workers, false);
+
+    TsvOut logTd (logPtr, 2, false);
+    BoundedQueue<ServeRequest> queue (2 * workers);  // PAR
+      // A full queue stops reading the requests
+    atomic<size_t> requests {0};
+    auto worker = [&] ()
       {
-     	  op. saveTsvOut (logTd, true); 
-       	op. qc ();     
-        bool found = false;
-        for (const Operon& goodOp : goodOperons)
-          if (   op. al1->targetName == goodOp. al1->targetName
-              && op. insideEq (goodOp)
-              && goodOp. getIdentity () >= op. getIdentity ()
-             )
+        TsvOut noLogTd (nullptr);
+        ServeRequest req;
+        while (queue. pop (req))
+        {
+          req. conn->reply (serveRequest (req. line, ++requests, workers == 1 ? logTd : noLogTd));
+          req = ServeRequest ();
+        }
+      };
+
+    // The requests are read by a thread not counted in threads_max
+    exception_ptr readError;
+    thread reader ([&] ()
+      {
+        try
+        {
+          if (socketPath == "-")
           {
-            found = true;
-            break;
+            const auto conn = make_shared<ServeConnection> (STDOUT_FILENO, false);
+            string line;
+            while (getline (cin, line))
+            {
+              trim (line);
+              if (! line. empty ())
+                queue. push (ServeRequest {conn, std::move (line)});
+            }
           }
-        if (! found)
-          goodOperons << op;          
-      }      
+          else
+            listenSocket (socketPath, queue);
+        }
+        catch (...)
+        {
+          readError = current_exception ();
+        }
+        queue. close ();
+      });
+    exception_ptr workerError;
+    {
+      // Dedicated threads, because the workers are long-running; the typing runs its tasks in ThreadPool::global()
+      mutex workerErrorMtx;
+      auto safeWorker = [&worker, &workerError, &workerErrorMtx, &queue] ()
+        {
+          try { worker (); }
+            catch (...)
+            {
+              const lock_guard<mutex> lg (workerErrorMtx);
+              if (! workerError)
+                workerError = current_exception ();
+              queue. close ();
+            }
+        };
+      vector<thread> workerThreads;
+      FFOR (size_t, i, workers - 1)
+        workerThreads. emplace_back (safeWorker);
+      safeWorker ();
+      for (thread& t : workerThreads)
+        t. join ();
     }
+    reader. join ();
+    if (readError)
+      rethrow_exception (readError);
+    if (workerError)
+      rethrow_exception (workerError);
+  }
 
-    // De-redundify single-subunit operons
-	  {
-	    size_t start = 0;
-      FFOR (size_t, i, goodBlastAls. size ())
+
+
+  void listenSocket (const string &socketPath,
+                     BoundedQueue<ServeRequest> &queue) const
+  // Return: on SIGTERM or SIGINT, after the requests of the connections have been read
+  {
+    sockaddr_un addr;
+    memset (& addr, 0, sizeof (addr));
+    addr. sun_family = AF_UNIX;
+    if (socketPath. size () >= sizeof (addr. sun_path))
+      throw runtime_error ("Socket path is too long: " + shellQuote (socketPath));
+    socketPath. copy (addr. sun_path, socketPath. size ());
+
+    const int sock = ::socket (AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+      throw runtime_error (string ("Cannot create a socket: ") + strerror (errno));
+    ::unlink (socketPath. c_str ());
+      // Socket of a previous server
+    if (   ::bind (sock, (const sockaddr*) & addr, sizeof (addr))
+        || ::listen (sock, 64)  // PAR
+       )
+      throw runtime_error ("Cannot listen on " + shellQuote (socketPath) + ": " + strerror (errno));
+
+    if (::pipe (serveStopPipe))
+      throw runtime_error (string ("Cannot create a pipe: ") + strerror (errno));
+    {
+      struct sigaction sa;
+      memset (& sa, 0, sizeof (sa));
+      sa. sa_handler = serveStopHandler;
+      sigemptyset (& sa. sa_mask);
+      sa. sa_flags = SA_RESTART;
+      sigaction (SIGTERM, & sa, nullptr);
+      sigaction (SIGINT,  & sa, nullptr);
+    }
+    stderr << "Listening on " << shellQuote (socketPath) << '\n';
+
+    struct Connection
+    {
+      weak_ptr<ServeConnection> conn;
+      shared_ptr<atomic<bool>> done;
+      thread reader;
+    };
+    list<Connection> connections;
+    for (;;)
+    {
+      pollfd fds [2] { {sock, POLLIN, 0}
+                     , {serveStopPipe [0], POLLIN, 0}
+                     };
+      if (::poll (fds, 2, -1) < 0)
       {
-        const BlastAlignment* al = goodBlastAls [i];
-        ASSERT (al);
-        if (al->reported)
-          continue; 
-        while (   start < i 
-               && ! (   goodBlastAls [start] -> targetName   == al->targetName
-                     && goodBlastAls [start] -> targetStrand == al->targetStrand
-                     && goodBlastAls [start] -> subunit      == al->subunit
-                     && goodBlastAls [start] -> targetEnd    >  al->targetStart
-                    )
-              )
-          start++;
-        al->saveTsvOut (logTd, true);
-        FOR_START (size_t, j, start, i)
+        if (errno == EINTR)
+          continue;
+        throw runtime_error (string ("Cannot wait for a connection: ") + strerror (errno));
+      }
+      if (fds [1]. revents)
+        break;
+      if (! fds [0]. revents)
+        continue;
+      const int fd = ::accept (sock, nullptr, nullptr);
+      if (fd < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw runtime_error (string ("Cannot accept a connection: ") + strerror (errno));
+      }
+      // Finished connections
+      for (auto it = connections. begin (); it != connections. end ();)
+        if (*it->done)
         {
-          const BlastAlignment* prev = goodBlastAls [j];
-          ASSERT (prev);
-          ASSERT (al->targetName   == prev->targetName);
-          ASSERT (al->targetStrand == prev->targetStrand);
-          ASSERT (al->subunit      == prev->subunit);
-          if (   al->insideEq (*prev)
-              && al->getDiff () >= prev->getDiff ()
-            //&& al->getIdentity () <= prev-> getIdentity ()
-             )
+          it->reader. join ();
+          it = connections. erase (it);
+        }
+        else
+          it++;
+      const auto conn = make_shared<ServeConnection> (fd, true);
+      const auto done = make_shared<atomic<bool>> (false);
+      // Requests of a connection are read by a separate thread
+      connections. push_back (Connection {conn, done, thread ([conn, done, &queue] ()
+        {
+          if (FILE* f = ::fdopen (::dup (conn->fd), "r"))
           {
-            var_cast (al) -> reported = true;
-            break;
+            char* buf = nullptr;
+            size_t bufSize = 0;
+            ssize_t n = 0;
+            while ((n = ::getline (& buf, & bufSize, f)) >= 0)
+            {
+              string line (buf, (size_t) n);
+              trim (line);
+              if (! line. empty () && ! queue. push (ServeRequest {conn, std::move (line)}))
+                break;
+            }
+            free (buf);
+            fclose (f);
           }
+          *done = true;
         }
+      )});
+    }
+
+    stderr << "Stopping the server" << '\n';
+    ::close (sock);
+    ::unlink (socketPath. c_str ());
+    // The requests which have been read are processed and replied to
+    for (Connection& c : connections)
+    {
+      if (const shared_ptr<ServeConnection> conn = c. conn. lock ())
+        ::shutdown (conn->fd, SHUT_RD);
+      c. reader. join ();
+    }
+    signal (SIGTERM, SIG_DFL);
+    signal (SIGINT,  SIG_DFL);
+    ::close (serveStopPipe [0]);
+    ::close (serveStopPipe [1]);
+  }
+
+
+
+  string serveRequest (const string &line,
+                       size_t num,
+                       TsvOut &logTd) const
+  // Input: line: JSON request
+  //        num: unique
+  // Return: JSON reply
+  {
+    string id ("null");
+    const string subDir ("serve" + to_string (num) + "/");
+    string inputFName;
+      // "sequence"
+    string report;
+    string error;
+    try
+    {
+      istringstream iss (line);
+      const JsonMap req (iss);
+      if (req. at ("id"))
+      {
+        // As in the request
+        id = jsonRawValue (line, "id");
+        ASSERT (! id. empty ());
       }
+      ReportFormat reqFormat (format);
+      if (const Json* j = req. at ("name"))
+        reqFormat. name = jsonUnescape (j->getString ());
+      if (contains (reqFormat. name, '\t'))
+        throw runtime_error ("\"name\" cannot contain a tab character");
+      if (const Json* j = req. at ("format"))
+      {
+        const string formatS (j->getString ());
+        if (formatS == "amrfinder")
+          reqFormat. amrfinder = true;
+        else if (formatS == "stxtyper")
+          reqFormat. amrfinder = false;
+        else
+          throw runtime_error ("Unknown \"format\": " + strQuote (formatS));
+      }
+      if (const Json* j = req. at ("print_node"))
+        reqFormat. print_node = j->getBoolean ();
+      if (reqFormat. print_node && ! reqFormat. amrfinder)
+        throw runtime_error ("\"print_node\" requires the \"amrfinder\" format");
+
+      const Json* file     = req. at ("file");
+      const Json* sequence = req. at ("sequence");
+      if ((file == nullptr) == (sequence == nullptr))
+        throw runtime_error ("Exactly one of \"file\" and \"sequence\" is expected");
+      string fName;
+      if (file)
+        fName = jsonUnescape (file->getString ());
+      else
+      {
+        inputFName = tmp + "/serve" + to_string (num) + ".fa";
+        fName = inputFName;
+        string seq (jsonUnescape (sequence->getString ()));
+        trim (seq);
+        if (! isLeft (seq, ">"))
+          seq = ">sequence\n" + seq;
+        OFStream f (fName);
+        f << seq << '\n';
+      }
+
+      ostringstream os;
+      {
+        TsvOut td (os, 2, false);
+        td. flushLn   = false;
+        td. jsonLines = jsonLines;
+        saveReportHeader (td, reqFormat, ! reqFormat. name. empty ());
+        typeAssemblyCached (fName, subDir, reqFormat, td, logTd);
+      }
+      report = os. str ();
+    }
+    catch (const exception &e)
+    {
+      error = e. what ();
+      if (error. empty ())
+        error = "Error";
     }
+    if (! inputFName. empty () && ! logPtr)
+      removeFile (inputFName);
+
+    if (error. empty ())
+      return "{\"id\":" + id + ",\"status\":\"ok\",\"report\":" + jsonQuote (report) + "}";
+    return "{\"id\":" + id + ",\"status\":\"error\",\"error\":" + jsonQuote (error) + "}";
+  }
+
+
 
-  	LOG ("\ngoodBlastAls -> goodOperons (single-subunit)");
-    goodBlastAls. sort (BlastAlignment::reportLess); 
-    FFOR (size_t, i, goodBlastAls. size ())
+  void setBlastThreads (size_t blastThreads,
+                        bool splitQuery) const
+  // Input: splitQuery: typeAssembly() is run by the main thread
+  // Output: tblastnThreadsParam, queryFNames
+  {
+    ASSERT (blastThreads);
+    ASSERT (queryFNames. empty ());
+
+    const string stxFName (execDir + "stx.prot");
+    size_t refs = 0;
     {
-      const BlastAlignment* al1 = goodBlastAls [i];
-      ASSERT (al1);
-      if (al1->reported)
-        continue;
-      Operon op (*al1);
-      goodOperons << std::move (op);
-      FFOR_START (size_t, j, i + 1, goodBlastAls. size ())
+      LineInput f (stxFName);
+      while (f. nextLine ())
+        if (isLeft (f. line, ">"))
+          refs++;
+    }
+    QC_ASSERT (refs);
+    minimize (blastThreads, refs);
+
+    tblastnThreadsParam = getBlastThreadsParam ("tblastn", blastThreads);
+    if (blastThreads == 1 || ! tblastnThreadsParam. empty () || ! splitQuery)
+    {
+      queryFNames << stxFName;
+      return;
+    }
+
+    // tblastn without -num_threads: stx.prot is split into blastThreads contiguous parts, preserving the order of the tblastn output
+    const size_t partSize = refs / blastThreads + (refs % blastThreads ? 1 : 0);
+    LineInput f (stxFName);
+    unique_ptr<OFStream> part;
+    size_t n = 0;
+    while (f. nextLine ())
+    {
+      if (isLeft (f. line, ">"))
+      {
+        if (n % partSize == 0)
+        {
+          queryFNames << tmp + "/stx.prot." + to_string (queryFNames. size () + 1);
+          part. reset (new OFStream (queryFNames. back ()));
+        }
+        n++;
+      }
+      ASSERT (part. get ());
+      *part << f. line << endl;
+    }
+    ASSERT (queryFNames. size () <= blastThreads);
+  }
+
+
+
+  static StringVector getTieredSeqs (const StringVector &lines,
+                                     const Vector<PrescreenWindow> &windows,
+                                     bool &fallback)
+  // Input: lines: output of the fast tblastn search
+  //        windows: empty, or the sequences are PrescreenWindow::name()'s
+  // Output: fallback: a hit is partial or at a contig end
+  // Return: sorted unique ids of the sequences with hits
+  {
+    constexpr size_t contigEnd = 30;  // PAR, bp
+    fallback = false;
+    StringVector seqs;  seqs. reserve (lines. size ());
+    for (const string& line : lines)
+    {
+      FieldSplitter fs (line);
+      const string seq (fs. next ());
+      fs. next ();  // qseqid
+      size_t sstart = str2<size_t> (string (fs. next ()));
+      size_t send   = str2<size_t> (string (fs. next ()));
+      size_t slen   = str2<size_t> (string (fs. next ()));
+      const size_t qstart = str2<size_t> (string (fs. next ()));
+      const size_t qend   = str2<size_t> (string (fs. next ()));
+      const size_t qlen   = str2<size_t> (string (fs. next ()));
+      if (! windows. empty ())
+      {
+        // Contig coordinates
+        const size_t i = PrescreenWindow::index (seq);
+        QC_ASSERT (i < windows. size ());
+        const PrescreenWindow& w = windows [i];
+        if (w. contigLen)
+        {
+          sstart += w. offset;
+          send   += w. offset;
+          slen    = w. contigLen;
+        }
+      }
+      if (   qstart > 1
+          || qend < qlen
+          || min (sstart, send) <= contigEnd
+          || max (sstart, send) + contigEnd > slen
+         )
+        fallback = true;
+      seqs << seq;
+    }
+    seqs. sort ();
+    seqs. uniq ();
+    return seqs;
+  }
+
+
+
+  void searchContig (const string &id,
+                     const string &seq,
+                     ContigSearch &res) const
+  // Update: res
+  {
+    if (! prescreen)
+    {
+      ASSERT (native);
+      native->search (id, seq, res. hits);
+      return;
+    }
+    Vector<PrescreenWindow> windows;
+    prescreen->processSeq (id, seq, windows);
+    for (PrescreenWindow& w : windows)
+    {
+      res. windows << WindowSearch ();
+      WindowSearch& ws = res. windows. back ();
+      if (locusCache)
+      {
+        ws. key = locusCache->getKey (seq, w. offset, w. len);
+        ws. cached = locusCache->get (ws. key, ws. cachedLines);
+      }
+      if (! ws. cached)
+      {
+        ws. seq = seq. substr (w. offset, w. len);
+        if (native)
+        {
+          native->search (id, ws. seq, ws. hits);
+          if (locusCache)
+          {
+            StringVector lines;  lines. reserve (ws. hits. size ());
+            for (const NativeSearch::Hit& hit : ws. hits)
+              lines << hit. toCache ();
+            locusCache->set (ws. key, lines);
+          }
+          ws. seq. clear ();
+        }
+      }
+      ws. window = std::move (w);
+    }
+  }
+
+
+
+  bool useBlastSubject (size_t seqs,
+                        size_t len) const
+  // Input: seqs, len: number and total length of the sequences to be searched by tblastn
+  // Return: true <=> tblastn -subject, false <=> makeblastdb and tblastn -db
+  {
+    if (blastStrategy == "subject")
+      return true;
+    if (blastStrategy == "db")
+      return false;
+    ASSERT (blastStrategy == "auto");
+    // makeblastdb costs more than the search of a small input, but -subject is not multi-threaded and compares each sequence separately
+    constexpr size_t subjectSeqs_max = 10000;     // PAR
+    constexpr size_t subjectLen_max  = 20000000;  // PAR
+    constexpr size_t threadsLen_min  = 2000000;   // PAR
+    if (seqs > subjectSeqs_max || len > subjectLen_max)
+      return false;
+    if (! tblastnThreadsParam. empty () && len > threadsLen_min)
+      return false;
+    return true;
+  }
+
+
+
+  void typeAssemblyCached (const string &fName,
+                           const string &subDir,
+                           const ReportFormat &format_,
+                           TsvOut &td,
+                           TsvOut &logTd) const
+  // Invokes: typeAssembly() if the report of fName is not in resultCache
+  {
+    if (! resultCache)
+    {
+      typeAssembly (fName, subDir, format_, td, logTd);
+      td. flush ();
+      return;
+    }
+
+    const string key (resultCache->getKey (fName, format_));
+    string rows;
+    if (resultCache->get (key, rows))
+    { 
+      LOG ("Report is found in the cache: " + key);
+      const lock_guard<mutex> lg (statsMtx);
+      stats. assemblies++;
+      stats. cachedReports++;
+    }
+    else
+    {
+      ReportFormat rowsFormat (format_);
+      rowsFormat. name. clear ();
+      ostringstream os;
+      {
+        TsvOut rowsTd (os, 2, false);
+        rowsTd. usePound = false;
+        rowsTd. flushLn  = false;
+        typeAssembly (fName, subDir, rowsFormat, rowsTd, logTd);
+      }
+      rows = os. str ();
+      resultCache->set (key, rows);
+    }
+
+    saveRows (td, format_. name, rows);
+    td. flush ();
+  }
+
+
+
+  static void saveRows (TsvOut &td,
+                        const string &name,
+                        const string &rows)
+  // Input: name: empty <=> no first column "name"
+  //        rows: tab-delimited lines without a header
+  {
+    istringstream iss (rows);
+    string line;
+    while (getline (iss, line))
+    {
+      if (! name. empty ())
+        td << name;
+      size_t start = 0;
+      for (;;)
       {
-        const BlastAlignment* al2 = goodBlastAls [j];
-        ASSERT (al2);          
-        if (! (   al2->targetName   == al1->targetName
-               && al2->targetStrand == al1->targetStrand
-              )
-           )
+        const size_t tab = line. find ('\t', start);
+        td << line. substr (start, tab == string::npos ? string::npos : tab - start);
+        if (tab == string::npos)
           break;
-        if (   ! al2->reported
-            && al2->insideEq (*al1)
-            && (   al2->stxType [0] == al1->stxType [0] 
-                || al2->getDiff () >= al1->getDiff ()
-              //|| al1->getIdentity () >= al2->getIdentity ()
-               )
-           )
-          var_cast (al2) -> reported = true;
+        start = tab + 1;
       }
+      td. newLn ();
     }
+  }
+
+
+
+  void typeAssembly (const string &fName,
+                     const string &subDir,
+                     const ReportFormat &format_,
+                     TsvOut &td,
+                     TsvOut &logTd) const
+  // Input: fName: unquoted
+  //        subDir: of Scratch, empty or ends with '/'
+  // Output: td
+  {
+    const uint   gencode    =             /*arg2uint ("translation_table")*/ 11; 
+    TRACE (1, "Assembly:\t" << fName << '\t' << subDir);
+    
+    RunStats st;
+    st. assemblies = 1;
+
+    // The native search has no temporary files
+    unique_ptr<const Scratch> scratch;
+    if (! native)
+    {
+      size_t fileSize = 0;
+      try { fileSize = (size_t) getFileSize (fName); }
+        catch (const exception &) { errno = 0; }  // Not a regular file, reported by FastaCheck
+      // dna_flat or prescreen, and the BLAST database of the same size
+      const size_t bytes = 2 * fileSize * (isGzipped (fName) ? 4 : 1);  // PAR
+      scratch. reset (new Scratch (*this, subDir, bytes));
+      if (scratch->ram)
+        st. scratchRam++;
+      else
+        st. scratchDisk++;
+    }
+    const string dir (scratch ? scratch->dir : noString);
+    auto addStats = [this, &st] ()
+      {
+        const lock_guard<mutex> lg (statsMtx);
+        stats. add (st);
+      };
+
+
+    // Validation and prescreen in one pass, a gzipped file is decompressed while reading
+    string dna_flatFName (fName);
+    string dna_flat (shellQuote (dna_flatFName));
+      // Quoted, for BLAST
+    Vector<PrescreenWindow> windows;
+    Vector<uint64_t> windowKeys;
+      // Parallel to windows if locusCache
+    Vector<size_t> uncached;
+      // Indexes of windows to be searched by tblastn
+    StringVector cachedLines;
+      // tblastn lines of the cached windows, with the score
+    Vector<NativeSearch::Hit> nativeHits;
+    size_t nSeqs = 0;
+  #if BLASTX
+    size_t nDna = 0;
+  #endif
+    size_t dnaLen_max = 0;
+    size_t dnaLen_total = 0;
+    {
+      unique_ptr<OFStream> prescreenF;
+      if (prescreen && ! native)
+        prescreenF. reset (new OFStream (dir + "prescreen"));
+      auto addResult = [&] (ContigSearch &res)
+        // Windows are numbered in the file order
+        {
+          for (WindowSearch& ws : res. windows)
+          {
+            const size_t i = windows. size ();
+            windows << std::move (ws. window);
+            const string name (PrescreenWindow::name (i));
+            if (locusCache)
+              windowKeys << ws. key;
+            if (ws. cached)
+            {
+              st. cachedWindows++;
+              for (const string& line : ws. cachedLines)
+                if (native)
+                  nativeHits << NativeSearch::Hit (name, line);
+                else
+                  cachedLines << name + '\t' + line;
+            }
+            else if (native)
+              for (NativeSearch::Hit& hit : ws. hits)
+              {
+                hit. line = name + hit. line. substr (hit. line. find ('\t'));
+                nativeHits << std::move (hit);
+              }
+            else
+            {
+              *prescreenF << '>' << name << '\n' << ws. seq << '\n';
+              uncached << i;
+            }
+          }
+          for (NativeSearch::Hit& hit : res. hits)
+            nativeHits << std::move (hit);
+        };
+      // Contigs are searched by the reading thread, or in batches by the tasks of ThreadPool::global()
+      const bool pipeline =    (prescreen || native)
+                            && threads_max > 1;
+      map<size_t,ContigSearch> batchResults;
+      mutex batchResultsMtx;
+      string workerError;
+      auto searchBatch = [this, &batchResults, &batchResultsMtx, &workerError] (const ContigBatch &b)
+        {
+          ContigSearch res;
+          try
+          {
+            FFOR (size_t, i, b. ids. size ())
+              searchContig (b. ids [i], b. seqs [i], res);
+          }
+          catch (const exception &e)
+          {
+            const lock_guard<mutex> lg (batchResultsMtx);
+            if (workerError. empty ())
+              workerError = e. what ();
+          }
+          const lock_guard<mutex> lg (batchResultsMtx);
+          batchResults [b. index] = std::move (res);
+        };
+      TaskGroup tg;
+        // Before batch and processSeq, by ~TaskGroup() running batch tasks finish before the variables they use are destroyed
+      auto pushBatch = [&tg, &searchBatch] (ContigBatch &&b)
+        {
+          const auto b_ = make_shared<ContigBatch> (std::move (b));
+          tg. waitBelow (2 * threads_max);  // PAR
+          tg. run ([&searchBatch, b_] () { searchBatch (*b_); });
+        };
+      ContigBatch batch;
+      function<void (const string&, const string&)> processSeq;
+      if (pipeline)
+        processSeq = [&batch, &pushBatch] (const string &id, const string &seq)
+          { 
+            constexpr size_t batchLen_min = 1000000;  // PAR
+            batch. ids  << id;
+            batch. seqs << seq;
+            batch. len  += seq. size ();
+            if (batch. len >= batchLen_min)
+            {
+              const size_t index = batch. index;
+              pushBatch (std::move (batch));
+              batch = ContigBatch ();
+              batch. index = index + 1;
+            }
+          };
+      else if (prescreen || native)
+        processSeq = [this, &addResult] (const string &id, const string &seq)
+          { 
+            ContigSearch res;
+            searchContig (id, seq, res);
+            addResult (res);
+          };
+      unique_ptr<OFStream> dnaF;
+      if (! native && ! prescreen && isGzipped (fName))
+      {
+        dna_flatFName = dir + "dna_flat";
+        dna_flat = shellQuote (dna_flatFName);
+        dnaF. reset (new OFStream (dir + "dna_flat"));
+      }
+      const Chronometer_OnePass_cerr cop ("fasta_check");
+      st. fasta_check. start ();
+      FastaCheck fc;
+      fc. hyphen = true;
+      fc. ambig  = true;
+      fc. outF   = dnaF. get ();  // The checks are the same since hyphens and ambiguities are allowed
+      fc. run (fName, processSeq);
+      if (pipeline)
+      {
+        if (! batch. ids. empty ())
+          pushBatch (std::move (batch));
+        tg. wait ();
+      }
+      if (! workerError. empty ())
+        throw runtime_error (workerError);
+      for (auto& it : batchResults)
+        addResult (it. second);
+      st. fasta_check. stop ();
+    #if BLASTX
+      nDna         = fc. ids. size ();
+    #endif
+      dnaLen_max   = fc. seqSize_max;
+      dnaLen_total = fc. seqSize_sum;
+      nSeqs        = fc. ids. size ();
+    }
+  #if BLASTX
+    QC_ASSERT (nDna);
+  #endif
+    QC_ASSERT (dnaLen_max);
+    QC_ASSERT (dnaLen_total);
+    st. contigs = nSeqs;
+    st. bp      = dnaLen_total;
+    st. windows = windows. size ();
+
+    string blastInFName (dna_flatFName);
+      // Unquoted
+    // Size of blastInFName
+    size_t blastSeqs = nSeqs;
+    size_t blastLen  = dnaLen_total;
+    if (prescreen)
+    {
+      LOG ("# Prescreen windows: " + to_string (windows. size ()) + ", cached: " + to_string (windows. size () - uncached. size ()));
+      if (windows. empty ())
+      {
+        addStats ();
+        return;  // Header-only report
+      }
+      blastInFName = dir + "prescreen";
+      blastSeqs = uncached. size ();
+      blastLen  = 0;
+      for (const size_t i : uncached)
+        blastLen += windows [i]. len;
+    }
+
+	  OperonTyping typing;
+	  auto addBlastAl = [&windows, &typing] (const string &line)
+	    {
+  	    TRACE (3, line);
+  	    typing. add (line, windows);
+	    };
+	  auto addScoredBlastAl = [&addBlastAl, dnaLen_total, nSeqs] (string line)
+	    // Input: line: with the score, see LocusCache
+	    // E-value as for the native search
+	    {
+	      const size_t pos = line. rfind ('\t');
+	      QC_ASSERT (pos != string::npos);
+	      const int score = str2<int> (line. substr (pos + 1));
+	      line. erase (pos);
+	      // qlen
+	      string_view rest (line);
+	      FFOR (size_t, i, 7)
+	      {
+	        const size_t tab = rest. find ('\t');
+	        QC_ASSERT (tab != string_view::npos);
+	        rest. remove_prefix (tab + 1);
+	      }
+	      const size_t qlen = str2<size_t> (string (rest. substr (0, rest. find ('\t'))));
+	      if (NativeSearch::getEvalue (score, NativeSearch::getSearchSpace (qlen, dnaLen_total, nSeqs)) <= tblastnEvalue)
+	        addBlastAl (line);
+	    };
+	    
+	    
+	//stderr. section ("Running blast");
+	  if (typer)
+	  {
+	    st. native_search. start ();
+	    typer->addHits (std::move (nativeHits), windows, dnaLen_total, nSeqs, typing);
+	    st. native_search. stop ();
+	  }
+	  else if (! prescreen || ! uncached. empty ())
+		{
+			const Chronometer_OnePass_cerr cop ("blast");
+  	  map<size_t,StringVector> window2lines;
+  	    // For locusCache
+  	  auto addBlastLine = [this, &window2lines, &addBlastAl, &addScoredBlastAl] (const string &line)
+  	    {
+  	      if (locusCache)
+  	      {
+  		      string rest (line);
+  		      const string name (findSplit (rest, '\t'));
+  		      window2lines [PrescreenWindow::index (name)] << std::move (rest);
+  		      addScoredBlastAl (line);
+  		    }
+  		    else
+  		      addBlastAl (line);
+  	    };
+ 			// Database: created by ~brovervv/code/database/stx.prot.sh
+    #if BLASTX
+  		const string blast_fmt ("-outfmt '6 qseqid sseqid qstart qend qlen sstart send slen qseq sseq'");
+			exec (fullProg ("blastx") + " -query " + dna_flat + " -db " + execDir + "stx.prot  " 
+			      + "-comp_based_stats 0  -evalue 1e-10  -seg no  -max_target_seqs 10000  -word_size 5  -query_gencode " + to_string (gencode) + " "
+			      + getBlastThreadsParam ("blastx", min (nDna, dnaLen_total / 10002)) 
+			      + " " + blast_fmt + " -out " + dir + "blast > /dev/null 2> " + dir + "blast-err", dir + "blast-err");
+			{
+        LineInput f (dir + "blast");
+    	  while (f. nextLine ())
+    	    addBlastLine (f. line);
+    	}
+ 		#else
+ 			auto getTarget = [&] (const string &inFName,
+ 			                      size_t seqs,
+ 			                      size_t len,
+ 			                      const string &db,
+ 			                      string &threadsParam_) -> string
+ 			  // Input: inFName: unquoted FASTA file of seqs sequences of len bp
+ 			  //        db: name of the BLAST database in dir
+ 			  // Output: threadsParam_
+ 			  // Return: tblastn target parameters, E-values are as for the whole assembly
+ 			  {
+   			  const bool subject = useBlastSubject (seqs, len);
+   			  LOG ("# tblastn " + string (subject ? "-subject" : "-db") + ": " + to_string (seqs) + " sequences, " + to_string (len) + " bp");
+   			  const string dbsize ("  -dbsize " + to_string (dnaLen_total));
+   			  if (subject)
+   			  {
+   			    // No database, one process per query part
+   			    st. blastSubject++;
+   			    threadsParam_. clear ();
+   			    return "-subject " + shellQuote (inFName) + dbsize;
+   			  }
+ 			    st. blastDb++;
+ 			    st. makeblastdb. start ();
+ 			    exec (fullProg ("makeblastdb") + "-in " + shellQuote (inFName) + "  -dbtype nucl  -out " + dir + db + "  -logfile " + dir + db + ".log  > /dev/null", dir + db + ".log");
+ 			    st. makeblastdb. stop ();
+ 			    threadsParam_ = tblastnThreadsParam;
+ 			    return "-db " + dir + db + dbsize;
+ 			  };
+ 			string threadsParam;
+ 			const string target (getTarget (blastInFName, blastSeqs, blastLen, "db", threadsParam));
+ 			st. tblastn. start ();
+  		const string blast_fmt ("-outfmt '6 sseqid qseqid sstart send slen qstart qend qlen sseq qseq");
+  		const string evalueParams ("  -evalue " + toString (tblastnEvalue) + "  " + blast_fmt + "'");
+  		const string hitParams (locusCache ? "  -evalue " + toString (tblastnEvalue_locus) + "  " + blast_fmt + " score'" : evalueParams);
+  		  // Of the searches whose lines are added by addBlastLine()
+  		ASSERT (! queryFNames. empty ());
+  		StringVector errs (queryFNames. size ());
+  		auto blast = [&] (size_t i,
+  		                  const string &target_,
+  		                  const string &params,
+  		                  const function<void (const string &line)> &processLine)
+  		  // tblastn output is read from a pipe while tblastn is running
+  		  {
+  		    const string suffix (queryFNames. size () == 1 ? noString : ("." + to_string (i + 1)));
+  		    const string blastErr (dir + "blast-err" + suffix);
+  		    try
+  		    {
+      			PipeIStream blastOut (fullProg ("tblastn") + " -query " + queryFNames [i] + "  " + target_ + "  "
+                			            + tblastnParams + "  -db_gencode " + to_string (gencode)
+                			            + params
+                			            + " 2> " + blastErr);
+      			{
+      			  LineInput f (blastOut);
+      			  while (f. nextLine ())
+      			    processLine (f. line);
+      			}
+      			blastOut. close (blastErr);
+      		}
+      		catch (const exception &e)
+      		{
+      		  errs [i] = e. what ();
+      		}
+  		  };
+  		auto search = [&] (const string &target_,
+  		                   const string &params,
+  		                   const function<void (const string &line)> &processLine)
+  		  {
+    		  if (queryFNames. size () == 1)
+    		    blast (0, target_, params, processLine);
+    		  else
+    		  {
+    		    // The order of the tblastn output is preserved
+    		    Vector<StringVector> partLines (queryFNames. size ());
+    		    {
+      		    TaskGroup tg;
+      		    FFOR_START (size_t, i, 1, queryFNames. size ())
+      		      tg. run ([&partLines, &blast, &target_, &params, i] () { blast (i, target_, params, [&partLines, i] (const string &line) { partLines [i] << line; }); });
+      		    blast (0, target_, params, processLine);
+      		    tg. wait ();
+      		  }
+    		    FFOR_START (size_t, i, 1, queryFNames. size ())
+    		    {
+    		      for (const string& line : partLines [i])
+    		        processLine (line);
+    		      partLines [i]. clear ();
+    		    }
+    		  }
+    		  for (string& err : errs)
+    		    if (! err. empty ())
+    		      throw runtime_error (err);
+    		};
+  		const string params (threadsParam);  // "-mt_mode 1" reduces time by 30%
+  		if (tiered)
+  		{
+  		  // Fast search of blastInFName, then the sensitive search of the hit sequences of blastInFName
+  		  StringVector fastLines;
+  		  search (target, "  " + tblastnFastParams + params + evalueParams, [&fastLines] (const string &line) { fastLines << line; });
+  		  bool fallback = false;
+  		  const StringVector hitSeqs (getTieredSeqs (fastLines, windows, fallback));
+  		  LOG ("# Tiered search: " + to_string (hitSeqs. size ()) + " sequences with hits" + (fallback ? ", partial hits: full search" : ""));
+  		  if (fallback)
+  		  {
+  		    st. tieredFallback++;
+  		    search (target, params + hitParams, addBlastLine);
+  		  }
+  		  else if (! hitSeqs. empty ())
+  		  {
+  		    const string tier2 (dir + "tier2");
+  		    size_t tier2Len = 0;
+  		    {
+  		      OFStream out (tier2);
+  		      LineInput f (blastInFName);
+  		      bool hit = false;
+  		      while (f. nextLine ())
+  		      {
+  		        if (isLeft (f. line, ">"))
+  		        {
+  		          string id (f. line. substr (1));
+  		          id = findSplit (id);
+  		          hit = hitSeqs. containsFast (id);
+  		        }
+  		        else if (hit)
+  		          tier2Len += f. line. size ();
+  		        if (hit)
+  		          out << f. line << '\n';
+  		      }
+  		    }
+  		    string tier2ThreadsParam;
+  		    const string tier2Target (getTarget (tier2, hitSeqs. size (), tier2Len, "tier2db", tier2ThreadsParam));
+  		    search (tier2Target, tier2ThreadsParam + hitParams, addBlastLine);
+  		  }
+  		}
+  		else
+  		  search (target, params + hitParams, addBlastLine);
+  		st. tblastn. stop ();
+		#endif
+  		if (locusCache)
+  		  for (const size_t i : uncached)
+  		    locusCache->set (windowKeys [i], window2lines [i]);
+		}
+  	st. parsing. start ();
+  	for (const string& line : cachedLines)
+  	  addScoredBlastAl (line);
+  	LOG ("# All stx blasts: " + to_string (typing. blastAls. size ()));
+  	typing. group ();
+    st. parsing. stop ();
+    st. hits   = typing. blastAls. size ();
+    st. groups = typing. groups. size ();
+    
+    st. operons. start ();
+    typing. findOperons (logTd);
+    st. operons. stop ();
 
     // Report
-    goodOperons. sort (Operon::reportLess);     
-  	for (const Operon& op : goodOperons)
-   	  op. saveTsvOut (td, false);
+    st. report. start ();
+  	for (const Operon& op : typing. goodOperons)
+   	  op. saveTsvOut (td, false, format_);
+    st. report. stop ();
+    st. reportedOperons = typing. goodOperons. size ();
+    TRACE (1, "Assembly done:\t" << fName << "\thits: " << st. hits << "\toperons: " << st. reportedOperons);
+    
+    addStats ();
   }
 };
 
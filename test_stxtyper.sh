@@ -71,6 +71,96 @@ function test_amrfinder_output {
     fi
 }
 
+function test_batch {
+    local test_base="$1"
+    local options="$2"
+
+    TESTS=$(( $TESTS + 1 ))
+
+    if ! $STXTYPER $options --batch "test/$test_base.tsv" > "test/$test_base.got"
+    then
+        echo "not ok: $STXTYPER returned a non-zero exit value indicating a failure of the software"
+        echo "#  $STXTYPER $options --batch test/$test_base.tsv > test/$test_base.got"
+        TEST_TEXT="$TEST_TEXT"$'\n'"Failed $test_base"
+        return 1
+    else
+        if ! diff -q "test/$test_base.expected" "test/$test_base.got"
+        then
+            echo "not ok: $STXTYPER returned output different from expected"
+            echo "#  $STXTYPER $options --batch test/$test_base.tsv > test/$test_base.got"
+            echo "# diff test/$test_base.expected test/$test_base.got"
+            diff "test/$test_base.expected" "test/$test_base.got"
+            echo "#  To approve run:"
+            echo "#     mv test/$test_base.got test/$test_base.expected "
+            TEST_TEXT="$TEST_TEXT"$'\n'"Failed $test_base"
+            return 1
+        else
+            echo "ok: test/$test_base.tsv"
+            return 0
+        fi
+    fi
+}
+
+function test_serve {
+    local test_base="$1"
+    local options="$2"
+
+    TESTS=$(( $TESTS + 1 ))
+
+    if ! $STXTYPER $options --serve - < "test/$test_base.jsonl" > "test/$test_base.got"
+    then
+        echo "not ok: $STXTYPER returned a non-zero exit value indicating a failure of the software"
+        echo "#  $STXTYPER $options --serve - < test/$test_base.jsonl > test/$test_base.got"
+        TEST_TEXT="$TEST_TEXT"$'\n'"Failed $test_base"
+        return 1
+    else
+        if ! diff -q "test/$test_base.expected" "test/$test_base.got"
+        then
+            echo "not ok: $STXTYPER returned output different from expected"
+            echo "#  $STXTYPER $options --serve - < test/$test_base.jsonl > test/$test_base.got"
+            echo "# diff test/$test_base.expected test/$test_base.got"
+            diff "test/$test_base.expected" "test/$test_base.got"
+            echo "#  To approve run:"
+            echo "#     mv test/$test_base.got test/$test_base.expected "
+            TEST_TEXT="$TEST_TEXT"$'\n'"Failed $test_base"
+            return 1
+        else
+            echo "ok: test/$test_base.jsonl"
+            return 0
+        fi
+    fi
+}
+
+function test_reads {
+    local test_base="$1"
+    local options="$2"
+
+    TESTS=$(( $TESTS + 1 ))
+
+    if ! $STXTYPER $options --reads "test/$test_base.fq.gz" > "test/$test_base.got"
+    then
+        echo "not ok: $STXTYPER returned a non-zero exit value indicating a failure of the software"
+        echo "#  $STXTYPER $options --reads test/$test_base.fq.gz > test/$test_base.got"
+        TEST_TEXT="$TEST_TEXT"$'\n'"Failed $test_base"
+        return 1
+    else
+        if ! diff -q "test/$test_base.expected" "test/$test_base.got"
+        then
+            echo "not ok: $STXTYPER returned output different from expected"
+            echo "#  $STXTYPER $options --reads test/$test_base.fq.gz > test/$test_base.got"
+            echo "# diff test/$test_base.expected test/$test_base.got"
+            diff "test/$test_base.expected" "test/$test_base.got"
+            echo "#  To approve run:"
+            echo "#     mv test/$test_base.got test/$test_base.expected "
+            TEST_TEXT="$TEST_TEXT"$'\n'"Failed $test_base"
+            return 1
+        else
+            echo "ok: test/$test_base.fq.gz"
+            return 0
+        fi
+    fi
+}
+
 
 test_input_file 'basic'
 FAILURES=$(( $? + $FAILURES ))
@@ -84,12 +174,215 @@ FAILURES=$(( $? + $FAILURES ))
 test_input_file 'cases'
 FAILURES=$(( $? + $FAILURES ))
 
+test_input_file 'synthetics' '--no_prescreen'
+FAILURES=$(( $? + $FAILURES ))
+
 test_input_file 'amrfinder_integration' '--amrfinder'
 FAILURES=$(( $? + $FAILURES ))
 
 test_input_file 'amrfinder_integration2' '--amrfinder --print_node' 
 FAILURES=$(( $? + $FAILURES ))
 
+test_batch 'batch' '--threads 2'
+FAILURES=$(( $? + $FAILURES ))
+test_batch 'batch_json_lines' '--json_lines'
+FAILURES=$(( $? + $FAILURES ))
+
+# Shards of the manifest merged into the report of the whole manifest
+SHARDS=$(mktemp -d)
+for shard in 1 2 3
+do
+    $STXTYPER -q --batch test/batch.tsv --shard $shard/3 -o "$SHARDS/$shard.tsv"
+done
+TESTS=$(( $TESTS + 1 ))
+if $STXTYPER -q --batch test/batch.tsv --merge "$SHARDS/1.tsv,$SHARDS/2.tsv,$SHARDS/3.tsv" > test/batch.got \
+   && diff -q test/batch.expected test/batch.got
+then
+    echo "ok: --shard, --merge"
+else
+    echo "not ok: merged shards differ from test/batch.expected"
+    echo "# diff test/batch.expected test/batch.got"
+    TEST_TEXT="$TEST_TEXT"$'\n'"Failed shard_merge"
+    FAILURES=$(( 1 + $FAILURES ))
+fi
+rm -rf "$SHARDS"
+
+# JSON Lines shards are merged by the unescaped names
+SHARDS=$(mktemp -d)
+for shard in 1 2 3
+do
+    $STXTYPER -q --engine native --json_lines --batch test/batch_escaped.tsv --shard $shard/3 -o "$SHARDS/$shard.jsonl"
+done
+TESTS=$(( $TESTS + 1 ))
+if $STXTYPER -q --json_lines --batch test/batch_escaped.tsv --merge "$SHARDS/1.jsonl,$SHARDS/2.jsonl,$SHARDS/3.jsonl" > test/batch_escaped.got \
+   && diff -q test/batch_escaped.expected test/batch_escaped.got
+then
+    echo "ok: --shard, --merge, --json_lines"
+else
+    echo "not ok: merged JSON Lines shards differ from test/batch_escaped.expected"
+    echo "# diff test/batch_escaped.expected test/batch_escaped.got"
+    TEST_TEXT="$TEST_TEXT"$'\n'"Failed shard_merge_json_lines"
+    FAILURES=$(( 1 + $FAILURES ))
+fi
+rm -rf "$SHARDS"
+
+# Replies are in the request order with one thread
+test_serve 'serve'
+FAILURES=$(( $? + $FAILURES ))
+
+# Local assembly of simulated reads of stx1a and stx2c contigs and of a contig without stx
+test_reads 'reads'
+FAILURES=$(( $? + $FAILURES ))
+
+# The second run uses the cached search results
+LOCUS_CACHE=$(mktemp -d)
+for run in 1 2
+do
+    test_input_file 'synthetics' "--locus_cache $LOCUS_CACHE"
+    FAILURES=$(( $? + $FAILURES ))
+done
+rm -rf "$LOCUS_CACHE"
+
+# The search results cached for an assembly are used for an assembly of another size
+LOCUS_CACHE=$(mktemp -d)
+BIGGER=$(mktemp -d)
+STATS=$(mktemp)
+cp test/synthetics.fa "$BIGGER/synthetics.fa"
+{ echo '>filler'; head -c 100000 /dev/zero | tr '\0' 'A' | fold -w 80; echo; } >> "$BIGGER/synthetics.fa"
+TESTS=$(( $TESTS + 1 ))
+if $STXTYPER -q -n test/synthetics.fa --locus_cache "$LOCUS_CACHE" > /dev/null \
+   && $STXTYPER -q -n "$BIGGER/synthetics.fa" --locus_cache "$LOCUS_CACHE" --stats "$STATS" > "$BIGGER/synthetics.got" \
+   && diff -q test/synthetics.expected "$BIGGER/synthetics.got" \
+   && [ "$(grep -o '"cached_prescreen_windows":[0-9]*' "$STATS" | cut -d: -f2)" == "$(grep -o '"prescreen_windows":[0-9]*' "$STATS" | cut -d: -f2)" ]
+then
+    echo "ok: --locus_cache, assembly of another size"
+else
+    echo "not ok: --locus_cache is not used for an assembly of another size"
+    TEST_TEXT="$TEST_TEXT"$'\n'"Failed locus_cache size"
+    FAILURES=$(( 1 + $FAILURES ))
+fi
+rm -rf "$LOCUS_CACHE" "$BIGGER" "$STATS"
+
+# The second run uses the cached report
+CACHE_DIR=$(mktemp -d)
+for run in 1 2
+do
+    test_input_file 'amrfinder_integration2' "--amrfinder --print_node --cache_dir $CACHE_DIR"
+    FAILURES=$(( $? + $FAILURES ))
+done
+rm -rf "$CACHE_DIR"
+
+# A report cached with the prescreen is not reused with --no_prescreen
+CACHE_DIR=$(mktemp -d)
+STATS=$(mktemp)
+test_input_file 'basic' "--engine native --cache_dir $CACHE_DIR"
+FAILURES=$(( $? + $FAILURES ))
+test_input_file 'basic' "--engine native --no_prescreen --cache_dir $CACHE_DIR --stats $STATS"
+FAILURES=$(( $? + $FAILURES ))
+TESTS=$(( $TESTS + 1 ))
+if grep -q '"cached_reports":0' "$STATS"
+then
+    echo "ok: --cache_dir, --no_prescreen"
+else
+    echo "not ok: the report cached with the prescreen is used with --no_prescreen"
+    TEST_TEXT="$TEST_TEXT"$'\n'"Failed cache_dir no_prescreen"
+    FAILURES=$(( 1 + $FAILURES ))
+fi
+rm -rf "$CACHE_DIR" "$STATS"
+
+# Both tblastn strategies
+test_input_file 'synthetics' '--no_prescreen --blast_strategy subject'
+FAILURES=$(( $? + $FAILURES ))
+test_input_file 'synthetics' '--no_prescreen --blast_strategy db'
+FAILURES=$(( $? + $FAILURES ))
+
+# Two-tier tblastn search
+test_input_file 'synthetics' '--tiered'
+FAILURES=$(( $? + $FAILURES ))
+test_input_file 'cases' '--no_prescreen --tiered'
+FAILURES=$(( $? + $FAILURES ))
+
+# The prescreen is less sensitive than tblastn: the reports of tblastn with and without the prescreen are compared
+for test_base in basic synthetics virulence_ecoli cases
+do
+    TESTS=$(( $TESTS + 1 ))
+    if $STXTYPER -q -n "test/$test_base.fa" > "test/$test_base.prescreen.got" \
+       && $STXTYPER -q --no_prescreen -n "test/$test_base.fa" > "test/$test_base.no_prescreen.got" \
+       && diff -q "test/$test_base.no_prescreen.got" "test/$test_base.prescreen.got"
+    then
+        echo "ok: prescreen concordance test/$test_base.fa"
+    else
+        echo "not ok: $STXTYPER failed or reports different operons with and without --no_prescreen"
+        echo "# diff test/$test_base.no_prescreen.got test/$test_base.prescreen.got"
+        TEST_TEXT="$TEST_TEXT"$'\n'"Failed prescreen concordance $test_base"
+        FAILURES=$(( 1 + $FAILURES ))
+    fi
+done
+
+# --stats
+STATS=$(mktemp)
+test_input_file 'basic' "--stats $STATS"
+FAILURES=$(( $? + $FAILURES ))
+TESTS=$(( $TESTS + 1 ))
+if grep -q '"reported_operons":' "$STATS" && grep -q '"tblastn":{' "$STATS"
+then
+    echo "ok: --stats"
+else
+    echo "not ok: --stats file $STATS has no counters or stages"
+    TEST_TEXT="$TEST_TEXT"$'\n'"Failed stats"
+    FAILURES=$(( 1 + $FAILURES ))
+fi
+rm -f "$STATS"
+
+# The error line number of the last line without '\n' is the same for a mapped and for a gzipped file
+if [ -x ./fasta_check ]
+then
+    NO_EOL=$(mktemp -d)
+    gzip -c test/no_eol.fasta > "$NO_EOL/no_eol.fasta.gz"
+    TESTS=$(( $TESTS + 1 ))
+    if ./fasta_check test/no_eol.fasta 2>&1 | grep -q 'line 4: Wrong nucleotide character' \
+       && ./fasta_check "$NO_EOL/no_eol.fasta.gz" 2>&1 | grep -q 'line 4: Wrong nucleotide character'
+    then
+        echo "ok: fasta_check test/no_eol.fasta"
+    else
+        echo "not ok: fasta_check does not report line 4 of test/no_eol.fasta"
+        TEST_TEXT="$TEST_TEXT"$'\n'"Failed no_eol"
+        FAILURES=$(( 1 + $FAILURES ))
+    fi
+    rm -rf "$NO_EOL"
+fi
+
+# Concordance of the built-in search with tblastn
+for test_base in basic synthetics virulence_ecoli cases
+do
+    test_input_file "$test_base" '--engine native'
+    FAILURES=$(( $? + $FAILURES ))
+done
+test_reads 'reads' '--engine native'
+FAILURES=$(( $? + $FAILURES ))
+
+test_input_file 'amrfinder_integration2' '--amrfinder --print_node --engine native' 
+FAILURES=$(( $? + $FAILURES ))
+
+# libstxtyper.a: Typer in concurrent threads, as --engine native
+if [ -x ./test_typer ]
+then
+    for test_base in basic synthetics virulence_ecoli cases
+    do
+        TESTS=$(( $TESTS + 1 ))
+        if ./test_typer "test/$test_base.fa" 2> /dev/null > "test/$test_base.got" \
+           && diff -q "test/$test_base.expected" "test/$test_base.got"
+        then
+            echo "ok: test_typer test/$test_base.fa"
+        else
+            echo "not ok: ./test_typer test/$test_base.fa failed or differs from test/$test_base.expected"
+            echo "# diff test/$test_base.expected test/$test_base.got"
+            TEST_TEXT="$TEST_TEXT"$'\n'"Failed test_typer $test_base"
+            FAILURES=$(( 1 + $FAILURES ))
+        fi
+    done
+fi
+
 echo "Done."
 echo "$TEST_TEXT"
 echo ""
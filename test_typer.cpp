@@ -0,0 +1,160 @@
+// test_typer.cpp
+
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+* Author: Vyacheslav Brover
+*
+* File Description:
+*   Test of libstxtyper.a
+*
+*/
+
+
+#undef NDEBUG
+
+#include "common.hpp"
+#include "tsv.hpp"
+using namespace Common_sp;
+#include "stx.hpp"
+using namespace Stx_sp;
+
+#include "common.inc"
+
+
+
+namespace
+{
+
+
+struct ThisApplication : Application
+{
+  ThisApplication ()
+    : Application ("Type an assembly held in memory by Typer of libstxtyper.a in concurrent threads, print the report as stxtyper --engine native.\nInvalid assemblies are checked to be rejected")
+    {
+      addPositional ("in", "Nucleotide FASTA file");
+      addKey ("stx_prot", "stx reference proteins", "stx.prot");
+      addKey ("threads_num", "Number of threads typing the assembly", "4");
+	    version = SVN_REV;
+    }
+
+
+
+  void body () const final
+  {
+    const string inFName    = getArg ("in");
+    const string protFName  = getArg ("stx_prot");
+    const size_t threadsNum = str2<size_t> (getArg ("threads_num"));
+    QC_ASSERT (threadsNum);
+
+    const Typer typer (protFName);
+
+    StringVector ids;
+    StringVector seqs;
+    {
+      LineInput f (inFName);
+      while (f. nextLine ())
+      {
+        trimTrailing (f. line);
+        if (isLeft (f. line, ">"))
+        {
+          string id (f. line. substr (1));
+          ids << findSplit (id);
+          seqs << string ();
+        }
+        else
+        {
+          QC_ASSERT (! seqs. empty ());
+          seqs. back () += f. line;
+        }
+      }
+    }
+    Typer::Seqs assembly;
+    FFOR (size_t, i, ids. size ())
+      assembly << Typer::Seqs::value_type (ids [i], seqs [i]);
+
+    // Reentrance
+    StringVector reports (threadsNum);
+    {
+      vector<thread> threads;
+      FFOR (size_t, i, threadsNum)
+        threads. emplace_back ([&typer, &assembly, &reports, i] ()
+          {
+            ostringstream oss;
+            {
+              TsvOut td (oss, 2, false);
+              td. usePound = false;
+              typer. saveTsvOut (assembly, ReportFormat (), td);
+            }
+            reports [i] = oss. str ();
+          });
+      for (thread& t : threads)
+        t. join ();
+    }
+    for (const string& report : reports)
+      QC_ASSERT (report == reports. front ());
+      
+    // The records are the rows of the report
+    QC_ASSERT (typer. type (assembly). size () == (size_t) count (reports. front (). begin (), reports. front (). end (), '\n'));
+
+    // Validation as by stxtyper
+    for (const string& bad : {string ("AC GT"), string ("ACXT"), string ()})
+    {
+      Typer::Seqs badAssembly (assembly);
+      badAssembly << Typer::Seqs::value_type ("bad", bad);
+      bool thrown = false;
+      try { typer. type (badAssembly); }
+        catch (const exception &) { thrown = true; }
+      QC_ASSERT (thrown);
+    }
+    if (! assembly. empty ())
+    {
+      Typer::Seqs dupAssembly (assembly);
+      dupAssembly << assembly. front ();
+      bool thrown = false;
+      try { typer. type (dupAssembly); }
+        catch (const exception &) { thrown = true; }
+      QC_ASSERT (thrown);
+    }
+
+    {
+      TsvOut td (cout, 2, false);
+      saveReportHeader (td, ReportFormat (), false);
+    }
+    cout << reports. front ();
+  }
+};
+
+
+
+}  // namespace
+
+
+
+int main (int argc,
+          const char* argv[])
+{
+  ThisApplication app;
+  return app. run (argc, argv);
+}
@@ -294,6 +294,8 @@ public:
 
 		
 struct TsvOut
+// Output: lines of tab-delimited fields, the first line is a header
+//         or JSON Lines: an object per line with the header fields as keys
 {
 private:
   ostream* os {nullptr};
@@ -301,8 +303,14 @@ private:
   size_t lines {0};
   size_t fields_max {0};
   size_t fields {0};
+  StringVector header;
+    // jsonLines
 public:
   bool usePound {true};
+  bool flushLn {true};
+    // false: buffered, flush() at the boundaries of groups of lines and by ~TsvOut(), also on an exception
+  bool jsonLines {false};
+    // The header is not printed, the fields are JSON strings
   
   
   explicit TsvOut (ostream* os_arg,
@@ -320,6 +328,8 @@ public:
  ~TsvOut ()
     { if (fields)
         errorExitStr ("TsvOut: unfinished line with " + to_string (fields) + " fields"); 
+      if (! flushLn)
+        flush ();
     }
     
     
@@ -335,11 +345,22 @@ public:
       { if (os)
         { if (lines && fields >= fields_max)
             throw runtime_error ("TsvOut: fields_max = " + to_string (fields_max));
-          if (fields)  
-            *os << '\t'; 
-          else if (! lines && usePound)
-            *os << '#';
-          *os << field; 
+          if (jsonLines)
+          { ostringstream oss;
+            oss. copyfmt (*os);  // ONumber
+            oss << field;
+            if (lines)
+              *os << (fields ? ',' : '{') << jsonQuote (header [fields]) << ':' << jsonQuote (oss. str ());
+            else
+              header << oss. str ();
+          }
+          else
+          { if (fields)  
+              *os << '\t'; 
+            else if (! lines && usePound)
+              *os << '#';
+            *os << field; 
+          }
           fields++;
         }
         return *this; 
@@ -347,7 +368,12 @@ public:
   void newLn ()
     { if (! os)
         return;
-      *os << endl;
+      if (! jsonLines)
+        *os << '\n';
+      else if (lines)
+        *os << "}\n";
+      if (flushLn)
+        os->flush ();
       if (! lines)
         fields_max = fields;
       lines++;
@@ -355,6 +381,10 @@ public:
         throw runtime_error ("TsvOut: fields_max = " + to_string (fields_max) + ", but fields = " + to_string (fields));
       fields = 0;
     }
+  void flush ()
+    { if (os)
+        os->flush ();
+    }
 };
 
 